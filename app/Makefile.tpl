@@ -2,17 +2,18 @@
 #				Last revised:	 24 April 2020
 # This section of the Makefile should not need to be changed.
 
-CFILES = ann2rr.c bxb.c calsig.c ecgeval.c epicmp.c fir.c gqfuse.c gqpost.c \
- gqrs.c hrstats.c ihr.c mfilt.c mrgann.c mxm.c nguess.c nst.c plotstm.c \
- pscgen.c pschart.c psfd.c rdann.c rdsamp.c rr2ann.c rxr.c sampfreq.c sigamp.c \
- sigavg.c signame.c signum.c skewedit.c snip.c sortann.c sqrs.c sqrs125.c \
- stepdet.c sumann.c sumstats.c tach.c time2sec.c wabp.c wfdb-config.c \
- wfdbcat.c wfdbcollate.c wfdbdesc.c wfdbmap.c wfdbsignals.c wfdbtime.c \
- wfdbwhich.c wqrs.c wrann.c wrsamp.c xform.c
+CFILES = ann2rr.c anncvt.c bxb.c calsig.c ecgeval.c epicmp.c fir.c gqfuse.c \
+ gqpost.c gqrs.c hrstats.c ihr.c mfilt.c mrgann.c mxm.c nguess.c nst.c \
+ plotstm.c pscgen.c pschart.c psfd.c rdann.c rdsamp.c rr2ann.c rxr.c \
+ sampfreq.c sigamp.c sigavg.c signame.c signum.c skewedit.c snip.c sortann.c \
+ sqrs.c sqrs125.c stepdet.c sumann.c sumstats.c tach.c time2sec.c wabp.c \
+ wfdb-config.c wfdbcat.c wfdbcollate.c wfdbdesc.c wfdbmap.c wfdbsignals.c \
+ wfdbtime.c wfdbwhich.c wqrs.c wrann.c wrsamp.c xform.c
 CFFILES = gqrs.conf
 HFILES = signal-colors.h
 XFILES = \
  ann2rr$(EXEEXT) \
+ anncvt$(EXEEXT) \
  bxb$(EXEEXT) \
  calsig$(EXEEXT) \
  ecgeval$(EXEEXT) \
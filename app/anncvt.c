@@ -0,0 +1,183 @@
+/* file: anncvt.c			19 October 2026
+-------------------------------------------------------------------------------
+anncvt: Copy an annotation file in MIT or compact format
+Copyright (C) 2026
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, see <http://www.gnu.org/licenses/>.
+
+You may contact the author by e-mail (wfdb@physionet.org) or postal mail
+(MIT Room E25-505A, Cambridge, MA 02139 USA).  For updates to this software,
+please visit PhysioNet (http://www.physionet.org/).
+_______________________________________________________________________________
+
+This program copies an annotation file (in any format readable by annopen,
+including the compact format) to a new annotation file in MIT format, or (if
+the -c option is used) in compact format.  Compact-format annotation files
+store the fields of each block of annotations in separate columns, and contain
+an index that allows iannsettime to find a given time without reading the
+entire file (see "Compact annotation files" in lib/annot.c).
+
+Annotations are copied in the order in which they are read, even if they are
+not in canonical order (use sortann to rearrange them), and the time
+resolution and annotation type definitions of the input are preserved, so that
+converting an MIT-format file to compact format and back yields the same
+annotations.  The output annotation file is written to the current directory.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef __STDC__
+extern void exit();
+#endif
+
+#include <wfdb/wfdb.h>
+
+char *pname;
+
+main(argc, argv)
+int argc;
+char *argv[];
+{
+    static WFDB_Anninfo ai[2];
+    WFDB_Annotation annot;
+    char *record = NULL, *prog_name();
+    int i, stat;
+    double tps;
+    void help();
+
+    pname = prog_name(argv[0]);
+    ai[1].stat = WFDB_WRITE;
+
+    /* Interpret command-line options. */
+    for (i = 1; i < argc; i++) {
+	if (*argv[i] == '-') switch (*(argv[i]+1)) {
+	  case 'a':	/* (input) annotator follows */
+	    if (++i >= argc) {
+		(void)fprintf(stderr, "%s: annotator must follow -a\n",
+			      pname);
+		exit(1);
+	    }
+	    ai[0].name = argv[i];
+	    break;
+	  case 'c':	/* write compact-format output */
+	    ai[1].stat = WFDB_COMPACT_WRITE;
+	    break;
+	  case 'h':	/* print usage summary and quit */
+	    help();
+	    exit(0);
+	    break;
+	  case 'o':	/* output annotator follows */
+	    if (++i >= argc) {
+		(void)fprintf(stderr, "%s: annotator must follow -o\n",
+			      pname);
+		exit(1);
+	    }
+	    ai[1].name = argv[i];
+	    break;
+	  case 'r':	/* input record name follows */
+	    if (++i >= argc) {
+		(void)fprintf(stderr,
+			      "%s: input record name must follow -r\n",
+			      pname);
+		exit(1);
+	    }
+	    record = argv[i];
+	    break;
+	  default:
+	    (void)fprintf(stderr, "%s: unrecognized option %s\n",
+			  pname, argv[i]);
+	    exit(1);
+	}
+	else {
+	    (void)fprintf(stderr, "%s: unrecognized argument %s\n",
+			  pname, argv[i]);
+	    exit(1);
+	}
+    }
+
+    if (record == NULL || ai[0].name == NULL || ai[1].name == NULL) {
+	help();
+	exit(1);
+    }
+    if (strcmp(ai[0].name, ai[1].name) == 0) {
+	fprintf(stderr,
+		"%s: must specify different annotator names after -a and -o\n",
+		pname);
+	exit(1);
+    }
+
+    /* Out-of-order input is copied as is (see below), so wfdbquit should not
+       try to sort the output. */
+    putenv("WFDBANNSORT=0");
+
+    if (sampfreq(record) < 0.)
+	(void)setsampfreq(WFDB_DEFFREQ);
+
+    ai[0].stat = WFDB_READ;
+    if (annopen(record, ai, 2) < 0)
+	exit(2);
+    if ((tps = getiaorigfreq(0)) > 0) {
+	setafreq(tps);
+	setiafreq(0, tps);
+    }
+
+    /* Stop putann from buffering (and sorting) the output annotations, so
+       that they are written in the order in which they are read. */
+    wfdbflush();
+
+    while ((stat = getann(0, &annot)) == 0)
+	if (putann(0, &annot) < 0) {
+	    wfdbquit();
+	    exit(3);
+	}
+    wfdbquit();
+    exit(stat == -1 ? 0 : 3);	/*NOTREACHED*/
+}
+
+static char *help_strings[] = {
+ "usage: %s -r RECORD -a ANNOTATOR -o OUTANN [OPTIONS ...]\n",
+ "where RECORD and ANNOTATOR specify the input, OUTANN is the name of the",
+ "output annotator, and OPTIONS may include:",
+ " -c         write the output in compact format (default: MIT format)",
+ " -h         print this usage summary",
+NULL
+};
+
+void help()
+{
+    int i;
+
+    (void)fprintf(stderr, help_strings[0], pname);
+    for (i = 1; help_strings[i] != NULL; i++)
+	(void)fprintf(stderr, "%s\n", help_strings[i]);
+}
+
+char *prog_name(s)
+char *s;
+{
+    char *p = s + strlen(s);
+
+#ifdef MSDOS
+    while (p >= s && *p != '\\' && *p != ':') {
+	if (*p == '.')
+	    *p = '\0';		/* strip off extension */
+	if ('A' <= *p && *p <= 'Z')
+	    *p += 'a' - 'A';	/* convert to lower case */
+	p--;
+    }
+#else
+    while (p >= s && *p != '/')
+	p--;
+#endif
+    return (p+1);
+}
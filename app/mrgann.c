@@ -22,94 +22,122 @@ You may contact the author by e-mail (wfdb@physionet.org) or postal mail
 please visit PhysioNet (http://www.physionet.org/).
 _______________________________________________________________________________
 
-This program reads two annotation files and creates a third.  Command-line
-arguments divide the annotation files into segments.  Within each segment,
-the annotations copied to the output annotation file may be any of the
-following:
+This program reads two or more annotation files and creates another.
+Command-line arguments divide the annotation files into segments.  Within each
+segment, the annotations copied to the output annotation file may be those of
+any subset of the input files, selected by -mX, where X is the sum of 1 for
+the first input file, 2 for the second, 4 for the third, 8 for the fourth,
+etc.  Thus, for two input files, the annotations copied may be:
  - none (selected by -m0)
  - all annotations from the first input file (selected by -m1)
  - all annotations from the second input file (selected by -m2)
  - all annotations from both input files (default; selected by -m3)
+By default, annotations from all of the input files are copied.  In addition,
+the -w option can restrict the annotations copied from any input file to those
+within a specified time window.
 
-Optionally, mrgann can remap the `chan' field in each annotation from one or
-both input files to a value that can be specified separately (using -c or -C)
-for each input annotation file.  This feature may be useful, for example, to
-merge annotations for independent signals, where there may be occasional
-simultaneous input annotations.  By remapping only the `chan' fields from one
-input file, it is possible in two or more passes to merge three or more
-annotation files in this way.
+Optionally, mrgann can remap the `chan' field in each annotation from any of
+the input files to a value that can be specified separately (using -c or -C
+for the first or second input file, or -x for any of them) for each input
+annotation file.  This feature may be useful, for example, to merge
+annotations for independent signals, where there may be occasional
+simultaneous input annotations.
 
-When in `-m3' mode, if simultaneous annotations with the same `chan' field
-(after any remapping has been done) are present, only the annotation from the
-first annotator is copied, and a warning message is written to the standard
-output.  */
+If simultaneous annotations with the same `chan' field (after any remapping
+has been done) are present in two or more of the input files, only the
+annotation from the first of these input files (in the order in which they
+were named after -i) is copied, and (in verbose mode) a warning message is
+written to the standard error output.  Simultaneous annotations are written in
+`chan' order.
+
+All of the input files are read in a single pass, using the WFDB library's
+annotator merge (see wfdb_annmerge), so that merging N input files requires
+O(log N) time per annotation. */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #ifndef __STDC__
 extern void exit();
 #endif
 
 #include <wfdb/wfdb.h>
 
-/* mode definitions */
-#define UNINITIALIZED	(-1)
-#define DISCARD_ALL	0
-#define COPY_0		1
-#define COPY_1		2
-#define MERGE		3
+#define MAXIN	32	/* maximum number of input annotators */
+#define ALL	(~0UL)	/* mode:  copy annotations from all input annotators */
 
 char *pname, *record = NULL;
-static int ateof[2], map0 = -1, map1 = -1, vflag;
+static int ateof, nin, map[MAXIN], vflag;
+static int kmax;		/* largest input number given with -w or -x */
+static char *wfrom[MAXIN], *wto[MAXIN];
 static WFDB_Frequency sfreq, ffreq, afreq = 0;
-static WFDB_Anninfo ai[3];
-static WFDB_Annotation annot[2];
-void help(), mergeann();
+static WFDB_Anninfo ai[MAXIN+1];
+static WFDB_Annotation annot;	/* next annotation from the merged inputs */
+static WFDB_Annotator an;	/* input annotator from which it was read */
+static WFDB_Time from[MAXIN], to[MAXIN];
+struct gann {		/* simultaneous annotation (see mergeann) */
+    WFDB_Annotation annot;
+    WFDB_Annotator an;
+    unsigned char aux[257];
+} *group;
+static int maxgroup;
+void checkk(), help(), mergeann();
 
 main(argc, argv)	
 int argc;
 char *argv[];
 {
-    char *prog_name();
-    WFDB_Time tf = (WFDB_Time)(-1);
-    int i, mode = UNINITIALIZED, next_mode = MERGE;
+    char *p, *prog_name();
+    WFDB_Time tf = (WFDB_Time)(-1), wtime();
+    int i, j, initialized = 0;
+    unsigned long mode = ALL, next_mode;
 
     pname = prog_name(argv[0]);
+    for (j = 0; j < MAXIN; j++)
+	map[j] = -1;
 
     /* Interpret command-line options. */
     for (i = 1; i < argc; i++) {
 	if (*argv[i] == '-') switch (*(argv[i]+1)) {
-	  case 'c':	/* map0 follows */
+	  case 'c':	/* map for first annotator follows */
 	    if (++i >= argc) {
 		(void)fprintf(stderr,
 		     "%s: `chan' mapping for first annotator must follow -c\n",
 			      pname);
 		exit(1);
 	    }
-	    map0 = atoi(argv[i]);
-	    if (map0 < -1 || map0 > 255) map0 = -1;
+	    map[0] = atoi(argv[i]);
+	    if (map[0] < -1 || map[0] > 255) map[0] = -1;
 	    break;
-	  case 'C':	/* map1 follows */
+	  case 'C':	/* map for second annotator follows */
 	    if (++i >= argc) {
 		(void)fprintf(stderr,
 		    "%s: `chan' mapping for second annotator must follow -C\n",
 			      pname);
 		exit(1);
 	    }
-	    map1 = atoi(argv[i]);
-	    if (map1 < -1 || map1 > 255) map1 = -1;
+	    map[1] = atoi(argv[i]);
+	    if (map[1] < -1 || map[1] > 255) map[1] = -1;
 	    break;
 	  case 'h':	/* print usage summary and quit */
 	    help();
 	    exit(0);
 	    break;
 	  case 'i':	/* input annotators follow */
-	    if (++i >= argc-1) {
+	    for (nin = 0; i+1 < argc && *argv[i+1] != '-'; nin++) {
+		if (nin >= MAXIN) {
+		    (void)fprintf(stderr,
+				  "%s: too many input annotators (max %d)\n",
+				  pname, MAXIN);
+		    exit(1);
+		}
+		ai[nin].name = argv[++i]; ai[nin].stat = WFDB_READ;
+	    }
+	    if (nin < 2) {
 		(void)fprintf(stderr, "%s: input annotators must follow -i\n",
 			      pname);
 		exit(1);
 	    }
-	    ai[0].name = argv[i]; ai[0].stat = WFDB_READ;
-	    ai[1].name = argv[++i]; ai[1].stat = WFDB_READ;
 	    break;
 	  case 'm':	/* time to switch modes follows */
 	    if (++i >= argc) {
@@ -118,27 +146,23 @@ char *argv[];
 			      pname, argv[i-1]);
 		exit(1);
 	    }
-	    if (mode == UNINITIALIZED) {
+	    if (!initialized) {
 		init();
-		mode = MERGE;
+		initialized = 1;
 	    }
 	    tf = strtim(argv[i]);
 	    if (tf < (WFDB_Time)0) tf = -tf;
 	    if (argv[i][0] == 'e') tf = (WFDB_Time)(-1);
 	    else tf = (tf * afreq / sfreq) + 0.5;
 	    mergeann(mode, tf);
-	    switch (*(argv[i-1]+2)) {
-	      case '0': mode = DISCARD_ALL; break;
-	      case '1': mode = COPY_0; break;
-	      case '2': mode = COPY_1; break;
-	      case '3': mode = MERGE; break;
-	      default:
+	    next_mode = strtoul(argv[i-1]+2, &p, 10);
+	    if (p == argv[i-1]+2 || *p) {
 		fprintf(stderr,
-			"%s: unrecognized mode `%c' -> 3\n",
-			pname, *(argv[i]+2));
-		mode = MERGE;
-		break;
+		  "%s: unrecognized mode `%s' (all inputs will be copied)\n",
+			pname, argv[i-1]+2);
+		next_mode = ALL;
 	    }
+	    mode = next_mode;
 	    break;
 	  case 'o':	/* output annotator follows */
 	    if (++i >= argc) {
@@ -146,7 +170,7 @@ char *argv[];
 			      pname);
 		exit(1);
 	    }
-	    ai[2].name = argv[i]; ai[2].stat = WFDB_WRITE;
+	    ai[MAXIN].name = argv[i]; ai[MAXIN].stat = WFDB_WRITE;
 	    break;
 	  case 'r':	/* input record name follows */
 	    if (++i >= argc) {
@@ -160,6 +184,36 @@ char *argv[];
 	  case 'v':	/* verbose mode */
 	    vflag = 1;
 	    break;
+	  case 'w':	/* input number and time window follow */
+	    if ((i += 3) >= argc ||
+		(j = atoi(argv[i-2])) < 1 || j > MAXIN) {
+		(void)fprintf(stderr,
+		"%s: input number (1-%d), start and end times must follow -w\n",
+			      pname, MAXIN);
+		exit(1);
+	    }
+	    if (j > kmax) kmax = j;
+	    wfrom[j-1] = argv[i-1];	/* converted by init (or below) */
+	    wto[j-1] = argv[i];
+	    if (initialized) {	/* -w follows -m, so convert the window now */
+		checkk();
+		from[j-1] = wtime(wfrom[j-1]);
+		to[j-1] = wtime(wto[j-1]);
+	    }
+	    break;
+	  case 'x':	/* input number and `chan' mapping follow */
+	    if ((i += 2) >= argc ||
+		(j = atoi(argv[i-1])) < 1 || j > MAXIN) {
+		(void)fprintf(stderr,
+		  "%s: input number (1-%d) and `chan' mapping must follow -x\n",
+			      pname, MAXIN);
+		exit(1);
+	    }
+	    if (j > kmax) kmax = j;
+	    if (initialized) checkk();
+	    map[j-1] = atoi(argv[i]);
+	    if (map[j-1] < -1 || map[j-1] > 255) map[j-1] = -1;
+	    break;
 	  default:
 	    (void)fprintf(stderr, "%s: unrecognized option %s (ignored)\n",
 			  pname, argv[i]);
@@ -170,123 +224,152 @@ char *argv[];
 			  pname, argv[i]);
     }
 
-    if (mode == UNINITIALIZED) {
+    if (!initialized)
 	init();
-	mode = MERGE;
-    }
     mergeann(mode, (WFDB_Time)(-1));
 
     wfdbquit();
     exit(0);	/*NOTREACHED*/
 }
 
+/* Check that the input numbers given with -w and -x refer to inputs named
+   with -i. */
+void checkk()
+{
+    if (kmax > nin) {
+	(void)fprintf(stderr,
+		"%s: input %d (given with -w or -x) was not named with -i\n",
+		      pname, kmax);
+	help();
+	exit(1);
+    }
+}
+
+/* Convert a time given as an argument of -w into sample intervals. */
+WFDB_Time wtime(s)
+char *s;
+{
+    WFDB_Time t;
+
+    if (s[0] == 'e') return ((WFDB_Time)(-1));
+    t = strtim(s);
+    if (t < (WFDB_Time)0) t = -t;
+    return ((WFDB_Time)((t * afreq / sfreq) + 0.5));
+}
+
 init()
 {
-    WFDB_Frequency af1, af2;
-    if (record == NULL || ai[0].name == NULL ||
-	ai[1].name == NULL || ai[2].name == NULL) {
+    int i, nfreq = 0;
+    WFDB_Frequency af;
+    WFDB_Time wtime();
+
+    if (record == NULL || nin < 2 || ai[MAXIN].name == NULL) {
 	help();
 	exit(1);
     }
+    checkk();
     if ((sfreq = sampfreq(record)) < 0.)
 	(void)setsampfreq(sfreq = WFDB_DEFFREQ);
     ffreq = sfreq / getspf();
 
-    if (annopen(record, ai, 3) < 0)
+    ai[nin] = ai[MAXIN];	/* the output annotator follows the inputs */
+    if (annopen(record, ai, nin+1) < 0)
 	exit(2);
-    af1 = getiaorigfreq(0);
-    af2 = getiaorigfreq(1);
-    if (af1 > 0 && af2 > 0)
-	setafreq(afreq = (af1 > af2 ? af1 : af2));
-    else if (af1 > 0)
-	setafreq(afreq = (af1 > ffreq ? af1 : ffreq));
-    else if (af2 > 0)
-	setafreq(afreq = (af2 > ffreq ? af2 : ffreq));
-    else
+
+    /* Use the highest time resolution of any input annotator.  If any of
+       them does not specify a time resolution, include the frame rate. */
+    for (i = 0; i < nin; i++) {
+	if ((af = getiaorigfreq(i)) > 0) {
+	    if (af > afreq) afreq = af;
+	    nfreq++;
+	}
+    }
+    if (nfreq < nin && ffreq > afreq)
 	afreq = ffreq;
-    setiafreq(0, afreq);
-    setiafreq(1, afreq);
+    if (nfreq > 0)
+	setafreq(afreq);
+    for (i = 0; i < nin; i++)
+	setiafreq(i, afreq);
 
-    ateof[0] = getann(0, &annot[0]);
-    ateof[1] = getann(1, &annot[1]);
+    for (i = 0; i < nin; i++) {
+	from[i] = wfrom[i] ? wtime(wfrom[i]) : 0L;
+	to[i] = wto[i] ? wtime(wto[i]) : (WFDB_Time)(-1);
+    }
+
+    if (wfdb_annmerge(NULL, nin) < 0)
+	exit(2);
+    ateof = wfdb_getmergedann(&an, &annot);
 }
 
+/* Copy the annotations before time tf (or all remaining annotations, if tf is
+   negative) from the input annotators selected by mode to the output.  All
+   annotations at the same time are collected first, so that conflicting
+   simultaneous annotations can be resolved and so that they can be written in
+   `chan' order. */
 void mergeann(mode, tf)
-int mode;
+unsigned long mode;
 WFDB_Time tf;
 {
-    switch (mode) {
-      case DISCARD_ALL:
-	while (!ateof[0] && (tf < 0L || annot[0].time < tf))
-	    ateof[0] = getann(0, &annot[0]);
-	while (!ateof[1] && (tf < 0L || annot[1].time < tf))
-	    ateof[1] = getann(1, &annot[1]);
-	break;
-      case COPY_0:
-	while (!ateof[0] && (tf < 0L || annot[0].time < tf)) {
-	    if (map0 >= 0) annot[0].chan = map0;
-	    putann(0, &annot[0]);
-	    ateof[0] = getann(0, &annot[0]);
-	}
-	while (!ateof[1] && (tf < 0L || annot[1].time < tf))
-	    ateof[1] = getann(1, &annot[1]);
-	break;
-      case COPY_1:
-	while (!ateof[0] && (tf < 0L || annot[0].time < tf))
-	    ateof[0] = getann(0, &annot[0]);
-	while (!ateof[1] && (tf < 0L || annot[1].time < tf)) {
-	    if (map1 >= 0) annot[1].chan = map1;
-	    putann(0, &annot[1]);
-	    ateof[1] = getann(1, &annot[1]);
-	}
-	break;
-      case MERGE:
-	while (!ateof[0] && !ateof[1] &&
-	       (tf < 0L || annot[0].time < tf || annot[1].time < tf)) {
-	    if (annot[0].time < annot[1].time) {
-		if (map0 >= 0) annot[0].chan = map0;
-		putann(0, &annot[0]);
-		ateof[0] = getann(0, &annot[0]);
-	    }
-	    else if (annot[0].time > annot[1].time) {
-		if (map1 >= 0) annot[1].chan = map1;
-		putann(0, &annot[1]);
-		ateof[1] = getann(1, &annot[1]);
-	    }
-	    else {
-		if (map0 >= 0) annot[0].chan = map0;
-		if (map1 >= 0) annot[1].chan = map1;
-		if (annot[0].chan < annot[1].chan) {
-		    putann(0, &annot[0]);
-		    putann(0, &annot[1]);
-		}
-		else if (annot[0].chan > annot[1].chan) {
-		    putann(0, &annot[1]);
-		    putann(0, &annot[0]);
+    int i, j, k, n;
+    WFDB_Time t;
+    struct gann g;
+
+    while (!ateof && (tf < 0L || annot.time < tf)) {
+	t = annot.time;
+	n = 0;
+	do {
+	    if ((mode & (1UL << an)) &&
+		t >= from[an] && (to[an] < 0L || t < to[an])) {
+		if (n >= maxgroup) {
+		    maxgroup += 16;
+		    group = (struct gann *)realloc(group,
+						maxgroup * sizeof(struct gann));
+		    if (group == NULL) {
+			fprintf(stderr, "%s: insufficient memory\n", pname);
+			exit(3);
+		    }
 		}
-		else {
-		    putann(0, &annot[0]);
-		    if (vflag && annot[0].anntyp != annot[1].anntyp)
-			fprintf(stderr, "%s: %s written, %s discarded\n",
-				mstimstr(annot[0].time),
-				annstr(annot[0].anntyp),
-				annstr(annot[1].anntyp));
+		group[n].annot = annot;
+		group[n].an = an;
+		if (map[an] >= 0) group[n].annot.chan = map[an];
+		if (annot.aux) {
+		    memcpy(group[n].aux, annot.aux, *annot.aux + 1);
+		    group[n].aux[*annot.aux + 1] = '\0';
+		    group[n].annot.aux = group[n].aux;
 		}
-		ateof[0] = getann(0, &annot[0]);
-		ateof[1] = getann(1, &annot[1]);
+		n++;
+	    }
+	    ateof = wfdb_getmergedann(&an, &annot);
+	} while (!ateof && annot.time == t);
+
+	/* Sort the group by chan.  The merge returns simultaneous annotations
+	   in input order, so this (stable) insertion sort leaves those with
+	   the same chan in input order. */
+	for (i = 1; i < n; i++) {
+	    for (j = i;
+		 j > 0 && group[j-1].annot.chan > group[i].annot.chan; j--)
+		;
+	    if (j < i) {
+		g = group[i];
+		memmove(&group[j+1], &group[j], (i-j) * sizeof(struct gann));
+		group[j] = g;
 	    }
 	}
-	while (!ateof[0] && ateof[1] && (tf < 0L || annot[0].time < tf)) {
-	    if (map0 >= 0) annot[0].chan = map0;
-	    putann(0, &annot[0]);
-	    ateof[0] = getann(0, &annot[0]);
-	}
-	while (ateof[0] && !ateof[1] && (tf < 0L || annot[1].time < tf)) {
-	    if (map1 >= 0) annot[1].chan = map1;
-	    putann(0, &annot[1]);
-	    ateof[1] = getann(1, &annot[1]);
+	for (i = k = 0; i < n; i = k) {
+	    /* group[i] ... group[k-1] have the same chan;  copy those from the
+	       first input annotator among them, discard the others. */
+	    for (k = i;
+		 k < n && group[k].annot.chan == group[i].annot.chan; k++)
+		if (group[k].an == group[i].an) {
+		    if (group[k].annot.aux) group[k].annot.aux = group[k].aux;
+		    putann(0, &group[k].annot);
+		}
+		else if (vflag &&
+			 group[k].annot.anntyp != group[i].annot.anntyp)
+		    fprintf(stderr, "%s: %s written, %s discarded\n",
+			    mstimstr(t), annstr(group[i].annot.anntyp),
+			    annstr(group[k].annot.anntyp));
 	}
-	break;
     }
 }
 
@@ -311,19 +394,27 @@ char *s;
 }
 
 static char *help_strings[] = {
- "usage: %s -r RECORD -i ANNOTATOR1 ANNOTATOR2 -o ANNOTATOR3 [OPTIONS ...]\n",
- "where RECORD, ANNOTATOR1, and ANNOTATOR2 specify the input, ANNOTATOR3",
+ "usage: %s -r RECORD -i ANNOTATOR1 ANNOTATOR2 ... -o OUTANN [OPTIONS ...]\n",
+ "where RECORD and the input ANNOTATORs (up to 32) specify the input, OUTANN",
  "specifies an output annotation file for RECORD, and OPTIONS may include:",
  " -h       print this usage summary",
- " -mX TIME change mode to X at specified TIME, where X is one of:",
+ " -mX TIME change mode to X at specified TIME, where X is the sum of 1 (to",
+ "          copy ANNOTATOR1 annotations), 2 (ANNOTATOR2), 4 (ANNOTATOR3),",
+ "          etc.;  for example:",
  "   0      discard all annotations beginning at TIME",
  "   1      copy ANNOTATOR1 annotations and discard ANNOTATOR2 annotations",
  "   2      copy ANNOTATOR2 annotations and discard ANNOTATOR1 annotations",
- "   3      merge ANNOTATOR1 and ANNOTATOR2 annotations (default)",
+ "   3      merge ANNOTATOR1 and ANNOTATOR2 annotations",
+ "          (the default is to merge annotations from all input ANNOTATORs)",
  " -v       verbose mode (warn about simultaneous annotations)",
  " -c N     map `chan' fields of ANNOTATOR1 annotations to N (-1 <= N <= 255)",
  " -C N     map `chan' fields of ANNOTATOR2 annotations to N (-1 <= N <= 255)",
+ " -x K N   map `chan' fields of annotations from input ANNOTATOR K to N",
  "Specifying N as -1 disables `chan' mapping (default).",
+ " -w K FROM TO  copy annotations from input ANNOTATOR K only if they occur",
+ "          between FROM and TO (TO may be `e', the end of the record)",
+ "If simultaneous annotations from two or more input annotators have the same",
+ "`chan' fields, only that from the first of these annotators is copied.",
 NULL
 };
 
@@ -42,6 +42,14 @@ are sorted.
 If the input annotations are already in the correct order, no output is written
 unless you have used the -o option.
 
+The annotations are read into a table (see wfdb_getanntab) in a single pass,
+with their aux strings in a single block of memory.  An array of sort keys
+is then divided into its ordered runs, and these are merged pairwise until
+one run remains, so that sorting takes O(n log r) time for n annotations in r
+runs (nearly-ordered input, and input merged from a few ordered sources, are
+sorted in one or two passes).  The merge is stable, so that the last of any
+annotations with identical time, num, and chan fields can be identified.
+
 If you attempt to sort a very large annotation file, sortann may run out of
 memory.  If this happens, use the -f and -t options to work on the file in
 sections of any convenient size, one at a time, then use mrgann to concatenate
@@ -49,13 +57,13 @@ the sections.  Note that you must specify an output annotator name (with -o)
 when using the -f or -t options (to avoid replacing the entire input file with
 a sorted subset of its contents).
 
-The working memory required by sortann is approximately 10 times the size of
-the annotation file.  Since annotation files are rarely as large as 1 megabyte
-and available memory is rarely less than 10 megabytes, it is unlikely that
-sortann will exhaust available memory, however.
+The working memory required by sortann is about 70 bytes per annotation, plus
+the total length of the aux strings;  thus tens of millions of annotations can
+be sorted on most machines.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #ifndef __STDC__
 extern void exit();
 #endif
@@ -64,10 +72,19 @@ extern void exit();
 #include <wfdb/ecgcodes.h>
 
 char *pname;
-struct annlistentry {
-    struct annlistentry *next, *prev;
-    WFDB_Annotation annotation;
-} annlist;
+WFDB_Anntab tab;	/* annotations read from the input annotator */
+
+struct sortkey {	/* sort key for an annotation in tab */
+    WFDB_Time time;
+    long numchan;	/* num * 256 + chan (giving the order of simultaneous
+			   annotations) */
+    long i;		/* index of the annotation in tab */
+};
+
+/* KEY_BEFORE is true if *A must be written before *B. */
+#define KEY_BEFORE(A, B) ((A)->time < (B)->time || \
+			  ((A)->time == (B)->time && (A)->numchan < (B)->numchan))
+#define KEY_EQUAL(A, B)  ((A)->time == (B)->time && (A)->numchan == (B)->numchan)
 
 int in_order = 1;
 
@@ -77,13 +94,13 @@ char *argv[];
 {
     static WFDB_Anninfo ai[2];
     static WFDB_Annotation annot;
-    static struct annlistentry *ap;
     char *record = NULL, *prog_name();
     WFDB_Time from = 0L, to = 0L;
-    long nann = 0L;
-    int i, insert_ann();
+    long j, k, n, nann = 0L;
+    int i;
     double sps, spm, tps;
-    void cleanup(), help();
+    struct sortkey *key, *tmp, *sortkeys();
+    void help();
 
     pname = prog_name(argv[0]);
 
@@ -201,20 +218,27 @@ char *argv[];
 	to = to * tps / sps + 0.5;
     }
 
-    /* Build a linked list of annotations in memory. */
-    while (getann(0, &annot) == 0) {
-	if (annot.time < from || (to > 0L && annot.time >= to))
+    /* Read the annotations, and make a sort key for each of those in the
+       selected interval. */
+    n = wfdb_getanntab(0, &tab);
+    key = tmp = NULL;
+    if (n > 0L) {
+	key = (struct sortkey *)malloc(n * sizeof(struct sortkey));
+	tmp = (struct sortkey *)malloc(n * sizeof(struct sortkey));
+    }
+    if (n == -3L || (n > 0L && (key == NULL || tmp == NULL))) {
+	fprintf(stderr, "%s: insufficient memory; no output written\n", pname);
+	wfdbquit();
+	exit(3);
+    }
+    for (j = 0L; j < n; j++) {
+	if (tab.time[j] < from || (to > 0L && tab.time[j] >= to))
 	    continue;
-	if (insert_ann(&annot) == 0) {
-	    fprintf(stderr, "%s: insufficient memory (%ld annotations read); ",
-		    pname, nann);
-	    if (strcmp(ai[0].name, ai[1].name) == 0)
-		fprintf(stderr, "no changes made\n");
-	    else
-		fprintf(stderr, "no output written\n");
-	    wfdbquit();
-	    exit(3);
-	}
+	key[nann].time = tab.time[j];
+	key[nann].numchan = tab.num[j] * 256L + tab.chan[j];
+	key[nann].i = j;
+	if (nann > 0L && !KEY_BEFORE(&key[nann-1], &key[nann]))
+	    in_order = 0;
 	nann++;
     }
     iannclose(0);
@@ -224,9 +248,10 @@ char *argv[];
 	   another annotator name was specified (using -o). */
 	fprintf(stderr, "%s: input is already ordered -- no output written\n",
 		pname);
-	cleanup();
 	exit(0);
     }
+    if (!in_order)
+	key = sortkeys(key, tmp, nann);
 
     if (from == 0L && to == 0L && ai[1].name == NULL)
         /* in this case, we are processing the entire input file, and it's
@@ -235,101 +260,73 @@ char *argv[];
 
     if (annopen(record, &ai[1], 1) < 0) /* open output annotation file */
         exit(2);
-    for (ap = annlist.next; ap; ap = ap->next)
-	if ((ap->annotation).anntyp != NOTQRS)
-	    putann(0, &(ap->annotation));
+    for (k = 0L; k < nann; k++) {
+	/* Of two or more annotations with the same time, num, and chan, only
+	   the last one is written (and only if it is not a NOTQRS). */
+	if (k+1 < nann && KEY_EQUAL(&key[k], &key[k+1]))
+	    continue;
+	j = key[k].i;
+	if (tab.anntyp[j] == NOTQRS)
+	    continue;
+	annot.time = tab.time[j];
+	annot.anntyp = tab.anntyp[j];
+	annot.subtyp = tab.subtyp[j];
+	annot.chan = tab.chan[j];
+	annot.num = tab.num[j];
+	annot.aux = (tab.auxoff[j] >= 0L) ? tab.aux + tab.auxoff[j] : NULL;
+	putann(0, &annot);
+    }
     wfdbquit();
-
-    cleanup();
+    wfdb_freeanntab(&tab);
 
     exit(0);	/*NOTREACHED*/
 }
 
-static struct annlistentry *lastp = &annlist;
-int insert_ann(pa)
-WFDB_Annotation *pa;
+/* Sort the n keys in key[] into canonical order, using tmp[] as workspace,
+   and return a pointer to the sorted keys (which may be in either array).  The
+   keys are divided into ordered runs, which are merged pairwise until only
+   one run remains.  The merge is stable:  if two keys are equal, the one that
+   was read first remains first. */
+struct sortkey *sortkeys(key, tmp, n)
+struct sortkey *key, *tmp;
+long n;
 {
-    char *p;
-    static struct annlistentry *ap, *newp = NULL;
-    void copybytes();
-
-    if (pa->aux) p = (char *)malloc(*(pa->aux)+2);
-    newp = (struct annlistentry *)malloc(sizeof(struct annlistentry));
-    if (newp == NULL) return (0);	/* insufficient memory -- quit */
-    newp->annotation = *pa;
-    if (pa->aux) {
-	copybytes(p, pa->aux, *(pa->aux)+2);
-	(newp->annotation).aux = p;
+    long i, j, m, nr, lo, mid, hi, p, q, *run;
+    struct sortkey *src = key, *dst = tmp, *t;
+
+    /* Find the beginning of each run. */
+    for (i = 1, nr = 1; i < n; i++)
+	if (KEY_BEFORE(&key[i], &key[i-1]))
+	    nr++;
+    if ((run = (long *)malloc((nr+1) * sizeof(long))) == NULL) {
+	fprintf(stderr, "%s: insufficient memory; no output written\n", pname);
+	exit(3);
     }
-    if (lastp == &annlist ||
-	pa->time > (lastp->annotation).time ||
-	(pa->time == (lastp->annotation).time &&
-	 pa->num > (lastp->annotation).num) ||
-	(pa->time == (lastp->annotation).time &&
-	 pa->num == (lastp->annotation).num &&
-	 pa->chan > (lastp->annotation).chan)) {
-	/* this annotation is in order -- add to end of list */
-	newp->prev = lastp;
-	lastp->next = newp;
-	lastp = newp;
-	lastp->next = NULL;
-    }
-    else {
-	in_order = 0;	/* set flag to indicate input was out-of-order */
-	/* Find the correct location in the list for this annotation.  The
-	   search is linear, beginning at the end of the list, which works
-	   well for nearly-ordered input. */
-	ap = lastp;
-	while (ap) {
-	    if (pa->time > (ap->annotation).time ||
-		(pa->time == (ap->annotation).time &&
-		 pa->num > (ap->annotation).num) ||
-		(pa->time == (ap->annotation).time &&
-		 pa->num == (ap->annotation).num &&
-		 pa->chan >= (ap->annotation).chan)) {
-		break;
-	    }
-	    ap = ap->prev;
-	}
-	if (ap == NULL) {
-	    /* insert newp at the beginning of the list */
-	    newp->prev = NULL;
-	    newp->next = annlist.next;
-	    (newp->next)->prev = annlist.next = newp;
+    run[0] = 0L;
+    for (i = 1, nr = 1; i < n; i++)
+	if (KEY_BEFORE(&key[i], &key[i-1]))
+	    run[nr++] = i;
+    run[nr] = n;
+
+    /* Merge adjacent pairs of runs until a single run remains. */
+    while (nr > 1) {
+	for (j = m = 0; j < nr; j += 2, m++) {
+	    lo = run[j];
+	    mid = run[j+1];
+	    hi = (j+1 < nr) ? run[j+2] : mid;
+	    for (p = lo, q = mid, i = lo; i < hi; i++)
+		if (q >= hi || (p < mid && !KEY_BEFORE(&src[q], &src[p])))
+		    dst[i] = src[p++];
+		else
+		    dst[i] = src[q++];
+	    run[m] = lo;
 	}
-	else if (pa->time == (ap->annotation).time &&
-		 pa->num == (ap->annotation).num &&
-		 pa->chan == (ap->annotation).chan) {  /* replace ap by newp */
-	    if (newp->prev = ap->prev) (newp->prev)->next = newp;
-	    if (newp->next = ap->next) (newp->next)->prev = newp;
-	    else lastp = newp;
-	    if ((ap->annotation).aux) free((ap->annotation).aux);
-	    if (ap != &annlist) free(ap);
-	}
-	else {	/* insert newp immediately after ap */
-	    newp->prev = ap;
-	    newp->next = ap->next;
-	    (newp->next)->prev = ap->next = newp;
-	}
-    }
-    return (1);	/* success */
-}
-
-void cleanup()	/* free the memory used for the annotation list */
-{
-    while (lastp != NULL && lastp != &annlist) {
-	if ((lastp->annotation).aux) free((lastp->annotation).aux);
-	if (lastp = lastp->prev) free(lastp->next);
+	run[m] = n;
+	nr = m;
+	t = src; src = dst; dst = t;
     }
-}
-
-/* This function emulates memcpy (which is not universally available). */
-void copybytes(dest, src, n)
-char *dest, *src;
-int n;
-{
-    while (n-- > 0)
-	*dest++ = *src++;
+    free(run);
+    return (src);
 }
 
 char *prog_name(s)
@@ -2,6 +2,18 @@
 #				Last revised:   20 December 2021
 # This section of the Makefile should not need to be changed.
 
+# Optional features of wfdbio.c.  Each requires an additional library, so none
+# of them is compiled unless it is enabled by adding the definition below to
+# WFDBIO_CFLAGS, and the library to WFDBIO_LIBS, on the 'make' command line:
+#   reading gzip-compressed (.gz) files:  -DWFDB_GZIP_SUPPORT and -lz
+#   reading Zstandard-compressed (.zst) files:  -DWFDB_ZSTD_SUPPORT and -lzstd
+#   write-behind output (see WFDB_WRITEBEHIND):  -DWFDB_WRITE_BEHIND and
+#     -lpthread
+# For example:
+#   make WFDBIO_CFLAGS="-DWFDB_GZIP_SUPPORT" WFDBIO_LIBS="-lz"
+# (Any -I options needed to find the libraries' headers also belong in
+# WFDBIO_CFLAGS.)
+
 INCLUDES = $(DESTDIR)$(INCDIR)/wfdb/wfdb.h \
            $(DESTDIR)$(INCDIR)/wfdb/wfdblib.h \
            $(DESTDIR)$(INCDIR)/wfdb/ecgcodes.h \
@@ -15,7 +27,7 @@ MFILES = Makefile Makefile.dos
 all:
 	$(MAKE) setup
 	$(MAKE) $(OFILES)
-	$(BUILDLIB) $(OFILES) $(BUILDLIB_LDFLAGS)
+	$(BUILDLIB) $(OFILES) $(BUILDLIB_LDFLAGS) $(WFDBIO_LIBS)
 
 # `make install':  install the WFDB library and headers
 install:
@@ -79,5 +91,6 @@ calib.o:	wfdb.h wfdblib.h calib.c
 wfdbio.o:	wfdb.h wfdblib.h wfdbio.c
 	lf='"$(LDFLAGS)"' ; \
 	lf=`echo "$$lf" | sed 's|$(DESTDIR)$(LIBDIR)|$(LIBDIR)|g'` ; \
-	$(CC) $(CFLAGS) -DVERSION='"$(VERSION)"' -DCFLAGS='"-I$(INCDIR)"' \
+	$(CC) $(CFLAGS) $(WFDBIO_CFLAGS) -DVERSION='"$(VERSION)"' \
+	  -DCFLAGS='"-I$(INCDIR)"' \
 	  -DLDFLAGS="$$lf" $(BUILD_DATE_FLAGS) -c wfdbio.c
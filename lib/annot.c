@@ -31,10 +31,54 @@ visible outside of this file:
  put_ann_table		(writes tables used by annstr, strann, and anndesc)
  allociann		(sets max # of simultaneously open input annotators)
  allocoann		(sets max # of simultaneously open output annotators)
+ edf_field [10.7.1]	(reads a numeric field of an EDF header)
+ edfann_free [10.7.1]	(frees memory used by an EDF+ annotation reader)
+ edfann_open [10.7.1]	(prepares to read EDF+ annotations)
+ edfann_read [10.7.1]	(reads the annotation signals of an EDF+ data record)
+ edfann_next [10.7.1]	(finds the next EDF+ annotation)
+ aix_add [10.7.1]	(records an annotation file checkpoint)
+ aix_find [10.7.1]	(finds the last checkpoint before a given time)
+ aix_init [10.7.1]	(loads an annotation file index)
+ aix_save [10.7.1]	(saves an annotation file index)
+ oa_sort [10.7.1]	(sorts buffered output annotations)
+ oa_put [10.7.1]	(encodes and writes an output annotation)
+ oa_flush [10.7.1]	(writes buffered output annotations)
+ oa_buffer [10.7.1]	(buffers an output annotation)
+ am_end [10.7.1]	(discards the state of an annotator merge)
+ am_fill [10.7.1]	(reads a block of annotations for an annotator merge)
+ am_before [10.7.1]	(compares the next annotations of two merged annotators)
+ am_siftdown [10.7.1]	(maintains the heap used by wfdb_getmergedann)
+ am_prime [10.7.1]	(begins or restarts an annotator merge)
+ ia_auxspace [10.7.1]	(finds space for an input annotation's aux string)
+ ia_auxkeep [10.7.1]	(reserves space for an input annotation's aux string)
+ anntab_group [10.7.1]	(groups the annotations in a table by type)
+ ca_putv [10.7.1]	(encodes a varint)
+ ca_getv [10.7.1]	(decodes a varint)
+ ca_readv [10.7.1]	(reads a varint from an input annotation file)
+ ca_p64 [10.7.1]	(encodes a 64-bit integer)
+ ca_g64 [10.7.1]	(decodes a 64-bit integer)
+ ca_putcol [10.7.1]	(encodes a column of a compact-format block)
+ ca_getcol [10.7.1]	(decodes a column of a compact-format block)
+ ca_fill [10.7.1]	(reads a block of a compact-format annotation file)
+ ca_next [10.7.1]	(reads an annotation from a compact-format file)
+ ca_find [10.7.1]	(finds the compact-format block preceding a time)
+ ca_flush [10.7.1]	(writes a block of a compact-format annotation file)
+ ca_put [10.7.1]	(writes an annotation to a compact-format file)
+ ca_close [10.7.1]	(writes the index of a compact-format annotation file)
 
 This file also contains definitions of the following WFDB library functions:
  annopen		(opens annotation files)
  getann			(reads an annotation)
+ getanns [10.7.1]	(reads a block of annotations)
+ wfdb_getanntab [10.7.1] (reads an annotator into a columnar table)
+ wfdb_anntabfind [10.7.1] (finds an annotation in a table by time)
+ wfdb_freeanntab [10.7.1] (frees memory allocated by wfdb_getanntab)
+ wfdb_anntabindex [10.7.1] (indexes an annotation table by type)
+ wfdb_anntabrange [10.7.1] (finds annotations of a given type in a time range)
+ wfdb_freeanntabidx [10.7.1] (frees memory allocated by wfdb_anntabindex)
+ wfdb_annmerge [10.7.1]	(selects input annotators to be merged)
+ wfdb_getmergedann [10.7.1] (reads the next annotation from merged annotators)
+ wfdb_setauxmode [10.7.1] (selects how aux strings of an annotator are stored)
  ungetann [5.3]		(pushes an annotation back into an input stream)
  putann			(writes an annotation)
  iannsettime		(skips to a specified time in input annotation files)
@@ -100,6 +144,8 @@ may be attached to the same signal provided that their num fields are unique.
 #include "ecgmap.h"
 
 #include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* Annotation word format */
 #define CODE	0176000	/* annotation code segment of annotation word */
@@ -121,6 +167,12 @@ may be attached to the same signal provided that their num fields are unique.
 #define AUX	((unsigned)(63 << CS))	/* auxiliary information */
 
 #define AUXBUFLEN 771
+#define IABUFLEN 32768	/* size of input annotation file buffer */
+/* size of the buffer for aux strings of annotations read by getanns */
+#define BULKAUXLEN 32768
+#define OABUFMAX 1048576L /* max number of buffered output annotations */
+#define AMBATCH 256	/* annotations read at a time by wfdb_getmergedann */
+#define AUXBLKLEN 65536	/* size of blocks of stable aux string storage */
 
 /* Constants for AHA annotation files only */
 #define ABLKSIZ	1024		/* AHA annotation file block length */
@@ -153,6 +205,9 @@ static struct iadata {
     int ateof;			/* EOF-reached indicator */
     unsigned char auxstr[AUXBUFLEN]; /* aux string buffer */
     unsigned index;		/* next available position in auxstr */
+    int auxmode;		/* WFDB_AUX_RING or WFDB_AUX_STABLE */
+    struct auxblock *auxblk;	/* most recently allocated block of stable aux
+				   string storage (see ia_auxspace) */
     double tmul;		/* tmul * annotation time = sample count */
     double tt;			/* annotation time (MIT format only).  This
 				   equals ann.time unless a SKIP follows ann;
@@ -165,6 +220,27 @@ static struct iadata {
 				   returned by getann */
     WFDB_Time prev_time;	/* sample number of the last annotation
 				   returned by getann */
+    struct edfann *edf;		/* EDF+ annotation reader state */
+    unsigned char *rbuf;	/* input buffer (see ia_fill) */
+    const unsigned char *rp;	/* next unread byte in input buffer */
+    const unsigned char *re;	/* end of input buffer contents */
+    int reof;			/* if non-zero, an attempt has been made to
+				   read past the end of the input file */
+    unsigned char *bulkaux;	/* aux strings of annotations read by the
+				   most recent getanns call */
+    long rend;			/* file offset corresponding to re */
+    struct annidx *idx;		/* checkpoints (see "Annotation file index"
+				   below) */
+    unsigned nidx, maxidx;	/* number of checkpoints, allocated length */
+    long ixnext;		/* offset at which the next checkpoint is to be
+				   recorded (LONG_MAX: none) */
+    char *aixname;		/* name of index file, or NULL */
+    struct wfdb_fileval annval;	/* validator of the annotation file, if
+				   aixname is not NULL */
+    int aixmode;		/* WFDBAIX (see below) */
+    struct cablock *cab;	/* current block (compact format only) */
+    struct caidx *cix;		/* block index (compact format only) */
+    long ncix;			/* number of index entries (-1: not yet read) */
 } **iad;
 
 static unsigned maxoann;	/* max allowed number of output annotators */
@@ -173,18 +249,46 @@ static struct oadata {
     WFDB_FILE *file;		/* file pointer for output annotation file */
     WFDB_Anninfo info;		/* output annotator information */
     WFDB_Annotation ann;	/* most recent annotation written by putann */
+    WFDB_Annotation last;	/* most recent annotation passed to putann
+				   (aux is not used) */
     WFDB_Frequency afreq;	/* time resolution, in ticks/second */
+    struct oaent *buf;		/* buffered annotations (see oa_buffer) */
+    long nbuf, maxbuf;		/* number of buffered annotations, allocated
+				   length of buf */
+    unsigned char *auxbuf;	/* aux strings of buffered annotations */
+    long nauxbuf, maxauxbuf;	/* bytes used and allocated in auxbuf */
+    int buffered;		/* if non-zero, putann buffers annotations */
     int seqno;			/* annotation serial number (AHA format only)*/
     char *rname;		/* record with which annotator is associated */
     char out_of_order;		/* if >0, one or more annotations written by
 				   putann are not in the canonical (time, num,
 				   chan) order */
     char table_written;		/* if >0, table has been written */
+    struct cablock *cab;	/* current block (compact format only) */
+    struct caidx *cix;		/* block index (compact format only) */
+    long ncix, maxcix;		/* number of index entries, allocated length */
+    int caunordered;		/* if non-zero, an annotation has been written
+				   out of time order, and no more blocks are
+				   indexed (compact format only) */
 } **oad;
 static WFDB_Frequency oafreq;	/* time resolution in ticks/sec for newly-
 				   created output annotators */
 static int annclose_error;	/* if <0, error occurred while closing
 				   annotation files */
+static struct amsource {	/* input annotator being merged */
+    WFDB_Annotator an;		/* annotator number */
+    WFDB_Annotation *buf;	/* annotations read from it by getanns */
+    int n, next;		/* number of annotations in buf, index of the
+				   next one to be returned */
+} *amsrc;			/* sources being merged (see wfdb_annmerge) */
+static unsigned namsrc;		/* number of sources being merged */
+static int amactive;		/* if non-zero, a merge is in progress */
+static unsigned *amheap;	/* heap of sources with annotations remaining */
+static unsigned namheap;	/* number of sources in the heap */
+static int amnext;		/* if non-zero, the annotation at the top of
+				   the heap has been returned already */
+static int amstale;		/* if non-zero, the sources must be refilled
+				   (set by iannsettime) */
 
 #ifdef WFDB_LARGETIME
 typedef unsigned long long unsigned_time;
@@ -192,6 +296,41 @@ typedef unsigned long long unsigned_time;
 typedef unsigned long unsigned_time;
 #endif
 
+/* EDF+ annotations
+
+   If an input annotation file cannot be opened for a record stored in EDF+
+   or BDF+ format (i.e., if the record name is the name of an EDF or BDF file,
+   as for readheader in signal.c), annopen reads annotations from the file's
+   "EDF Annotations" (or "BDF Annotations") signals instead.  Each data record
+   of these signals contains one or more time-stamped annotation lists (TALs);
+   getann returns each non-empty annotation text as a NOTE annotation, with
+   the text in its aux field, at the onset time given by its TAL.  (Durations
+   are not reported.)  The annotation bytes of each data record are read only
+   when getann reaches that record, so that no separate pass over the file is
+   needed.  Annotation times are in units of the frame rate multiplied by the
+   maximum number of samples per signal per frame, as for the signals of an
+   EDF record (see edfparse in signal.c).
+*/
+
+/* EDF_READ is the (private) annotator stat for EDF+ annotations. */
+#define EDF_READ	0x100
+
+struct edfann {
+    long start;			/* byte offset of first data record */
+    long recbytes;		/* number of bytes per data record */
+    long nrec;			/* number of data records (-1: unknown) */
+    long irec;			/* index of next data record to be read */
+    int nann;			/* number of annotation signals */
+    long *annoff;		/* byte offset of each annotation signal within
+				   a data record */
+    long *annlen;		/* length in bytes of each annotation signal */
+    char *buf;			/* annotation bytes of current data record */
+    char *bp;			/* next unparsed byte in buf */
+    char *be;			/* end of annotation bytes in buf */
+    double onset;		/* onset (in seconds) of current TAL */
+    int intal;			/* if non-zero, bp is within a TAL */
+};
+
 /* Local functions (for the use of other functions in this module only). */
 
 /* Round a double to the nearest WFDB_Time, with halfway cases always
@@ -221,6 +360,797 @@ static WFDB_Time round_to_time(double x)
     }
 }
 
+/* Input annotation files in MIT and AHA format are read through a buffer
+   belonging to the annotator, rather than a byte at a time using wfdb_getc.
+   ia_fill refills the buffer (or, if the file is held in memory, points rp and
+   re to the file's contents;  see wfdb_fmap), and returns the number of bytes
+   now available, or 0 (setting reof) at the end of the file.  ia_getc, ia_g16,
+   ia_g32, and ia_fread are the buffered equivalents of wfdb_getc, wfdb_g16,
+   wfdb_g32, and wfdb_fread, and ia_rewind discards the buffer contents after
+   the file has been repositioned to offset. */
+static long ia_fill(struct iadata *ia)
+{
+    const char *data;
+    long n;
+
+    if ((n = wfdb_fmap(ia->file, &data, LONG_MAX)) < 0) {
+	if (ia->rbuf == NULL)
+	    SUALLOC(ia->rbuf, IABUFLEN, 1);
+	n = ia->rbuf ? wfdb_fread(ia->rbuf, 1, IABUFLEN, ia->file) : 0;
+	data = (char *)ia->rbuf;
+    }
+    ia->rp = (const unsigned char *)data;
+    ia->re = ia->rp + n;
+    ia->rend += n;
+    if (n <= 0) {
+	ia->rp = ia->re = NULL;
+	ia->reof = 1;
+	return (0);
+    }
+    return (n);
+}
+
+#define ia_getc(IA)	(((IA)->rp < (IA)->re || ia_fill(IA)) ? \
+			 *(IA)->rp++ : EOF)
+
+static int ia_g16(struct iadata *ia)
+{
+    int x;
+
+    if (ia->re - ia->rp >= 2) {
+	x = ia->rp[0] | (ia->rp[1] << 8);
+	ia->rp += 2;
+	return ((int)((short)x));
+    }
+    x = ia_getc(ia);
+    return ((int)((short)((ia_getc(ia) << 8) | (x & 0xff))));
+}
+
+static long ia_g32(struct iadata *ia)
+{
+    long x, y;
+
+    x = ia_g16(ia);
+    y = ia_g16(ia);
+    return ((x << 16) | (y & 0xffff));
+}
+
+static size_t ia_fread(unsigned char *p, size_t n, struct iadata *ia)
+{
+    size_t count, k;
+
+    for (count = 0; count < n; count += k) {
+	if (ia->rp >= ia->re && ia_fill(ia) == 0)
+	    break;
+	if ((k = ia->re - ia->rp) > n - count)
+	    k = n - count;
+	memcpy(p + count, ia->rp, k);
+	ia->rp += k;
+    }
+    return (count);
+}
+
+static void ia_rewind(struct iadata *ia, long offset)
+{
+    ia->rp = ia->re = NULL;
+    ia->reof = 0;
+    ia->rend = offset;
+}
+
+/* Aux string storage
+
+   By default, getann stores the aux string of each annotation in the
+   annotator's auxstr ring buffer, which is reused after a few annotations have
+   been read;  thus an aux string remains valid only until a few more
+   annotations have been read, and applications must copy it if they need it
+   for longer.  If WFDB_AUX_STABLE mode has been selected using wfdb_setauxmode,
+   aux strings are instead appended to a list of AUXBLKLEN-byte blocks that are
+   kept until the annotator is closed, so that they remain valid until then. */
+
+struct auxblock {
+    struct auxblock *prev;	/* previously allocated block */
+    unsigned used;		/* number of bytes used in data */
+    unsigned char data[AUXBLKLEN];
+};
+
+/* ia_auxspace returns a pointer to space for an aux string occupying n bytes
+   (including its length byte and the null that follows it).  The space is
+   reserved only when ia_auxkeep is called. */
+static unsigned char *ia_auxspace(struct iadata *ia, unsigned n)
+{
+    struct auxblock *b;
+
+    if (ia->auxmode == WFDB_AUX_STABLE) {
+	if ((b = ia->auxblk) == NULL || b->used + n > AUXBLKLEN) {
+	    b = NULL;
+	    SUALLOC(b, 1, sizeof(struct auxblock));
+	    if (b) {
+		b->prev = ia->auxblk;
+		b->used = 0;
+		ia->auxblk = b;
+	    }
+	    else	/* out of memory -- revert to the ring buffer */
+		ia->auxmode = WFDB_AUX_RING;
+	}
+	if (b)
+	    return (b->data + b->used);
+    }
+    if (ia->index >= AUXBUFLEN - n)
+	ia->index = 0;
+    return (ia->auxstr + ia->index);
+}
+
+/* ia_auxkeep reserves the n bytes most recently returned by ia_auxspace. */
+static void ia_auxkeep(struct iadata *ia, unsigned n)
+{
+    if (ia->auxmode == WFDB_AUX_STABLE)
+	ia->auxblk->used += n;
+    else
+	ia->index += n;
+}
+
+/* Annotation file index
+
+   When an MIT-format annotation file is read, a checkpoint is recorded at the
+   first annotation that begins at least AIXSPAN bytes after the previous
+   checkpoint.  A checkpoint contains the annotator's state (the byte offset
+   and contents of the annotation's first word, the time preceding it, and the
+   current 'chan' and 'num' fields) at the point where getann would begin to
+   decode the annotation.  The checkpoints always cover a contiguous initial
+   portion of the file, since reading begins either at the beginning of the
+   file or at a checkpoint.  iannsettime searches the checkpoints for the last
+   annotation before the requested time, and resumes reading there, rather
+   than reading from the beginning of the file (or from the current position,
+   if the checkpoint is closer).
+
+   The checkpoints are valid only if the annotations preceding them are in
+   time order, so no more checkpoints are recorded once a negative SKIP (which
+   indicates an out-of-order annotation) has been read.
+
+   A completed index can be saved in an index file ("record.atr.aix" for the
+   annotation file "record.atr", in the same directory) so that it is available
+   immediately when the annotation file is next opened.  An index file is used
+   only if the validator (see wfdb_fileval, in wfdbio.c) recorded in it matches
+   that of the annotation file, and only for local files.  Index files are
+   written in native byte order, and those written on a platform with a
+   different byte order or structure layout are ignored.  The environment
+   variable WFDBAIX determines how index files are used (0: never;  1: if
+   present and up to date;  2: as for 1, but also create them once the entire
+   annotation file has been read);  if WFDBAIX is not set, DEFWFDBAIX (see
+   wfdblib.h) determines the behavior.  An index file contains an aixhdr
+   structure, followed by 'n' annidx structures. */
+
+#define AIXSPAN		4096	/* minimum spacing of checkpoints, in bytes */
+#define AIX_MAGIC	"WFDBAIX2"
+#define AIX_ORDER	0x01020304
+
+struct annidx {		/* annotation file checkpoint */
+    double tt;		/* unscaled time preceding the annotation */
+    long offset;	/* offset of the byte following the first word */
+    int word;		/* first word of the annotation */
+    short chan, num;	/* 'chan' and 'num' fields preceding it */
+};
+
+struct aixhdr {
+    char magic[8];		/* AIX_MAGIC */
+    unsigned int order;		/* AIX_ORDER, in the writer's byte order */
+    unsigned int sizes;		/* encoded sizes of structures */
+    struct wfdb_fileval annval;	/* validator of annotation file */
+    int n;			/* number of checkpoints */
+    int pad;
+};
+
+#define AIX_SIZES ((unsigned)(sizeof(struct aixhdr) << 16 | \
+			      sizeof(struct annidx) << 8 | sizeof(long)))
+
+/* aix_add records a checkpoint for the annotation that begins with ia->word;
+   offset is the offset of the byte that follows this word. */
+static void aix_add(struct iadata *ia, long offset)
+{
+    struct annidx *x;
+
+    if (ia->nidx >= ia->maxidx) {
+	ia->maxidx = ia->maxidx ? 2 * ia->maxidx : 64;
+	SREALLOC(ia->idx, ia->maxidx, sizeof(struct annidx));
+	if (ia->idx == NULL) {
+	    ia->nidx = ia->maxidx = 0;
+	    ia->ixnext = LONG_MAX;
+	    return;
+	}
+    }
+    x = &ia->idx[ia->nidx++];
+    x->tt = ia->tt;
+    x->offset = offset;
+    x->word = ia->word;
+    x->chan = ia->ann.chan;
+    x->num = ia->ann.num;
+    ia->ixnext = offset + AIXSPAN;
+}
+
+/* aix_find returns the last checkpoint for an annotation that precedes time
+   t (in sample intervals), or NULL if there is none. */
+static struct annidx *aix_find(struct iadata *ia, WFDB_Time t)
+{
+    struct annidx *x;
+    unsigned lo = 0, hi = ia->nidx, mid;
+
+    while (lo < hi) {	/* find the first checkpoint at or after t */
+	mid = lo + (hi - lo) / 2;
+	x = &ia->idx[mid];
+	if (round_to_time((x->tt + (x->word & DATA)) * ia->tmul) < t)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo > 0 ? &ia->idx[lo-1] : NULL);
+}
+
+/* aix_init is invoked by annopen once an MIT-format annotation file has been
+   opened.  It determines the name of the index file and loads it if it is
+   present and up to date. */
+static void aix_init(struct iadata *ia)
+{
+    char *p;
+    size_t n;
+    struct aixhdr h;
+    struct stat st;
+    WFDB_FILE *ifile;
+
+    ia->ixnext = 0L;
+    ia->aixmode = DEFWFDBAIX;
+    if ((p = getenv("WFDBAIX")) != NULL)
+	ia->aixmode = strtol(p, NULL, 10);
+    if (ia->aixmode <= 0 || ia->file->type != WFDB_LOCAL ||
+	ia->file->fp == stdin || (p = wfdbfile(NULL, NULL)) == NULL ||
+	wfdb_fileval(p, &ia->annval) < 0)
+	return;
+    if (wfdb_asprintf(&ia->aixname, "%s.aix", p) < 0 ||
+	stat(ia->aixname, &st) < 0 || st.st_size < sizeof(h) ||
+	(ifile = wfdb_fopen(ia->aixname, "rb")) == NULL)
+	return;
+    if (wfdb_fread(&h, sizeof(h), 1, ifile) == 1 &&
+	memcmp(h.magic, AIX_MAGIC, sizeof(h.magic)) == 0 &&
+	h.order == AIX_ORDER && h.sizes == AIX_SIZES &&
+	memcmp(&h.annval, &ia->annval, sizeof(h.annval)) == 0 &&
+	h.n > 0 && st.st_size == sizeof(h) + h.n * sizeof(struct annidx)) {
+	n = h.n;
+	SALLOC(ia->idx, n, sizeof(struct annidx));
+	if (ia->idx && wfdb_fread(ia->idx, sizeof(struct annidx), n, ifile)==n){
+	    ia->nidx = ia->maxidx = n;
+	    ia->ixnext = LONG_MAX;	/* the index is complete */
+	    ia->aixmode = 1;		/* and need not be written again */
+	}
+	else {
+	    SFREE(ia->idx);
+	}
+    }
+    wfdb_fclose(ifile);
+}
+
+/* aix_save is invoked by getann on reaching the end of an MIT-format
+   annotation file.  It writes the index file if required. */
+static void aix_save(struct iadata *ia)
+{
+    char *tmpname = NULL;
+    struct aixhdr h;
+    WFDB_FILE *ofile;
+
+    if (ia->aixmode < 2 || ia->aixname == NULL || ia->nidx == 0 ||
+	ia->ixnext == LONG_MAX)
+	return;
+    ia->aixmode = 1;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, AIX_MAGIC, sizeof(h.magic));
+    h.order = AIX_ORDER;
+    h.sizes = AIX_SIZES;
+    h.annval = ia->annval;
+    h.n = ia->nidx;
+
+    /* Write the index under a temporary name, then rename it, so that other
+       processes never see an incomplete file. */
+    wfdb_asprintf(&tmpname, "%s.%ld", ia->aixname, (long)getpid());
+    if (tmpname && (ofile = wfdb_fopen(tmpname, "wb")) != NULL) {
+	wfdb_fwrite(&h, sizeof(h), 1, ofile);
+	wfdb_fwrite(ia->idx, sizeof(struct annidx), ia->nidx, ofile);
+	if (wfdb_ferror(ofile) | wfdb_fclose(ofile) ||
+	    rename(tmpname, ia->aixname))
+	    (void)remove(tmpname);
+    }
+    SFREE(tmpname);
+}
+
+/* Compact annotation files
+
+   A compact-format annotation file (written if the 'stat' of an output
+   annotator is WFDB_COMPACT_WRITE) stores annotations in blocks of up to
+   CABLKLEN annotations, with each field in a separate column.  annopen
+   recognizes these files by the CA_MAGIC string at the beginning, so that
+   they can be read by any input annotator.  The file contains:
+
+     CA_MAGIC (8 bytes)
+     the blocks, each containing:
+       the number of annotations in the block, n (a varint, see below)
+       the number of bytes in the remainder of the block (a varint)
+       the times of the annotations (zigzag-encoded varints, see below);  the
+	 first is the time of the first annotation, and each of the others is
+	 the difference between its time and the time of the one before it
+       the anntyp, subtyp, chan, and num columns, each written as a 0 byte
+	 followed by the n values, or (if all n values are equal) as a 1 byte
+	 followed by the common value
+       the aux strings, written as a 0 byte (if there are none), or as a 1 byte
+	 followed by the n lengths (0 for an annotation without an aux string)
+	 and then by the contents of the strings (without lengths or nulls)
+     a 0 byte, marking the end of the blocks
+     the index, containing the time of the first annotation and the offset
+       of each of the initial blocks that are preceded only by annotations in
+       time order (8 bytes each)
+     the trailer, containing the offset of the index and the number of
+       entries in it (8 bytes each), followed by CA_TRAILER (8 bytes)
+
+   Fixed-length integers are little-endian.  A varint is an unsigned integer
+   written 7 bits at a time, least significant bits first, with the high bit
+   set in each byte except the last.  A zigzag-encoded varint represents a
+   signed integer x as the varint 2x (if x >= 0) or -2x-1 (if x < 0).  As in
+   MIT-format files, times are in units of the annotator's time resolution.
+
+   The index is read when iannsettime is first invoked for the annotator.  As
+   for the checkpoints of MIT-format files (see above), iannsettime resumes
+   reading at the last indexed block that begins before the requested time.
+   Files that cannot be read in this way (such as standard input) are read
+   sequentially.
+
+   Output annotations are buffered and sorted as for MIT-format files (see
+   "Output annotation buffering" below).  If any are written out of order
+   after the buffer has been flushed, oannclose reports this, but does not
+   run sortann, which would rewrite the file in MIT format. */
+
+#define CABLKLEN	1024	/* maximum number of annotations in a block */
+#define CA_MAGIC	"WFDBCAN1"
+#define CA_TRAILER	"WFDBCANX"
+
+struct cablock {	/* a block of annotations (compact format only) */
+    int n;			/* number of annotations in the block */
+    int next;			/* index of the next annotation to be read */
+    WFDB_Time time[CABLKLEN];
+    char anntyp[CABLKLEN];
+    signed char subtyp[CABLKLEN];
+    unsigned char chan[CABLKLEN];
+    signed char num[CABLKLEN];
+    unsigned char auxlen[CABLKLEN]; /* aux string lengths (0: none) */
+    unsigned char *aux;		/* aux strings (output only) */
+    long naux, maxaux;		/* bytes used and allocated in aux */
+    const unsigned char *auxp;	/* next aux string in raw (input only) */
+    unsigned char *raw;		/* encoded block */
+    long maxraw;		/* allocated length of raw */
+};
+
+struct caidx {		/* index entry (compact format only) */
+    WFDB_Time time;		/* time of the first annotation in a block */
+    long offset;		/* offset of the block */
+};
+
+#define CA_ZIG(x)	((x) < 0 ? ((unsigned_time)~(x) << 1) | 1 : \
+			 (unsigned_time)(x) << 1)
+#define CA_UNZIG(v)	((v) & 1 ? ~(WFDB_Time)((v) >> 1) : \
+			 (WFDB_Time)((v) >> 1))
+
+/* ca_putv writes v as a varint at p, and returns a pointer to the byte that
+   follows it. */
+static unsigned char *ca_putv(unsigned char *p, unsigned_time v)
+{
+    while (v >= 0x80) {
+	*p++ = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    *p++ = v;
+    return (p);
+}
+
+/* ca_getv reads a varint at p (which must precede end) into *v, and returns a
+   pointer to the byte that follows it, or NULL if it is incomplete. */
+static const unsigned char *ca_getv(const unsigned char *p,
+				    const unsigned char *end, unsigned_time *v)
+{
+    unsigned shift;
+
+    for (*v = 0, shift = 0; p < end && shift < 8*sizeof(unsigned_time);
+	 shift += 7) {
+	*v |= (unsigned_time)(*p & 0x7f) << shift;
+	if ((*p++ & 0x80) == 0)
+	    return (p);
+    }
+    return (NULL);
+}
+
+/* ca_readv reads a varint from annotator ia into *v, and returns 0, or -1 if
+   it is incomplete. */
+static int ca_readv(struct iadata *ia, unsigned_time *v)
+{
+    int c;
+    unsigned shift;
+
+    for (*v = 0, shift = 0; shift < 8*sizeof(unsigned_time); shift += 7) {
+	if ((c = ia_getc(ia)) == EOF)
+	    return (-1);
+	*v |= (unsigned_time)(c & 0x7f) << shift;
+	if ((c & 0x80) == 0)
+	    return (0);
+    }
+    return (-1);
+}
+
+static void ca_p64(unsigned char *p, unsigned_time v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++, v >>= 8)
+	p[i] = v & 0xff;
+}
+
+static unsigned_time ca_g64(const unsigned char *p)
+{
+    int i;
+    unsigned_time v = 0;
+
+    for (i = 7; i >= 0; i--)
+	v = (v << 8) | p[i];
+    return (v);
+}
+
+/* ca_putcol writes a column of n byte values at p, and returns a pointer to
+   the byte that follows it. */
+static unsigned char *ca_putcol(unsigned char *p, const void *col, int n)
+{
+    const unsigned char *c = col;
+    int i;
+
+    for (i = 1; i < n && c[i] == c[0]; i++)
+	;
+    if (i == n) {
+	*p++ = 1;
+	*p++ = c[0];
+    }
+    else {
+	*p++ = 0;
+	memcpy(p, c, n);
+	p += n;
+    }
+    return (p);
+}
+
+/* ca_getcol reads a column of n byte values at p (which must precede end)
+   into col, and returns a pointer to the byte that follows it, or NULL if it
+   is incomplete. */
+static const unsigned char *ca_getcol(const unsigned char *p,
+				      const unsigned char *end, void *col,
+				      int n)
+{
+    if (p < end && *p == 1 && end - p >= 2) {
+	memset(col, p[1], n);
+	return (p + 2);
+    }
+    if (p < end && *p == 0 && end - p > n) {
+	memcpy(col, p + 1, n);
+	return (p + 1 + n);
+    }
+    return (NULL);
+}
+
+/* ca_fill reads the next block of compact-format annotator ia.  It returns
+   the number of annotations in the block, 0 at the end of the blocks, or -1
+   if the block is incomplete or invalid. */
+static int ca_fill(struct iadata *ia)
+{
+    int i, n;
+    const unsigned char *p, *end;
+    struct cablock *b;
+    unsigned_time v, len, t;
+    long naux;
+
+    if (ia->cab == NULL) {
+	SUALLOC(ia->cab, 1, sizeof(struct cablock));
+	if (ia->cab == NULL)
+	    return (-1);
+    }
+    b = ia->cab;
+    b->n = b->next = 0;
+    if (ca_readv(ia, &v) < 0 || v > CABLKLEN)
+	return (-1);
+    if ((n = v) == 0)
+	return (0);
+    if (ca_readv(ia, &len) < 0 || len > 16L*CABLKLEN + 255L*CABLKLEN)
+	return (-1);
+    if (len > b->maxraw) {
+	SREALLOC(b->raw, len, 1);
+	b->maxraw = b->raw ? len : 0L;
+	if (b->raw == NULL)
+	    return (-1);
+    }
+    if (ia_fread(b->raw, len, ia) != len)
+	return (-1);
+    p = b->raw;
+    end = p + len;
+    for (i = 0, t = 0; i < n; i++) {
+	if ((p = ca_getv(p, end, &v)) == NULL)
+	    return (-1);
+	t += (unsigned_time)CA_UNZIG(v);
+	b->time[i] = (WFDB_Time)t;
+    }
+    if ((p = ca_getcol(p, end, b->anntyp, n)) == NULL ||
+	(p = ca_getcol(p, end, b->subtyp, n)) == NULL ||
+	(p = ca_getcol(p, end, b->chan, n)) == NULL ||
+	(p = ca_getcol(p, end, b->num, n)) == NULL || p >= end)
+	return (-1);
+    if (*p++ == 0)
+	memset(b->auxlen, 0, n);
+    else {
+	if (end - p < n)
+	    return (-1);
+	memcpy(b->auxlen, p, n);
+	p += n;
+	for (i = 0, naux = 0L; i < n; i++)
+	    naux += b->auxlen[i];
+	b->auxp = p;
+	p += naux;
+    }
+    if (p != end)
+	return (-1);
+    return (b->n = n);
+}
+
+/* ca_next reads the next annotation from compact-format annotator ia into
+   ia->ann.  It returns 1, 0 at the end of the file, or -1 if the file is
+   incomplete or invalid. */
+static int ca_next(struct iadata *ia)
+{
+    int i, len, stat;
+    struct cablock *b = ia->cab;
+
+    if ((b == NULL || b->next >= b->n) && (stat = ca_fill(ia)) <= 0)
+	return (stat);
+    b = ia->cab;
+    i = b->next++;
+    ia->ann_tt = b->time[i];
+    ia->ann.anntyp = b->anntyp[i];
+    ia->ann.subtyp = b->subtyp[i];
+    ia->ann.chan = b->chan[i];
+    ia->ann.num = b->num[i];
+    if ((len = b->auxlen[i]) > 0) {
+	ia->ann.aux = ia_auxspace(ia, len+2);
+	ia->ann.aux[0] = len;
+	memcpy(ia->ann.aux + 1, b->auxp, len);
+	ia->ann.aux[len+1] = '\0';
+	ia_auxkeep(ia, len+2);
+	b->auxp += len;
+    }
+    else
+	ia->ann.aux = NULL;
+    return (1);
+}
+
+/* ca_find returns the index entry for the last block of compact-format
+   annotator ia that begins before time t (in sample intervals), or NULL if
+   there is none.  The index is read when ca_find is first invoked. */
+static struct caidx *ca_find(struct iadata *ia, WFDB_Time t)
+{
+    unsigned char buf[24];
+    long i, n, offset, end, lo, hi, mid;
+
+    if (ia->ncix < 0) {
+	ia->ncix = 0;
+	if (wfdb_fseek(ia->file, -24L, SEEK_END) == 0 &&
+	    (end = wfdb_ftell(ia->file)) > 0 &&
+	    wfdb_fread(buf, 1, 24, ia->file) == 24 &&
+	    memcmp(buf + 16, CA_TRAILER, 8) == 0) {
+	    offset = (long)ca_g64(buf);
+	    n = (long)ca_g64(buf + 8);
+	    if (n > 0 && offset > 0 && offset < end &&
+		(end - offset) % 16 == 0 && (end - offset) / 16 == n &&
+		wfdb_fseek(ia->file, offset, 0) == 0) {
+		SUALLOC(ia->cix, n, sizeof(struct caidx));
+		/* Each entry must point to a block between the 8-byte file
+		   header and the index, and the entries must be in time
+		   order;  otherwise the index is ignored. */
+		for (i = 0; ia->cix && i < n &&
+			 wfdb_fread(buf, 1, 16, ia->file) == 16; i++) {
+		    ia->cix[i].time = (WFDB_Time)ca_g64(buf);
+		    ia->cix[i].offset = (long)ca_g64(buf + 8);
+		    if (ia->cix[i].offset < 8L || ia->cix[i].offset >= offset ||
+			(i > 0 && ia->cix[i].time < ia->cix[i-1].time))
+			break;
+		}
+		if (i == n)
+		    ia->ncix = n;
+		else
+		    SFREE(ia->cix);
+	    }
+	}
+	/* Return to the position at which reading is to continue. */
+	(void)wfdb_fseek(ia->file, ia->rend, 0);
+    }
+    lo = 0L;
+    hi = ia->ncix;
+    while (lo < hi) {	/* find the first block beginning at or after t */
+	mid = lo + (hi - lo) / 2;
+	if (round_to_time(ia->cix[mid].time * ia->tmul) < t)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo > 0 ? &ia->cix[lo-1] : NULL);
+}
+
+/* ca_flush encodes and writes the block of annotations buffered by
+   compact-format output annotator oa, if it is not empty. */
+static int ca_flush(struct oadata *oa)
+{
+    int i;
+    long len;
+    unsigned char head[20], *p, *q;
+    struct cablock *b = oa->cab;
+    unsigned_time prev;
+    WFDB_Time d;
+
+    if (b == NULL || b->n == 0)
+	return (0);
+    len = 16L*b->n + b->naux + 8;
+    if (len > b->maxraw) {
+	SREALLOC(b->raw, len, 1);
+	b->maxraw = b->raw ? len : 0L;
+	if (b->raw == NULL)
+	    return (-1);
+    }
+    p = b->raw;
+    for (i = 0, prev = 0; i < b->n; i++) {
+	d = (WFDB_Time)((unsigned_time)b->time[i] - prev);
+	p = ca_putv(p, CA_ZIG(d));
+	prev = b->time[i];
+    }
+    p = ca_putcol(p, b->anntyp, b->n);
+    p = ca_putcol(p, b->subtyp, b->n);
+    p = ca_putcol(p, b->chan, b->n);
+    p = ca_putcol(p, b->num, b->n);
+    if (b->naux == 0L)
+	*p++ = 0;
+    else {
+	*p++ = 1;
+	memcpy(p, b->auxlen, b->n);
+	p += b->n;
+	memcpy(p, b->aux, b->naux);
+	p += b->naux;
+    }
+    q = ca_putv(ca_putv(head, b->n), p - b->raw);
+    (void)wfdb_fwrite(head, 1, q - head, oa->file);
+    (void)wfdb_fwrite(b->raw, 1, p - b->raw, oa->file);
+    b->n = 0;
+    b->naux = 0L;
+    return (0);
+}
+
+/* ca_put adds an annotation to the block buffered by compact-format output
+   annotator oa, and writes the block once it is full. */
+static int ca_put(struct oadata *oa, const WFDB_Annotation *annot)
+{
+    int len = 0;
+    struct cablock *b;
+    struct caidx *x;
+
+    if ((b = oa->cab) == NULL) {
+	SUALLOC(oa->cab, 1, sizeof(struct cablock));
+	if ((b = oa->cab) == NULL)
+	    return (-1);
+    }
+    if (oa->ncix > 0 && annot->time < oa->ann.time)
+	oa->caunordered = 1;	/* out of order: stop indexing */
+    if (b->n == 0 && !oa->caunordered) {	/* index the new block */
+	if (oa->ncix >= oa->maxcix) {
+	    oa->maxcix = oa->maxcix ? 2 * oa->maxcix : 64;
+	    SREALLOC(oa->cix, oa->maxcix, sizeof(struct caidx));
+	}
+	if (oa->cix == NULL || wfdb_ftell(oa->file) < 0L) {
+	    oa->ncix = oa->maxcix = 0;
+	    oa->caunordered = 1;
+	}
+	else {
+	    x = &oa->cix[oa->ncix++];
+	    x->time = annot->time;
+	    x->offset = wfdb_ftell(oa->file);
+	}
+    }
+    if (annot->aux && (len = *annot->aux) > 0) {
+	if (b->naux + len > b->maxaux) {
+	    b->maxaux = b->maxaux ? 2 * b->maxaux : BULKAUXLEN;
+	    SREALLOC(b->aux, b->maxaux, 1);
+	    if (b->aux == NULL) {
+		b->naux = b->maxaux = 0L;
+		return (-1);
+	    }
+	}
+	memcpy(b->aux + b->naux, annot->aux + 1, len);
+	b->naux += len;
+    }
+    b->time[b->n] = annot->time;
+    b->anntyp[b->n] = annot->anntyp;
+    b->subtyp[b->n] = annot->subtyp;
+    b->chan[b->n] = annot->chan;
+    b->num[b->n] = annot->num;
+    b->auxlen[b->n++] = len;
+    if (b->n >= CABLKLEN)
+	return (ca_flush(oa));
+    return (0);
+}
+
+/* ca_close writes the last block, the index, and the trailer of
+   compact-format output annotator oa, and frees its buffers. */
+static void ca_close(struct oadata *oa)
+{
+    unsigned char buf[24];
+    long i, offset;
+
+    (void)ca_flush(oa);
+    (void)wfdb_putc(0, oa->file);	/* end of blocks */
+    if ((offset = wfdb_ftell(oa->file)) < 0L)
+	oa->ncix = 0;
+    for (i = 0; i < oa->ncix; i++) {
+	ca_p64(buf, (unsigned_time)oa->cix[i].time);
+	ca_p64(buf + 8, (unsigned_time)oa->cix[i].offset);
+	(void)wfdb_fwrite(buf, 1, 16, oa->file);
+    }
+    ca_p64(buf, (unsigned_time)(oa->ncix > 0 ? offset : 0L));
+    ca_p64(buf + 8, (unsigned_time)oa->ncix);
+    memcpy(buf + 16, CA_TRAILER, 8);
+    (void)wfdb_fwrite(buf, 1, 24, oa->file);
+    if (oa->cab) {
+	SFREE(oa->cab->aux);
+	SFREE(oa->cab->raw);
+	SFREE(oa->cab);
+    }
+    SFREE(oa->cix);
+}
+
+/* mit_next reads the next annotation from MIT-format annotator ia into ia->ann
+   (leaving the word that follows it in ia->word).  It returns the length of
+   the annotation's aux string (or 0 if there is none). */
+static int mit_next(struct iadata *ia)
+{
+    int len, auxlen = 0;
+    long skip;
+
+    if (ia->rend - (ia->re - ia->rp) >= ia->ixnext)
+	aix_add(ia, ia->rend - (ia->re - ia->rp));
+    ia->tt += ia->word & DATA; /* annotation time */
+    ia->ann_tt = ia->tt;
+    ia->ann.anntyp = (ia->word & CODE) >> CS; /* set annotation type */
+    ia->ann.subtyp = 0;	/* reset subtype field */
+    ia->ann.aux = NULL;	/* reset aux field */
+    while (((ia->word = (unsigned)ia_g16(ia))&CODE) >= PAMIN && !ia->reof)
+	switch (ia->word & CODE) { /* process pseudo-annotations */
+	  case SKIP:
+	    if ((skip = ia_g32(ia)) < 0)
+		ia->ixnext = LONG_MAX;	/* out of order: stop indexing */
+	    ia->tt += skip;
+	    break;
+	  case SUB:   ia->ann.subtyp = DATA & ia->word; break;
+	  case CHN:   ia->ann.chan = DATA & ia->word; break;
+	  case NUM:   ia->ann.num = DATA & ia->word; break;
+	  case AUX:			/* auxiliary information */
+	    len = ia->word & 0377;	/* length of auxiliary data */
+	    ia->ann.aux = ia_auxspace(ia, len+2);    /* save pointer */
+	    ia->ann.aux[0] = len;		/* save length byte */
+	    /* Now read the data.  Note that an extra byte may be
+	       present in the annotation file to preserve word alignment;
+	       if so, this extra byte is read and then overwritten by
+	       the null in the second statement below. */
+	    (void)ia_fread(ia->ann.aux+1, (len+1)&~1, ia);
+	    ia->ann.aux[len+1] = '\0';	      /* add a null */
+	    ia_auxkeep(ia, len+2);		/* update buffer index */
+	    auxlen = len;
+	    break;
+	  default: break;
+	}
+    return (auxlen);
+}
+
 static int get_ann_table(WFDB_Annotator i)
 {
     char *p1, *p2;
@@ -354,6 +1284,185 @@ static int allocoann(unsigned n)
     return (maxoann);
 }
     
+/* Read an integer or real field of an EDF header. */
+static double edf_field(const char *p, int len)
+{
+    char buf[81];
+
+    if (len > 80) len = 80;
+    strncpy(buf, p, len);
+    buf[len] = '\0';
+    return (strtod(buf, NULL));
+}
+
+/* Free memory used by an EDF+ annotation reader. */
+static void edfann_free(struct edfann *ea)
+{
+    if (ea) {
+	SFREE(ea->annoff);
+	SFREE(ea->annlen);
+	SFREE(ea->buf);
+	SFREE(ea);
+    }
+}
+
+/* Prepare to read annotations from an EDF+ or BDF+ file.  If the file contains
+   any annotation signals, edfann_open fills in ia->edf, ia->afreq, and
+   ia->file, and returns 0;  otherwise, it returns -1. */
+static int edfann_open(struct iadata *ia, char *record)
+{
+    char hdr[256], *sh = NULL, *q;
+    const char *label = NULL;
+    int bps = 0, i, nsig = 0, spf, spfmax = 0;
+    long off;
+    double recdur;
+    struct edfann *ea;
+    WFDB_FILE *ifile;
+
+    /* The final component of the record name must include a suffix other
+       than '.hea'. */
+    for (q = record + strlen(record) - 1; q > record && *q != '.' &&
+	     *q != '/' && *q != ':' && *q != '\\'; q--)
+	;
+    if (*q != '.' || strcmp(q+1, "hea") == 0 ||
+	(ifile = wfdb_open(NULL, record, WFDB_READ)) == NULL)
+	return (-1);
+
+    /* Read the fixed-size and variable-size sections of the header. */
+    if (wfdb_fread(hdr, 1, 256, ifile) == 256) {
+	if (strncmp(hdr, "0       ", 8) == 0) {
+	    bps = 2;
+	    label = "EDF Annotations";
+	}
+	else if (strncmp(hdr+1, "BIOSEMI", 7) == 0) {
+	    bps = 3;
+	    label = "BDF Annotations";
+	}
+	nsig = (int)edf_field(hdr + 252, 4);
+    }
+    if (bps == 0 || nsig < 1 ||
+	(long)edf_field(hdr + 184, 8) != (nsig + 1) * 256L) {
+	(void)wfdb_fclose(ifile);
+	return (-1);
+    }
+    SUALLOC(sh, nsig, 256);
+    if (wfdb_fread(sh, 256, nsig, ifile) != nsig) {
+	SFREE(sh);
+	(void)wfdb_fclose(ifile);
+	return (-1);
+    }
+
+    /* Locate the annotation signals within each data record.  The number of
+       samples per data record of each signal follows 216 bytes of other
+       fields for every signal. */
+    SUALLOC(ea, 1, sizeof(struct edfann));
+    SUALLOC(ea->annoff, nsig, sizeof(long));
+    SUALLOC(ea->annlen, nsig, sizeof(long));
+    ea->start = (nsig + 1) * 256L;
+    if ((ea->nrec = (long)edf_field(hdr + 236, 8)) < 0) ea->nrec = -1;
+    for (i = 0, off = 0; i < nsig; i++) {
+	spf = (int)edf_field(sh + nsig*216 + i*8, 8);
+	if (spf > spfmax) spfmax = spf;
+	if (strncmp(sh + i*16, label, strlen(label)) == 0) {
+	    ea->annoff[ea->nann] = off;
+	    ea->annlen[ea->nann] = (long)spf * bps;
+	    ea->nann++;
+	}
+	off += (long)spf * bps;
+    }
+    ea->recbytes = off;
+    SFREE(sh);
+    if (ea->nann == 0 || ea->recbytes <= 0) {
+	edfann_free(ea);
+	(void)wfdb_fclose(ifile);
+	return (-1);
+    }
+    for (i = 0, off = 0; i < ea->nann; i++)
+	off += ea->annlen[i];
+    SALLOC(ea->buf, off + ea->nann + 1, 1);
+    ea->bp = ea->be = ea->buf;
+
+    /* Use the same time resolution as for the signals (see edfparse). */
+    if ((recdur = edf_field(hdr + 244, 8)) <= 0.0) recdur = 1.0;
+    ia->afreq = (1.0 / recdur) * spfmax;
+    ia->edf = ea;
+    ia->file = ifile;
+    return (0);
+}
+
+/* Read the annotation signals of the next data record into ea->buf.  Returns
+   0 if successful, -1 at the end of the file. */
+static int edfann_read(struct edfann *ea, WFDB_FILE *ifile)
+{
+    int i;
+    long n;
+
+    if (ea->nrec >= 0 && ea->irec >= ea->nrec)
+	return (-1);
+    ea->be = ea->buf;
+    for (i = 0; i < ea->nann; i++) {
+	if (wfdb_fseek(ifile, ea->start + ea->irec * ea->recbytes +
+		       ea->annoff[i], 0) ||
+	    (n = wfdb_fread(ea->be, 1, ea->annlen[i], ifile)) <= 0)
+	    return (-1);
+	ea->be += n;
+	*ea->be++ = '\0';	/* a TAL never spans two signals */
+    }
+    *ea->be = '\0';
+    ea->bp = ea->buf;
+    ea->intal = 0;
+    ea->irec++;
+    return (0);
+}
+
+/* Find the next non-empty annotation in an EDF+ file.  Returns the length of
+   the annotation text, which begins at *text, or -1 if there are no more
+   annotations. */
+static int edfann_next(struct edfann *ea, WFDB_FILE *ifile, char **text)
+{
+    char *p;
+
+    for (;;) {
+	if (!ea->intal) {
+	    /* Skip any padding preceding the next TAL. */
+	    while (ea->bp < ea->be && *ea->bp == '\0')
+		ea->bp++;
+	    if (ea->bp >= ea->be) {
+		if (edfann_read(ea, ifile) < 0)
+		    return (-1);
+		continue;
+	    }
+	    /* Read the onset time, and skip the duration if present. */
+	    ea->onset = strtod(ea->bp, &p);
+	    if (p == ea->bp) {	/* not a TAL -- skip it */
+		ea->bp += strlen(ea->bp);
+		continue;
+	    }
+	    if (*p == '\025')
+		while (*p && *p != '\024')
+		    p++;
+	    if (*p != '\024') {
+		ea->bp = p + strlen(p);
+		continue;
+	    }
+	    ea->bp = p + 1;
+	    ea->intal = 1;
+	}
+	/* ea->bp points to the next annotation text in the TAL, or to the
+	   null that ends the TAL. */
+	if (*ea->bp == '\0') {
+	    ea->intal = 0;
+	    continue;
+	}
+	for (p = ea->bp; *p && *p != '\024'; p++)
+	    ;
+	*text = ea->bp;
+	ea->bp = (*p == '\024') ? p + 1 : p;
+	if (p > *text)
+	    return (p - *text);
+    }
+}
+
 /* WFDB library functions (for general use). */
 
 /* annopen: open annotation files for the specified record */
@@ -385,10 +1494,12 @@ FINT annopen(char *record, const WFDB_Anninfo *aiarray,
 	switch (aiarray[i].stat) {
 	  case WFDB_READ:	/* standard (MIT-format) input file */
 	  case WFDB_AHA_READ:	/* AHA-format input file */
+	  case WFDB_COMPACT_READ: /* compact-format input file */
 	    niafneeded++;
 	    break;
 	  case WFDB_WRITE:	/* standard (MIT-format) output file */
 	  case WFDB_AHA_WRITE:	/* AHA-format output file */
+	  case WFDB_COMPACT_WRITE: /* compact-format output file */
 	    noafneeded++;
 	    break;
 	  default:
@@ -408,10 +1519,25 @@ FINT annopen(char *record, const WFDB_Anninfo *aiarray,
 	switch (aiarray[i].stat) {
 	  case WFDB_READ:	/* standard (MIT-format) input file */
 	  case WFDB_AHA_READ:	/* AHA-format input file */
+	  case WFDB_COMPACT_READ: /* compact-format input file */
 	    ia = iad[niaf];
 	    wfdb_setirec(record);
 	    if ((ia->file=wfdb_open(aiarray[i].name,record,WFDB_READ)) ==
 		NULL) {
+		/* If the record is an EDF+ file, read its annotations. */
+		if (edfann_open(ia, record) == 0) {
+		    WFDB_Annotation annot;
+
+		    ia->info.name = NULL;
+		    SSTRCPY(ia->info.name, aiarray[i].name);
+		    ia->info.stat = EDF_READ;
+		    ia->ann.anntyp = 0;
+		    ia->tmul = 1.0;
+		    niaf++;
+		    (void)getann(niaf-1, &annot);	/* prime the pump */
+		    setiafreq(niaf-1, getifreq());
+		    break;
+		}
 		wfdb_error("annopen: can't read annotator %s for record %s\n",
 			 aiarray[i].name, record);
 		return (-3);
@@ -419,35 +1545,49 @@ FINT annopen(char *record, const WFDB_Anninfo *aiarray,
 	    ia->info.name = NULL;
 	    SSTRCPY(ia->info.name, aiarray[i].name);
 
-	    /* Try to figure out what format the file is in.  AHA-format files
-	       begin with a null byte and an ASCII character which is one
-	       of the legal AHA annotation codes other than '[' or ']'.
-	       MIT annotation files cannot begin in this way. */
-	    ia->word = (unsigned)wfdb_g16(iad[niaf]->file);
-	    a = (ia->word >> 8) & 0xff;
-	    if ((ia->word & 0xff) ||
-		ammap(a) == NOTQRS || a == '[' || a == ']') {
-		if (aiarray[i].stat != WFDB_READ) {
-		    wfdb_error("warning (annopen, annotator %s, record %s):\n",
-			     aiarray[i].name, record);
-		    wfdb_error(" file appears to be in MIT format\n");
-		    wfdb_error(" ... continuing under that assumption\n");
-		}
-		(ia->info).stat = WFDB_READ;
-		/* read any initial null annotation(s) */
-		while ((ia->word & CODE) == SKIP) {
-		    ia->tt += wfdb_g32(ia->file);
-		    ia->word = (unsigned)wfdb_g16(ia->file);
-		}
+	    /* Try to figure out what format the file is in.  Compact-format
+	       files begin with CA_MAGIC, and are read whatever format was
+	       requested.  AHA-format files begin with a null byte and an ASCII
+	       character which is one of the legal AHA annotation codes other
+	       than '[' or ']'.  MIT annotation files cannot begin in this
+	       way. */
+	    ia_rewind(ia, 0L);
+	    ia->ixnext = LONG_MAX;
+	    if (ia_fill(ia) >= 8 && memcmp(ia->rp, CA_MAGIC, 8) == 0) {
+		ia->rp += 8;
+		ia->info.stat = WFDB_COMPACT_READ;
+		ia->ncix = -1L;		/* the index is read by ca_find */
 	    }
 	    else {
-		if (aiarray[i].stat != WFDB_AHA_READ) {
-		    wfdb_error("warning (annopen, annotator %s, record %s):\n",
-			     aiarray[i].name, record);
-		    wfdb_error(" file appears to be in AHA format\n");
-		    wfdb_error(" ... continuing under that assumption\n");
+		ia->word = (unsigned)ia_g16(ia);
+		a = (ia->word >> 8) & 0xff;
+		if ((ia->word & 0xff) ||
+		    ammap(a) == NOTQRS || a == '[' || a == ']') {
+		    if (aiarray[i].stat != WFDB_READ) {
+			wfdb_error(
+			    "warning (annopen, annotator %s, record %s):\n",
+			    aiarray[i].name, record);
+			wfdb_error(" file appears to be in MIT format\n");
+			wfdb_error(" ... continuing under that assumption\n");
+		    }
+		    (ia->info).stat = WFDB_READ;
+		    aix_init(ia);
+		    /* read any initial null annotation(s) */
+		    while ((ia->word & CODE) == SKIP) {
+			ia->tt += ia_g32(ia);
+			ia->word = (unsigned)ia_g16(ia);
+		    }
+		}
+		else {
+		    if (aiarray[i].stat != WFDB_AHA_READ) {
+			wfdb_error(
+			    "warning (annopen, annotator %s, record %s):\n",
+			    aiarray[i].name, record);
+			wfdb_error(" file appears to be in AHA format\n");
+			wfdb_error(" ... continuing under that assumption\n");
+		    }
+		    ia->info.stat = WFDB_AHA_READ;
 		}
-		ia->info.stat = WFDB_AHA_READ;
 	    }
 	    ia->ann.anntyp = 0;    /* any pushed-back annot is invalid */
 	    niaf++;
@@ -456,6 +1596,7 @@ FINT annopen(char *record, const WFDB_Anninfo *aiarray,
 
 	  case WFDB_WRITE:	/* standard (MIT-format) output file */
 	  case WFDB_AHA_WRITE:	/* AHA-format output file */
+	  case WFDB_COMPACT_WRITE: /* compact-format output file */
 	    oa = oad[noaf];
 	    /* Quit (with message from wfdb_checkname) if name is illegal */
 	    if (wfdb_checkname(aiarray[i].name, "annotator"))
@@ -470,119 +1611,581 @@ FINT annopen(char *record, const WFDB_Anninfo *aiarray,
 	    SSTRCPY(oa->info.name, aiarray[i].name);
 	    oa->rname = NULL;
 	    SSTRCPY(oa->rname, record);
-	    oa->ann.time = 0L;
+	    oa->ann.time = oa->last.time = 0L;
 	    oa->info.stat = aiarray[i].stat;
+	    oa->buffered = (oa->info.stat == WFDB_WRITE ||
+			    oa->info.stat == WFDB_COMPACT_WRITE);
 	    oa->out_of_order = 0;
+	    oa->ncix = oa->maxcix = 0L;
+	    oa->caunordered = 0;
+	    if (oa->info.stat == WFDB_COMPACT_WRITE)
+		(void)wfdb_fwrite(CA_MAGIC, 1, 8, oa->file);
 	    oa->table_written = 0;
 	    noaf++;
 	    break;
 	}
     }
-    return (0);
+    return (0);
+}
+
+/* getann: read an annotation from annotator n into *annot */
+FINT getann(WFDB_Annotator n, WFDB_Annotation *annot)
+{
+    int a, len;
+    unsigned char *ap;
+    struct iadata *ia;
+    WFDB_TRACE_FUNCTION("getann");
+
+    if (n >= niaf || (ia = iad[n]) == NULL || ia->file == NULL) {
+	wfdb_error("getann: can't read annotator %d\n", n);
+		return (-2);
+    }
+
+    if (ia->pann.anntyp) {	/* an annotation was pushed back */
+	*annot = ia->pann;
+      	ia->pann.anntyp = 0;
+	ia->prev_time = annot->time;
+	ia->prev_tt = ia->pann_tt;
+	return (0);
+    }
+
+    if (ia->ateof) {
+	if (ia->ateof != -1)
+	    return (-1);	/* reached logical EOF */
+	wfdb_error("getann: unexpected EOF in annotator %s\n",
+		 ia->info.name);
+	return (-3);
+    }
+    *annot = ia->ann;
+    ia->prev_time = annot->time;
+    ia->prev_tt = ia->ann_tt;
+
+    if (ia->info.stat == EDF_READ) {	/* EDF+ annotation signals */
+	char *text;
+
+	if ((len = edfann_next(ia->edf, ia->file, &text)) < 0) {
+	    ia->ateof = 1;
+	    return (0);
+	}
+	if (len > 255) len = 255;
+	ia->ann.anntyp = NOTE;
+	ia->ann.subtyp = ia->ann.chan = ia->ann.num = 0;
+	ia->ann.aux = ia_auxspace(ia, len+2);
+	ia->ann.aux[0] = len;
+	memcpy(ia->ann.aux + 1, text, len);
+	ia->ann.aux[len+1] = '\0';
+	ia_auxkeep(ia, len+2);
+	ia->ann_tt = ia->edf->onset * ia->afreq;
+	ia->ann.time = round_to_time(ia->ann_tt * ia->tmul);
+	return (0);
+    }
+
+    switch (ia->info.stat) {
+      case WFDB_READ:		/* MIT-format input file */
+      default:
+	if (ia->word == 0) {	/* logical end of file */
+	    ia->ateof = 1;
+	    aix_save(ia);
+	    return (0);
+	}
+	(void)mit_next(ia);
+	break;
+      case WFDB_COMPACT_READ:		/* compact-format input file */
+	if ((a = ca_next(ia)) == 0) {	/* logical end of file */
+	    ia->ateof = 1;
+	    return (0);
+	}
+	if (a < 0)			/* incomplete or invalid block */
+	    ia->reof = 1;
+	break;
+      case WFDB_AHA_READ:		/* AHA-format input file */
+	if ((ia->word&0377) == EOAF) { /* logical end of file */
+	    ia->ateof = 1;
+	    return (0);
+	}
+	a = ia->word >> 8;		 /* AHA annotation code */
+	ia->ann.anntyp = ammap(a);	 /* convert to MIT annotation code */
+	ia->ann_tt = (WFDB_Time)ia_g32(ia);	 /* time of annotation */
+	if (ia_g16(ia) <= 0)		 /* serial number (starts at 1) */
+	    wfdb_error("getann: unexpected annot number in annotator %s\n",
+		       ia->info.name);
+	ia->ann.subtyp = ia_getc(ia);	 /* MIT annotation subtype */
+	if (a == 'U' && ia->ann.subtyp == 0)
+	    ia->ann.subtyp = -1;	 /* unreadable (noise subtype -1) */
+	ia->ann.chan = ia_getc(ia);	 /* MIT annotation code */
+	ap = ia_auxspace(ia, AUXLEN+2);
+	/* read aux data */
+	(void)ia_fread(ap + 1, AUXLEN, ia);
+	/* There is very limited space in AHA format files for auxiliary
+	   information, so no length byte is recorded;  instead, we
+	   assume that if the first byte of auxiliary data is
+	   not null, that up to AUXLEN bytes may be significant. */
+	if (ap[1]) {
+	    ap[0] = AUXLEN;
+	    ia->ann.aux = ap;			 /* save buffer pointer */
+	    ap[1 + AUXLEN] = '\0';		 /* add a null */
+	    ia_auxkeep(ia, AUXLEN+2);		 /* update buffer index */
+	}
+	else
+	    ia->ann.aux = NULL;
+	ia->word = (unsigned)ia_g16(ia);
+	break;
+    }
+    ia->ann.time = round_to_time(ia->ann_tt * ia->tmul);
+    if (ia->reof)
+	ia->ateof = -1;
+    return (0);
+}
+
+/* getanns: read up to max annotations from annotator n into out[0], out[1],
+   ...;  return the number of annotations read, or (if none could be read) the
+   value returned by getann.  The aux strings of these annotations are kept
+   until the next call of getanns for annotator n (or, in WFDB_AUX_STABLE mode,
+   until the annotator is closed);  if there is not enough space for them,
+   fewer than max annotations are read.  MIT-format files are
+   decoded directly from the annotator's input buffer. */
+FINT getanns(WFDB_Annotator n, WFDB_Annotation *out, int max)
+{
+    int k, len, stat = 0;
+    unsigned bi = 0;
+    struct iadata *ia;
+    WFDB_Annotation *annot;
+    WFDB_TRACE_FUNCTION("getanns");
+
+    if (n >= niaf || (ia = iad[n]) == NULL || ia->file == NULL) {
+	wfdb_error("getanns: can't read annotator %d\n", n);
+	return (-2);
+    }
+    for (k = 0; k < max && bi <= BULKAUXLEN - 258; k++) {
+	annot = out + k;
+	if (ia->info.stat == WFDB_READ && ia->pann.anntyp == 0 &&
+	    ia->ateof == 0 && ia->word != 0) {
+	    /* This is what getann does, without the overhead of a call. */
+	    *annot = ia->ann;
+	    ia->prev_time = annot->time;
+	    ia->prev_tt = ia->ann_tt;
+	    (void)mit_next(ia);
+	    ia->ann.time = round_to_time(ia->ann_tt * ia->tmul);
+	    if (ia->reof)
+		ia->ateof = -1;
+	}
+	else if ((stat = getann(n, annot)) < 0)
+	    break;
+
+	/* Copy the aux string, which will otherwise be overwritten. */
+	if (annot->aux && ia->auxmode != WFDB_AUX_STABLE) {
+	    if (ia->bulkaux == NULL)
+		SUALLOC(ia->bulkaux, BULKAUXLEN, 1);
+	    if (ia->bulkaux) {
+		len = *annot->aux;
+		memcpy(ia->bulkaux + bi, annot->aux, len + 1);
+		ia->bulkaux[bi + len + 1] = '\0';
+		annot->aux = ia->bulkaux + bi;
+		bi += len + 2;
+	    }
+	}
+    }
+    return (k > 0 ? k : stat);
+}
+
+/* wfdb_getanntab: read the remaining annotations from annotator n into the
+   columnar table *tab;  return the number of annotations read, or a negative
+   value if an error occurred.  As for a loop of getann calls, reading stops
+   at the end of the file or at the first error (such as an unexpected EOF),
+   and any annotations read before the error are returned.  Any previous
+   contents of *tab are discarded without being freed.  The arrays in *tab are
+   allocated by this function, and should be freed using wfdb_freeanntab when
+   no longer needed. */
+#define ATBATCH 1024	/* number of annotations read by each getanns call */
+
+FLONGINT wfdb_getanntab(WFDB_Annotator n, WFDB_Anntab *tab)
+{
+    int k = 0;
+    long i, j, len, max = 0L, maxaux = 0L;
+    WFDB_Annotation *buf = NULL, *annot;
+    WFDB_TRACE_FUNCTION("wfdb_getanntab");
+
+    memset(tab, 0, sizeof(WFDB_Anntab));
+    SUALLOC(buf, ATBATCH, sizeof(WFDB_Annotation));
+    if (buf == NULL)
+	return (-3);
+    while ((k = getanns(n, buf, ATBATCH)) > 0) {
+	if (tab->n + k > max) {
+	    max = max ? 2 * max : 4 * ATBATCH;
+	    SREALLOC(tab->time, max, sizeof(WFDB_Time));
+	    SREALLOC(tab->anntyp, max, 1);
+	    SREALLOC(tab->subtyp, max, 1);
+	    SREALLOC(tab->chan, max, 1);
+	    SREALLOC(tab->num, max, 1);
+	    SREALLOC(tab->auxoff, max, sizeof(long));
+	    if (!tab->time || !tab->anntyp || !tab->subtyp || !tab->chan ||
+		!tab->num || !tab->auxoff)
+		break;
+	}
+	for (i = 0; i < k; i++) {
+	    annot = buf + i;
+	    j = tab->n++;
+	    tab->time[j] = annot->time;
+	    tab->anntyp[j] = annot->anntyp;
+	    tab->subtyp[j] = annot->subtyp;
+	    tab->chan[j] = annot->chan;
+	    tab->num[j] = annot->num;
+	    if (annot->aux) {
+		len = *annot->aux + 2;	/* length byte, data, and null */
+		if (tab->auxlen + len > maxaux) {
+		    maxaux = maxaux ? 2 * maxaux : BULKAUXLEN;
+		    SREALLOC(tab->aux, maxaux, 1);
+		    if (tab->aux == NULL)
+			break;
+		}
+		memcpy(tab->aux + tab->auxlen, annot->aux, len);
+		tab->auxoff[j] = tab->auxlen;
+		tab->auxlen += len;
+	    }
+	    else
+		tab->auxoff[j] = -1L;
+	}
+	if (i < k)
+	    break;
+    }
+    SFREE(buf);
+    if (k > 0) {	/* out of memory */
+	wfdb_freeanntab(tab);
+	return (-3);
+    }
+    if (k < -1 && tab->n == 0L)
+	return (k);	/* error reading annotator */
+    return (tab->n);
+}
+
+/* wfdb_anntabfind: return the index of the first annotation in *tab with a
+   time of t or later, or tab->n if there is no such annotation.  The
+   annotations in *tab must be in time order. */
+FLONGINT wfdb_anntabfind(const WFDB_Anntab *tab, WFDB_Time t)
+{
+    long lo = 0L, hi = tab->n, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (tab->time[mid] < t)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo);
+}
+
+/* wfdb_freeanntab: free the arrays in *tab, and set tab->n to 0. */
+FVOID wfdb_freeanntab(WFDB_Anntab *tab)
+{
+    SFREE(tab->time);
+    SFREE(tab->anntyp);
+    SFREE(tab->subtyp);
+    SFREE(tab->chan);
+    SFREE(tab->num);
+    SFREE(tab->auxoff);
+    SFREE(tab->aux);
+    tab->n = tab->auxlen = 0L;
+}
+
+/* anntab_group: allocate the arrays of *idx, and fill in idx->start and
+   idx->pos by sorting the positions of the annotations in *tab by type
+   (a counting sort, which keeps annotations of the same type in table order).
+   idx->time is left for the caller to fill in.  Returns 0, or -3 if there is
+   not enough memory. */
+static int anntab_group(const WFDB_Anntab *tab, WFDB_Anntabidx *idx)
+{
+    int k;
+    long i, next[256];
+
+    memset(idx, 0, sizeof(WFDB_Anntabidx));
+    if (tab->n <= 0L)
+	return (0);
+    SUALLOC(idx->pos, tab->n, sizeof(long));
+    SUALLOC(idx->time, tab->n, sizeof(WFDB_Time));
+    if (idx->pos == NULL || idx->time == NULL) {
+	wfdb_freeanntabidx(idx);
+	return (-3);
+    }
+    for (i = 0; i < tab->n; i++)
+	idx->start[(unsigned char)tab->anntyp[i] + 1]++;
+    for (k = 0; k < 256; k++) {
+	idx->start[k+1] += idx->start[k];
+	next[k] = idx->start[k];
+    }
+    for (i = 0; i < tab->n; i++)
+	idx->pos[next[(unsigned char)tab->anntyp[i]]++] = i;
+    return (0);
+}
+
+/* wfdb_anntabindex: build an index of the annotations in *tab by type, so that
+   wfdb_anntabrange can find the annotations of a given type within a time
+   interval without scanning the table.  Returns 0, or -3 if there is not
+   enough memory.  The annotations in *tab must be in time order.  The index
+   refers to positions in *tab, so it must be rebuilt if *tab is changed.  The
+   arrays in *idx are allocated by this function, and should be freed using
+   wfdb_freeanntabidx when no longer needed. */
+FINT wfdb_anntabindex(const WFDB_Anntab *tab, WFDB_Anntabidx *idx)
+{
+    long i;
+
+    if (anntab_group(tab, idx) < 0)
+	return (-3);
+    for (i = 0; i < tab->n; i++)
+	idx->time[i] = tab->time[idx->pos[i]];
+    return (0);
+}
+
+/* wfdb_anntabrange: return the number of annotations of the given type with
+   times in the interval [t0, t1), using an index built by wfdb_anntabindex.
+   If pos is not NULL, *pos is set to point to the positions of these
+   annotations in the table, in time order.  Only the low 8 bits of type are
+   significant, as for the anntyp field of an annotation. */
+FLONGINT wfdb_anntabrange(const WFDB_Anntabidx *idx, int type,
+			  WFDB_Time t0, WFDB_Time t1, const long **pos)
+{
+    long lo, hi, mid, first;
+
+    type &= 0377;
+    lo = idx->start[type];
+    hi = idx->start[type+1];
+    while (lo < hi) {	/* find the first annotation at or after t0 */
+	mid = lo + (hi - lo) / 2;
+	if (idx->time[mid] < t0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    first = lo;
+    hi = idx->start[type+1];
+    while (lo < hi) {	/* find the first annotation at or after t1 */
+	mid = lo + (hi - lo) / 2;
+	if (idx->time[mid] < t1)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (pos)
+	*pos = idx->pos + first;
+    return (lo - first);
+}
+
+/* wfdb_freeanntabidx: free the arrays in *idx, and clear it. */
+FVOID wfdb_freeanntabidx(WFDB_Anntabidx *idx)
+{
+    SFREE(idx->pos);
+    SFREE(idx->time);
+    memset(idx, 0, sizeof(WFDB_Anntabidx));
+}
+
+/* Merging input annotators
+
+   wfdb_annmerge selects a set of open input annotators to be merged, and
+   wfdb_getmergedann then returns their annotations one at a time in time
+   order, together with the number of the annotator from which each was read.
+   Simultaneous annotations from different annotators are returned in the
+   order in which the annotators were listed in the call to wfdb_annmerge;
+   those from a single annotator are returned in the order in which they
+   occur in its file.  The annotators are read in blocks using getanns, and
+   a heap ordered by the times of the next annotations from each annotator
+   selects the next annotation to be returned, so that merging n annotators
+   costs O(log n) per annotation.
+
+   An annotation returned by wfdb_getmergedann (including its aux string)
+   remains valid until the next call of wfdb_getmergedann.  If iannsettime is
+   invoked, the merge continues from the new position;  if any of the input
+   annotators are closed, the merge ends, and wfdb_annmerge must be used to
+   begin a new one.  If an error occurs while reading one of the annotators,
+   wfdb_getmergedann returns the error once the annotations read from it
+   before the error have been returned, and the merge then continues with the
+   remaining annotators. */
+
+/* am_end: discard the state of a merge */
+static void am_end(void)
+{
+    unsigned i;
+
+    for (i = 0; i < namsrc; i++)
+	SFREE(amsrc[i].buf);
+    SFREE(amsrc);
+    SFREE(amheap);
+    namsrc = namheap = 0;
+    amnext = amstale = amactive = 0;
+}
+
+/* am_fill: read the next block of annotations from source s;  returns the
+   number read, 0 if there are no more, or the (negative) value returned by
+   getanns if an error occurred */
+static int am_fill(unsigned s)
+{
+    int stat;
+    struct amsource *src = &amsrc[s];
+
+    src->next = 0;
+    if ((stat = getanns(src->an, src->buf, AMBATCH)) < 0) {
+	src->n = 0;
+	return (stat == -1 ? 0 : stat);
+    }
+    return (src->n = stat);
 }
 
-/* getann: read an annotation from annotator n into *annot */
-FINT getann(WFDB_Annotator n, WFDB_Annotation *annot)
+/* am_before: return true if the next annotation from source s precedes the
+   next annotation from source t */
+static int am_before(unsigned s, unsigned t)
 {
-    int a, len;
-    struct iadata *ia;
+    WFDB_Time ts = amsrc[s].buf[amsrc[s].next].time;
+    WFDB_Time tt = amsrc[t].buf[amsrc[t].next].time;
 
-    if (n >= niaf || (ia = iad[n]) == NULL || ia->file == NULL) {
-	wfdb_error("getann: can't read annotator %d\n", n);
-		return (-2);
+    return (ts < tt || (ts == tt && s < t));
+}
+
+/* am_siftdown: restore the heap property below amheap[i] */
+static void am_siftdown(unsigned i)
+{
+    unsigned c, s = amheap[i];
+
+    while ((c = 2*i + 1) < namheap) {
+	if (c + 1 < namheap && am_before(amheap[c+1], amheap[c]))
+	    c++;
+	if (!am_before(amheap[c], s))
+	    break;
+	amheap[i] = amheap[c];
+	i = c;
     }
+    amheap[i] = s;
+}
 
-    if (ia->pann.anntyp) {	/* an annotation was pushed back */
-	*annot = ia->pann;
-      	ia->pann.anntyp = 0;
-	ia->prev_time = annot->time;
-	ia->prev_tt = ia->pann_tt;
-	return (0);
+/* am_prime: fill the buffers of all sources and build the heap;  returns 0,
+   or the value returned by am_fill for the first source that could not be
+   read */
+static int am_prime(void)
+{
+    int stat, err = 0;
+    unsigned i;
+
+    for (i = namheap = 0; i < namsrc; i++) {
+	if ((stat = am_fill(i)) > 0)
+	    amheap[namheap++] = i;
+	else if (stat < 0 && err == 0)
+	    err = stat;
     }
+    for (i = namheap / 2; i > 0; i--)
+	am_siftdown(i - 1);
+    amnext = amstale = 0;
+    return (err);
+}
 
-    if (ia->ateof) {
-	if (ia->ateof != -1)
-	    return (-1);	/* reached logical EOF */
-	wfdb_error("getann: unexpected EOF in annotator %s\n",
-		 ia->info.name);
+/* wfdb_annmerge: begin merging the n input annotators listed in alist (or all
+   open input annotators, if alist is NULL);  returns 0 if successful, -2 if
+   any of the annotators is not open or is listed more than once, or -3 if
+   there is insufficient memory */
+FINT wfdb_annmerge(const WFDB_Annotator *alist, unsigned int n)
+{
+    unsigned i, j;
+    WFDB_Annotator a;
+
+    am_end();
+    if (alist == NULL)
+	n = niaf;
+    if (n == 0) {		/* an empty merge returns no annotations */
+	amactive = 1;
+	return (0);
+    }
+    SALLOC(amsrc, n, sizeof(struct amsource));
+    SUALLOC(amheap, n, sizeof(unsigned));
+    if (amsrc == NULL || amheap == NULL) {
+	am_end();
 	return (-3);
     }
-    *annot = ia->ann;
-    ia->prev_time = annot->time;
-    ia->prev_tt = ia->ann_tt;
-
-    switch (ia->info.stat) {
-      case WFDB_READ:		/* MIT-format input file */
-      default:
-	if (ia->word == 0) {	/* logical end of file */
-	    ia->ateof = 1;
-	    return (0);
+    namsrc = n;
+    for (i = 0; i < n; i++) {
+	a = alist ? alist[i] : i;
+	if (a >= niaf || iad[a] == NULL || iad[a]->file == NULL) {
+	    wfdb_error("wfdb_annmerge: annotator %d is not open\n", a);
+	    am_end();
+	    return (-2);
 	}
-	ia->tt += ia->word & DATA; /* annotation time */
-	ia->ann_tt = ia->tt;
-	ia->ann.anntyp = (ia->word & CODE) >> CS; /* set annotation type */
-	ia->ann.subtyp = 0;	/* reset subtype field */
-	ia->ann.aux = NULL;	/* reset aux field */
-	while (((ia->word = (unsigned)wfdb_g16(ia->file))&CODE) >= PAMIN &&
-	       !wfdb_feof(ia->file))
-	    switch (ia->word & CODE) { /* process pseudo-annotations */
-	      case SKIP:  ia->tt += wfdb_g32(ia->file); break;
-	      case SUB:   ia->ann.subtyp = DATA & ia->word; break;
-	      case CHN:   ia->ann.chan = DATA & ia->word; break;
-	      case NUM:	  ia->ann.num = DATA & ia->word; break;
-	      case AUX:			/* auxiliary information */
-		len = ia->word & 0377;	/* length of auxiliary data */
-		if (ia->index >= AUXBUFLEN-2 - len)
-		    ia->index = 0;	/* buffer index */
-		ia->ann.aux = ia->auxstr + ia->index;    /* save pointer */
-		ia->auxstr[ia->index++] = len;	/* save length byte */
-		/* Now read the data.  Note that an extra byte may be
-		   present in the annotation file to preserve word alignment;
-		   if so, this extra byte is read and then overwritten by
-		   the null in the second statement below. */
-		(void)wfdb_fread(ia->auxstr+ia->index,1,(len+1)&~1,ia->file);
-		ia->auxstr[ia->index + len] = '\0';	      /* add a null */
-		ia->index += len+1;		     /* update buffer index */
-		break;
-	      default: break;
+	for (j = 0; j < i; j++)
+	    if (amsrc[j].an == a) {
+		wfdb_error("wfdb_annmerge: annotator %d is listed twice\n", a);
+		am_end();
+		return (-2);
 	    }
-	break;
-      case WFDB_AHA_READ:		/* AHA-format input file */
-	if ((ia->word&0377) == EOAF) { /* logical end of file */
-	    ia->ateof = 1;
-	    return (0);
+	amsrc[i].an = a;
+	SUALLOC(amsrc[i].buf, AMBATCH, sizeof(WFDB_Annotation));
+	if (amsrc[i].buf == NULL) {
+	    am_end();
+	    return (-3);
 	}
-	a = ia->word >> 8;		 /* AHA annotation code */
-	ia->ann.anntyp = ammap(a);	 /* convert to MIT annotation code */
-	ia->ann_tt = (WFDB_Time)wfdb_g32(ia->file);  /* time of annotation */
-	if (wfdb_g16(ia->file) <= 0)	 /* serial number (starts at 1) */
-	    wfdb_error("getann: unexpected annot number in annotator %s\n",
-		       ia->info.name);
-	ia->ann.subtyp = wfdb_getc(ia->file); /* MIT annotation subtype */
-	if (a == 'U' && ia->ann.subtyp == 0)
-	    ia->ann.subtyp = -1;	 /* unreadable (noise subtype -1) */
-	ia->ann.chan = wfdb_getc(ia->file);	 /* MIT annotation code */
-	if (ia->index >= 256 - (AUXLEN+2)) ia->index = 0;
-	/* read aux data */
-	(void)wfdb_fread(ia->auxstr + ia->index + 1, 1, AUXLEN, ia->file);
-	/* There is very limited space in AHA format files for auxiliary
-	   information, so no length byte is recorded;  instead, we
-	   assume that if the first byte of auxiliary data is
-	   not null, that up to AUXLEN bytes may be significant. */
-	if (ia->auxstr[ia->index+1]) {
-	    ia->auxstr[ia->index] = AUXLEN;
-	    ia->ann.aux = ia->auxstr + ia->index; /* save buffer pointer */
-	    ia->auxstr[ia->index + 1 + AUXLEN] = '\0';   /* add a null */
-	    ia->index += AUXLEN+2;		 /* update buffer index */
+    }
+    amactive = 1;
+    amstale = 1;	/* the buffers are filled by wfdb_getmergedann */
+    return (0);
+}
+
+/* wfdb_getmergedann: read the next annotation of the merge begun by
+   wfdb_annmerge into *annot, and the number of the annotator from which it
+   was read into *a (unless a is NULL);  returns 0 if successful, -1 if there
+   are no more annotations, -2 if no merge is in progress, or the (negative)
+   value returned by getanns if an error occurred while reading one of the
+   annotators */
+FINT wfdb_getmergedann(WFDB_Annotator *a, WFDB_Annotation *annot)
+{
+    int stat;
+    unsigned s;
+    struct amsource *src;
+
+    if (!amactive) {
+	wfdb_error("wfdb_getmergedann: no annotators are being merged\n");
+	return (-2);
+    }
+    if (amstale) {
+	if ((stat = am_prime()) < 0)
+	    return (stat);
+    }
+    else if (amnext) {	/* advance past the annotation returned last */
+	s = amheap[0];
+	amnext = 0;
+	if (++amsrc[s].next >= amsrc[s].n && (stat = am_fill(s)) <= 0) {
+	    amheap[0] = amheap[--namheap];
+	    if (namheap > 0)
+		am_siftdown(0);
+	    if (stat < 0)
+		return (stat);
 	}
 	else
-	    ia->ann.aux = NULL;
-	ia->word = (unsigned)wfdb_g16(ia->file);
-	break;
+	    am_siftdown(0);
     }
-    ia->ann.time = round_to_time(ia->ann_tt * ia->tmul);
-    if (wfdb_feof(ia->file))
-	ia->ateof = -1;
+    if (namheap == 0)
+	return (-1);
+    src = &amsrc[amheap[0]];
+    *annot = src->buf[src->next];
+    if (a)
+	*a = src->an;
+    amnext = 1;
+    return (0);
+}
+
+/* wfdb_setauxmode: select how the aux strings of annotations read from
+   annotator n are stored.  In WFDB_AUX_RING mode (the default), they share a
+   small buffer that is reused as more annotations are read.  In
+   WFDB_AUX_STABLE mode, the aux strings of annotations read from then on
+   remain valid until the annotator is closed, at the cost of keeping them all
+   in memory.  Returns 0, -1 if the mode is invalid, or -2 if annotator n is
+   not open for input. */
+FINT wfdb_setauxmode(WFDB_Annotator n, int mode)
+{
+    struct iadata *ia;
+
+    if (n >= niaf || (ia = iad[n]) == NULL || ia->file == NULL) {
+	wfdb_error("wfdb_setauxmode: can't read annotator %d\n", n);
+	return (-2);
+    }
+    if (mode != WFDB_AUX_RING && mode != WFDB_AUX_STABLE) {
+	wfdb_error("wfdb_setauxmode: invalid mode %d\n", mode);
+	return (-1);
+    }
+    ia->auxmode = mode;
     return (0);
 }
 
@@ -609,45 +2212,91 @@ FINT ungetann(WFDB_Annotator n, const WFDB_Annotation *annot)
     return (0);
 }
 
-/* putann: write annotation at annot to annotator n */
-FINT putann(WFDB_Annotator n, const WFDB_Annotation *annot)
+/* Output annotation buffering
+
+   Annotations written to an MIT-format output annotator are kept in memory,
+   rather than being written immediately, until the annotator is closed or
+   until OABUFMAX annotations have been buffered.  If any of them are out of
+   canonical (time, num, chan) order, oa_flush sorts them before writing them,
+   so that applications can write annotations in any order without requiring
+   a second pass through the file to sort them.  The sort is stable, so that
+   annotations with identical time, num, and chan fields are written in the
+   order in which they were given to putann.
+
+   Once the annotations have been flushed (because the buffer is full, or
+   because wfdbflush was invoked), putann writes any subsequent annotations
+   directly;  if these are out of order, oannclose arranges for them to be
+   sorted by sortann as in earlier versions.
+
+   Note that sorting in memory is not quite equivalent to running sortann.
+   sortann keeps only the last of any annotations with identical time, num,
+   and chan fields, and discards NOTQRS annotations;  oa_flush writes all of
+   them, exactly as putann would have written annotations that were given to
+   it in canonical order.  (The annotation type table written by put_ann_table
+   consists of such annotations, so the sortann rules cannot be applied to
+   the buffer as a whole.)  Applications that rely on sortann to remove
+   duplicates should run it explicitly. */
+
+struct oaent {		/* buffered output annotation */
+    WFDB_Time time;
+    long auxoff;	/* offset of aux string in auxbuf, or -1 if none */
+    char anntyp;
+    signed char subtyp;
+    unsigned char chan;
+    signed char num;
+};
+
+/* OA_BEFORE is true if *A precedes *B in canonical order. */
+#define OA_BEFORE(A, B) ((A)->time < (B)->time || \
+	((A)->time == (B)->time && ((A)->num < (B)->num || \
+	 ((A)->num == (B)->num && (A)->chan < (B)->chan))))
+
+/* oa_sort: stable merge sort of n buffered annotations;  returns 0 if
+   successful, -1 if there is insufficient memory. */
+static int oa_sort(struct oaent *a, long n)
+{
+    long i, k, lo, mid, hi, p, q, w;
+    struct oaent *src, *dst, *t, *tmp = NULL;
+
+    for (i = 1; i < n && !OA_BEFORE(&a[i], &a[i-1]); i++)
+	;
+    if (i >= n)
+	return (0);	/* already in order */
+    SUALLOC(tmp, n, sizeof(struct oaent));
+    if (tmp == NULL)
+	return (-1);
+    for (src = a, dst = tmp, w = 1; w < n; w *= 2) {
+	for (lo = 0; lo < n; lo += 2*w) {
+	    mid = (lo + w < n) ? lo + w : n;
+	    hi = (lo + 2*w < n) ? lo + 2*w : n;
+	    for (p = lo, q = mid, k = lo; k < hi; k++)
+		dst[k] = (q >= hi ||
+			  (p < mid && !OA_BEFORE(&src[q], &src[p]))) ?
+		    src[p++] : src[q++];
+	}
+	t = src; src = dst; dst = t;	/* the merged runs are now in src */
+    }
+    if (src != a)
+	memcpy(a, src, n * sizeof(struct oaent));
+    SFREE(tmp);
+    return (0);
+}
+
+/* oa_put: encode and write an annotation */
+static int oa_put(WFDB_Annotator n, const WFDB_Annotation *annot)
 {
     unsigned annwd;
     const unsigned char *ap;
     int i, len;
     unsigned_time delta;
     WFDB_Time t;
-    struct oadata *oa;
+    struct oadata *oa = oad[n];
 
-    if (n >= noaf || (oa = oad[n]) == NULL || oa->file == NULL) {
-	wfdb_error("putann: can't write annotation file %d\n", n);
-	return (-2);
-    }
     t = annot->time;
-    if (!oa->table_written) {
-	oa->table_written = 1;
-	if (put_ann_table(n) < 0)
-	    return (-1);
-    }
     delta = (unsigned_time) t - oa->ann.time;
-    if (!(annot->chan > oa->ann.chan || annot->num > oa->ann.num ||
-	  t > oa->ann.time || (t == 0L && oa->ann.time == 0L)))
-        oa->out_of_order = 1;
     switch (oa->info.stat) {
       case WFDB_WRITE:	/* MIT-format output file */
       default:
-	/* Do not allow annotations to be written at the minimum or
-	   maximum possible time value.  This prevents applications
-	   from inadvertently clamping annotations to the WFDB_Time
-	   range, which is almost always a mistake (for example, using
-	   a 32-bit 'mrgann' on a record longer than 2^31 samples.)
-	   In addition, encoding an annotation at time WFDB_TIME_MAX
-	   on a 64-bit system would require 2^32 SKIPs (24 GB), so
-	   it's better to catch such bugs beforehand. */
-	if (t == WFDB_TIME_MIN || t == WFDB_TIME_MAX) {
-	    wfdb_error("putann: time overflow in annotation file %d\n", n);
-	    return (-1);
-	}
 	if (t > oa->ann.time) {
 	    /* A SKIP can represent a forward offset of at most
 	       2^31-1, so if delta is larger than that, it needs to be
@@ -716,6 +2365,13 @@ FINT putann(WFDB_Annotator n, const WFDB_Annotation *annot)
 	for ( ; i < AUXLEN; i++)
 	    (void)wfdb_putc('\0', oa->file);
 	break;
+      case WFDB_COMPACT_WRITE:	/* compact-format output file */
+	if (ca_put(oa, annot) < 0) {
+	    wfdb_error("putann: can't buffer annotation for file %s\n",
+		       oa->info.name);
+	    return (-1);
+	}
+	break;
     }
     if (wfdb_ferror(oa->file)) {
 	wfdb_error("putann: write error on annotation file %s\n",
@@ -727,6 +2383,143 @@ FINT putann(WFDB_Annotator n, const WFDB_Annotation *annot)
     return (0);
 }
 
+
+/* oa_flush: sort (if necessary) and write the buffered annotations of
+   annotator n, and stop buffering its output */
+static int oa_flush(WFDB_Annotator n)
+{
+    long i;
+    int stat = 0;
+    struct oadata *oa = oad[n];
+    struct oaent *e;
+    WFDB_Annotation annot;
+
+    oa->buffered = 0;
+    if (oa_sort(oa->buf, oa->nbuf) == 0)
+	oa->out_of_order = 0;
+    for (i = 0; i < oa->nbuf && stat == 0; i++) {
+	e = &oa->buf[i];
+	annot.time = e->time;
+	annot.anntyp = e->anntyp;
+	annot.subtyp = e->subtyp;
+	annot.chan = e->chan;
+	annot.num = e->num;
+	annot.aux = (e->auxoff >= 0) ? oa->auxbuf + e->auxoff : NULL;
+	stat = oa_put(n, &annot);
+    }
+    if (oa->nbuf > 0) {
+	oa->last = oa->ann;
+	oa->last.aux = NULL;
+    }
+    SFREE(oa->buf);
+    SFREE(oa->auxbuf);
+    oa->nbuf = oa->maxbuf = oa->nauxbuf = oa->maxauxbuf = 0L;
+    return (stat);
+}
+
+/* oa_order: note if annot is out of order with respect to the annotation
+   most recently given to (or written by) output annotator oa */
+static void oa_order(struct oadata *oa, const WFDB_Annotation *annot)
+{
+    WFDB_Time t = annot->time;
+
+    if (!(annot->chan > oa->last.chan || annot->num > oa->last.num ||
+	  t > oa->last.time || (t == 0L && oa->last.time == 0L)))
+        oa->out_of_order = 1;
+}
+
+/* oa_buffer: add an annotation to the output buffer of annotator n, or
+   flush the buffer and write the annotation if the buffer is full */
+static int oa_buffer(WFDB_Annotator n, const WFDB_Annotation *annot)
+{
+    long len = 0L;
+    struct oadata *oa = oad[n];
+    struct oaent *e, *buf;
+    unsigned char *auxbuf;
+
+    if (annot->aux && *annot->aux)
+	len = *annot->aux + 1;	/* length byte and data */
+    if (oa->nbuf >= oa->maxbuf && oa->maxbuf < OABUFMAX) {
+	buf = oa->buf;
+	SREALLOC(buf, oa->maxbuf ? 2 * oa->maxbuf : 1024, sizeof(struct oaent));
+	if (buf) {
+	    oa->buf = buf;
+	    oa->maxbuf = oa->maxbuf ? 2 * oa->maxbuf : 1024;
+	}
+    }
+    if (oa->nauxbuf + len > oa->maxauxbuf) {
+	auxbuf = oa->auxbuf;
+	SREALLOC(auxbuf, oa->maxauxbuf ? 2 * oa->maxauxbuf : BULKAUXLEN, 1);
+	if (auxbuf) {
+	    oa->auxbuf = auxbuf;
+	    oa->maxauxbuf = oa->maxauxbuf ? 2 * oa->maxauxbuf : BULKAUXLEN;
+	}
+    }
+    if (oa->nbuf >= oa->maxbuf || oa->nauxbuf + len > oa->maxauxbuf) {
+	/* The buffer is full, or could not be enlarged.  oa_flush leaves the
+	   last annotation it wrote in oa->last;  the pending annotation must
+	   be checked against it, since it is written directly. */
+	if (oa_flush(n) < 0)
+	    return (-1);
+	oa_order(oa, annot);
+	oa->last = *annot;
+	oa->last.aux = NULL;
+	return (oa_put(n, annot));
+    }
+    e = &oa->buf[oa->nbuf++];
+    e->time = annot->time;
+    e->anntyp = annot->anntyp;
+    e->subtyp = annot->subtyp;
+    e->chan = annot->chan;
+    e->num = annot->num;
+    if (len > 0) {
+	memcpy(oa->auxbuf + oa->nauxbuf, annot->aux, len);
+	e->auxoff = oa->nauxbuf;
+	oa->nauxbuf += len;
+    }
+    else
+	e->auxoff = -1L;
+    return (0);
+}
+
+/* putann: write annotation at annot to annotator n */
+FINT putann(WFDB_Annotator n, const WFDB_Annotation *annot)
+{
+    WFDB_Time t;
+    struct oadata *oa;
+
+    if (n >= noaf || (oa = oad[n]) == NULL || oa->file == NULL) {
+	wfdb_error("putann: can't write annotation file %d\n", n);
+	return (-2);
+    }
+    t = annot->time;
+    if (!oa->table_written) {
+	oa->table_written = 1;
+	if (put_ann_table(n) < 0)
+	    return (-1);
+    }
+    oa_order(oa, annot);
+    if (oa->info.stat != WFDB_AHA_WRITE) {
+	/* Do not allow annotations to be written at the minimum or
+	   maximum possible time value.  This prevents applications
+	   from inadvertently clamping annotations to the WFDB_Time
+	   range, which is almost always a mistake (for example, using
+	   a 32-bit 'mrgann' on a record longer than 2^31 samples.)
+	   In addition, encoding an annotation at time WFDB_TIME_MAX
+	   on a 64-bit system would require 2^32 SKIPs (24 GB), so
+	   it's better to catch such bugs beforehand. */
+	if (t == WFDB_TIME_MIN || t == WFDB_TIME_MAX) {
+	    wfdb_error("putann: time overflow in annotation file %d\n", n);
+	    return (-1);
+	}
+    }
+    oa->last = *annot;
+    oa->last.aux = NULL;
+    if (oa->buffered)
+	return (oa_buffer(n, annot));
+    return (oa_put(n, annot));
+}
+
 /* iannsettime: seek so that for the next annotation read from each input
    annotator, anntime >= t */
 FINT iannsettime(WFDB_Time t)
@@ -734,6 +2527,9 @@ FINT iannsettime(WFDB_Time t)
     int stat = 0, niavalid = niaf;
     WFDB_Annotation tempann;
     WFDB_Annotator i;
+    struct annidx *x;
+    struct caidx *cx;
+    unsigned char magic[8];
 
     /* Handle negative arguments as equivalent positive arguments.  As
        an exception, WFDB_TIME_MIN indicates that we should rewind to
@@ -741,25 +2537,77 @@ FINT iannsettime(WFDB_Time t)
        annotations at negative time values. */
     if (t < 0 && t != WFDB_TIME_MIN) t = -t;
 
+    if (amsrc)
+	amstale = 1;	/* refill any merge buffers after seeking */
+
     /* Loop over all annotators. */
     for (i = 0; i < niaf; i++) {
         struct iadata *ia;
 
 	ia = iad[i];
-	if (ia->ann.time >= t) {	/* "rewind" the annotation file */
+	/* If a checkpoint precedes t, and follows the current position (or
+	   if the file must be rewound), resume reading at the checkpoint. */
+	if (ia->info.stat == WFDB_READ && t != WFDB_TIME_MIN && ia->nidx > 0 &&
+	    (x = aix_find(ia, t)) != NULL &&
+	    (ia->ann.time >= t || ia->ateof ||
+	     x->offset > ia->rend - (ia->re - ia->rp))) {
+	    if (wfdb_fseek(ia->file, x->offset, 0) == -1) {
+		wfdb_error("iannsettime: improper seek\n");
+		return (-1);
+	    }
+	    ia_rewind(ia, x->offset);
 	    ia->pann.anntyp = 0;	/* flush pushback buffer */
-	    if (wfdb_fseek(ia->file, 0L, 0) == -1) {
+	    ia->ateof = 0;
+	    ia->tt = x->tt;
+	    ia->word = x->word;
+	    ia->ann.chan = x->chan;
+	    ia->ann.num = x->num;
+	    (void)getann(i, &tempann);
+	}
+	else if (ia->info.stat == WFDB_COMPACT_READ && t != WFDB_TIME_MIN &&
+		 (cx = ca_find(ia, t)) != NULL &&
+		 (ia->ann.time >= t || ia->ateof ||
+		  cx->offset > ia->rend - (ia->re - ia->rp))) {
+	    if (wfdb_fseek(ia->file, cx->offset, 0) == -1) {
 		wfdb_error("iannsettime: improper seek\n");
 		return (-1);
 	    }
+	    ia_rewind(ia, cx->offset);
+	    ia->pann.anntyp = 0;	/* flush pushback buffer */
+	    ia->ateof = 0;
+	    if (ia->cab)
+		ia->cab->n = ia->cab->next = 0;
+	    (void)getann(i, &tempann);
+	}
+	else if (ia->ann.time >= t) {	/* "rewind" the annotation file */
+	    ia->pann.anntyp = 0;	/* flush pushback buffer */
 	    ia->ann.subtyp = ia->ann.chan = ia->ann.num = ia->ateof = 0;
 	    ia->ann.time = ia->tt = 0L;
-	    ia->word = wfdb_g16(ia->file);
-	    if (ia->info.stat == WFDB_READ)
-		while ((ia->word & CODE) == SKIP) {
-		    ia->tt += wfdb_g32(ia->file);
-		    ia->word = wfdb_g16(ia->file);
+	    if (ia->info.stat == EDF_READ) {
+		ia->edf->irec = 0;
+		ia->edf->bp = ia->edf->be = ia->edf->buf;
+		ia->edf->intal = 0;
+	    }
+	    else {
+		if (wfdb_fseek(ia->file, 0L, 0) == -1) {
+		    wfdb_error("iannsettime: improper seek\n");
+		    return (-1);
+		}
+		ia_rewind(ia, 0L);
+		if (ia->info.stat == WFDB_COMPACT_READ) {
+		    (void)ia_fread(magic, 8, ia);	/* skip CA_MAGIC */
+		    if (ia->cab)
+			ia->cab->n = ia->cab->next = 0;
 		}
+		else {
+		    ia->word = ia_g16(ia);
+		    if (ia->info.stat == WFDB_READ)
+			while ((ia->word & CODE) == SKIP) {
+			    ia->tt += ia_g32(ia);
+			    ia->word = ia_g16(ia);
+			}
+		}
+	    }
 	    (void)getann(i, &tempann);
 	}
 	while (ia->ann.time < t && (stat = getann(i, &tempann)) == 0)
@@ -1055,7 +2903,23 @@ FVOID iannclose(WFDB_Annotator n)
     struct iadata *ia;
 
     if (n < niaf && (ia = iad[n]) != NULL && ia->file != NULL) {
+	am_end();	/* annotator numbers are about to change */
 	(void)wfdb_fclose(ia->file);
+	edfann_free(ia->edf);
+	SFREE(ia->rbuf);
+	SFREE(ia->bulkaux);
+	while (ia->auxblk) {
+	    struct auxblock *b = ia->auxblk;
+
+	    ia->auxblk = b->prev;
+	    SFREE(b);
+	}
+	SFREE(ia->idx);
+	SFREE(ia->aixname);
+	if (ia->cab)
+	    SFREE(ia->cab->raw);
+	SFREE(ia->cab);
+	SFREE(ia->cix);
 	SFREE(ia->info.name);
 	SFREE(ia);
 	while (n < niaf-1) {
@@ -1076,6 +2940,8 @@ FVOID oannclose(WFDB_Annotator n)
     struct oadata *oa;
 
     if (n < noaf && (oa = oad[n]) != NULL && oa->file != NULL) {
+	if (oa->buffered)
+	    (void)oa_flush(n);
 	switch (oa->info.stat) {
 	  case WFDB_WRITE:	/* write logical EOF for MIT-format files */
 	    wfdb_p16(0, oa->file);
@@ -1085,6 +2951,9 @@ FVOID oannclose(WFDB_Annotator n)
 	    while (i-- > 0)
 		(void)wfdb_putc(EOAF, oa->file);
 	    break;
+	  case WFDB_COMPACT_WRITE: /* write index of compact-format files */
+	    ca_close(oa);
+	    break;
 	}
 	errflag = wfdb_ferror(oa->file);
 	if (wfdb_fclose(oa->file))
@@ -1094,6 +2963,16 @@ FVOID oannclose(WFDB_Annotator n)
 		       oa->info.name);
 	    annclose_error = -7;
 	}
+	if (oa->out_of_order && oa->info.stat == WFDB_COMPACT_WRITE) {
+	    /* sortann would rewrite the file in MIT format, so the
+	       annotations are left as they are. */
+	    wfdb_error("oannclose: annotations in compact-format annotation"
+		       " file %s are not in canonical order\n",
+		       oa->info.name);
+	    oa->out_of_order = 0;
+	    if (annclose_error == 0)
+		annclose_error = -6;
+	}
 	if (oa->out_of_order) {
 	    int dosort = DEFWFDBANNSORT;
 	    char *p = getenv("WFDBANNSORT");
@@ -1218,8 +3097,13 @@ void wfdb_oaflush(void)
 {
     unsigned int i;
 
-    for (i = 0; i < noaf; i++)
+    for (i = 0; i < noaf; i++) {
+	if (oad[i]->buffered)
+	    (void)oa_flush(i);
+	if (oad[i]->info.stat == WFDB_COMPACT_WRITE)
+	    (void)ca_flush(oad[i]);
 	(void)wfdb_fflush(oad[i]->file);
+    }
 }
 
 void wfdb_anclose(void)
@@ -1242,6 +3126,132 @@ void wfdb_anclose(void)
    "non-wrapped" functions above, except that 'long' is used in place
    of WFDB_Time. */
 
+#undef getanns
+FINT getanns(WFDB_Annotator a, struct WFDB_ann_L *annot, int max)
+{
+    WFDB_Annotation *lla = NULL;
+    int i, n;
+
+    if (max <= 0)
+	return (0);
+    SUALLOC(lla, max, sizeof(WFDB_Annotation));
+    if (lla == NULL)
+	return (-3);
+    n = wfdb_getanns_LL(a, lla, max);
+    for (i = 0; i < n; i++) {
+	if (lla[i].time > LONG_MAX || lla[i].time < LONG_MIN)
+	    lla[i].time = (lla[i].time < 0 ? LONG_MIN : LONG_MAX);
+	memset(&annot[i], 0, sizeof(struct WFDB_ann_L));
+	annot[i].time = lla[i].time;
+	annot[i].anntyp = lla[i].anntyp;
+	annot[i].subtyp = lla[i].subtyp;
+	annot[i].chan = lla[i].chan;
+	annot[i].num = lla[i].num;
+	annot[i].aux = lla[i].aux;
+    }
+    SFREE(lla);
+    return (n);
+}
+
+/* In the table filled by this function, tab->time points to an array of long
+   integers (although it is declared as a WFDB_Time pointer). */
+#undef wfdb_getanntab
+FLONGINT wfdb_getanntab(WFDB_Annotator a, WFDB_Anntab *tab)
+{
+    long i, n, *lt;
+    WFDB_Time t;
+
+    n = wfdb_getanntab_LL(a, tab);
+    lt = (long *)tab->time;
+    for (i = 0; i < n; i++) {	/* convert times in place */
+	t = tab->time[i];
+	if (t > LONG_MAX || t < LONG_MIN)
+	    t = (t < 0 ? LONG_MIN : LONG_MAX);
+	lt[i] = t;
+    }
+    return (n);
+}
+
+#undef wfdb_anntabfind
+FLONGINT wfdb_anntabfind(const WFDB_Anntab *tab, long t)
+{
+    long lo = 0L, hi = tab->n, mid;
+    const long *lt = (const long *)tab->time;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (lt[mid] < t)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (lo);
+}
+
+#undef wfdb_anntabindex
+FINT wfdb_anntabindex(const WFDB_Anntab *tab, WFDB_Anntabidx *idx)
+{
+    long i, *lt;
+
+    if (anntab_group(tab, idx) < 0)
+	return (-3);
+    lt = (long *)idx->time;
+    for (i = 0; i < tab->n; i++)
+	lt[i] = ((const long *)tab->time)[idx->pos[i]];
+    return (0);
+}
+
+#undef wfdb_anntabrange
+FLONGINT wfdb_anntabrange(const WFDB_Anntabidx *idx, int type, long t0,
+			  long t1, const long **pos)
+{
+    long lo, hi, mid, first;
+    const long *lt = (const long *)idx->time;
+
+    type &= 0377;
+    lo = idx->start[type];
+    hi = idx->start[type+1];
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (lt[mid] < t0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    first = lo;
+    hi = idx->start[type+1];
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (lt[mid] < t1)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (pos)
+	*pos = idx->pos + first;
+    return (lo - first);
+}
+
+#undef wfdb_getmergedann
+FINT wfdb_getmergedann(WFDB_Annotator *a, struct WFDB_ann_L *annot)
+{
+    WFDB_Annotation lla;
+    int stat;
+
+    if ((stat = wfdb_getmergedann_LL(a, &lla)) < 0)
+	return (stat);
+    if (lla.time > LONG_MAX || lla.time < LONG_MIN)
+	lla.time = (lla.time < 0 ? LONG_MIN : LONG_MAX);
+    memset(annot, 0, sizeof(struct WFDB_ann_L));
+    annot->time = lla.time;
+    annot->anntyp = lla.anntyp;
+    annot->subtyp = lla.subtyp;
+    annot->chan = lla.chan;
+    annot->num = lla.num;
+    annot->aux = lla.aux;
+    return (stat);
+}
+
 #undef getann
 FINT getann(WFDB_Annotator a, struct WFDB_ann_L *annot)
 {
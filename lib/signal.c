@@ -38,6 +38,15 @@ visible outside of this file:
  sigmap_init	(manages the signal maps)
  sigmap		(creates a virtual signal vector from a raw sample vector)
  edfparse [10.4.5](gets header info from an EDF file)
+ setrecinfo [10.7.1] (sets record parameters from a header's record line)
+ allochsd [10.7.1] (allocates workspace for readheader)
+ hec_free [10.7.1] (deallocates memory used by a compiled header)
+ hec_init [10.7.1] (finds the compiled header for a multi-segment record)
+ hec_strok [10.7.1] (checks a string offset in a compiled header)
+ hec_load [10.7.1] (reads a compiled header)
+ hec_readheader [10.7.1] (gets segment header info from a compiled header)
+ hec_putstr [10.7.1] (adds a string to a compiled header)
+ hec_compile [10.7.1] (creates a compiled header)
  readheader	(reads a header file)
  hsdfree	(deallocates memory used by readheader)
  flac_getsamp	(reads the next sample from a FLAC input file)
@@ -48,12 +57,24 @@ visible outside of this file:
  flac_osinit	(prepares to encode a FLAC output file)
  flac_osopen	(opens a FLAC output file)
  flac_osclose	(closes a FLAC output file)
+ edf_osfmt [10.7.1] (checks if an output signal file is to be written as EDF)
+ edf_spr [10.7.1] (gets the number of samples of a signal per EDF data record)
+ edf_recdur [10.7.1] (gets the duration of an EDF data record)
+ edf_putstr [10.7.1] (writes a string into an EDF header field)
+ edf_putnum [10.7.1] (writes a number into an EDF header field)
+ edf_putheader [10.7.1] (writes the header of an EDF or BDF output file)
+ edf_osinit [10.7.1] (prepares to write an EDF or BDF output file)
+ edf_putsamp [10.7.1] (stores a sample in an EDF data record)
+ edf_putrec [10.7.1] (writes an EDF data record)
+ edf_osclose [10.7.1] (completes an EDF or BDF output file)
  isigclose	(closes input signals)
  osigclose	(closes output signals)
  isgsetframe	(skips to a specified frame number in a specified signal group)
+ edf_getframe [10.7.1] (reads an EDF or BDF data record as an input frame)
  getskewedframe	(reads an input frame, without skew correction)
  meansamp       (calculates mean of an array of samples)
  rgetvec        (reads a sample from each input signal without resampling)
+ getvec16 [10.7.1] (reads an input vector as 16-bit samples)
  openosig       (opens output signals)
 
 This file also contains low-level I/O routines for signals in various formats;
@@ -74,6 +95,10 @@ This file also contains definitions of the following WFDB library functions:
  getvec		(reads a (possibly resampled) sample from each input signal)
  getframe [9.0]	(reads an input frame)
  putvec		(writes a sample to each output signal)
+ getvecs [10.7.1] (reads a block of input vectors)
+ getvecs16 [10.7.1] (reads a block of input vectors as 16-bit samples)
+ putvecs [10.7.1] (writes a block of output vectors)
+ putvecs16 [10.7.1] (writes a block of 16-bit output vectors)
  isigsettime	(skips to a specified time in each signal)
  isgsettime	(skips to a specified time in a specified signal group)
  tnextvec [10.4.13] (skips to next valid sample of a specified signal)
@@ -186,6 +211,8 @@ void example(void)
 
 #include <limits.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef iAPX286
 #define BROKEN_CC
@@ -322,7 +349,17 @@ static unsigned framelen;	/* total number of samples per frame */
 static int gvmode = DEFWFDBGVMODE;	/* getvec mode */
 static int gvc;			/* getvec sample-within-frame counter */
 static int isedf;		/* if non-zero, record is stored as EDF/EDF+ */
+static int edfblock;		/* if non-zero, the open input signals are
+				   read by edf_getframe */
+static unsigned char *edfbuf;	/* edf_getframe workspace */
+static unsigned edfbuflen;	/* length of edfbuf, in bytes */
 static WFDB_Sample *sbuf = NULL;	/* buffer used by sample() */
+static WFDB_Sample16 *sbuf16;	/* buffer used by sample() in WFDB_GVCOMPACT
+				   mode */
+static int sample_clamped;	/* if non-zero, sample() has reported that
+				   samples were clamped */
+static WFDB_Sample *v16buf;	/* getvec16 workspace */
+static int v16len;		/* length of v16buf, in samples */
 static int sample_vflag;	/* if non-zero, last value returned by sample()
 				   was valid */
 
@@ -337,6 +374,10 @@ static struct osdata {		/* unique for each output signal */
     WFDB_Siginfo info;		/* output signal information */
     WFDB_Sample samp;		/* most recent sample written */
     int skew;			/* skew to be written by setheader() */
+    unsigned edfoff;		/* offset of this signal's samples within an
+				   EDF data record, in bytes */
+    char edfann;		/* if non-zero, this is an EDF+ annotation
+				   signal */
 } **osd;
 static struct ogdata {		/* shared by all signals in a group (file) */
     int data;			/* raw data to be written by w*() */
@@ -356,6 +397,12 @@ static struct ogdata {		/* shared by all signals in a group (file) */
     char force_flush;		/* flush even if seek doesn't work */
     char nrewind;		/* number of bytes to seek backwards
 				   after flushing */
+    int edf;			/* if non-zero, the file is EDF or BDF, and
+				   this is the number of bytes per sample */
+    unsigned edfnf;		/* number of frames per EDF data record (0
+				   until the first frame is written) */
+    unsigned edfif;		/* number of frames in current data record */
+    long edfnrec;		/* number of EDF data records written */
 } **ogd;
 static WFDB_Time ostime;	/* time of next output sample */
 static int obsize;		/* default output buffer size */
@@ -367,6 +414,7 @@ static int ninfo;	/* number of info strings read */
 
 /* Local functions (not accessible outside this file). */
 
+static int readheader(const char *record);
 static char *ftimstr(WFDB_Time t, WFDB_Frequency f);
 static char *fmstimstr(WFDB_Time t, WFDB_Frequency f);
 static WFDB_Time fstrtim(const char *string, WFDB_Frequency f);
@@ -505,15 +553,28 @@ static struct sigmapinfo {
     double gain, scale, offset;
     WFDB_Sample sample_offset;
     WFDB_Sample baseline;
+    WFDB_Sample shift;		/* added to input sample if map is SM_SHIFT */
     int index;
     int spf;
+    int map;			/* how to compute this sample (see below) */
 } *smi;
+static int sigmap_direct;	/* if non-zero, the current segment's frames
+				   need no rearrangement (see sigmap_init) */
+
+/* sigmap_init compiles the mapping from the current segment's frame to the
+   virtual frame into a gather table, in which smi[i].map selects how sample
+   i of the virtual frame is obtained: */
+#define SM_ABSENT	0	/* signal missing from segment (invalid) */
+#define SM_COPY		1	/* copied from ivec[index] */
+#define SM_SHIFT	2	/* ivec[index] + shift */
+#define SM_FAST		3	/* scaled (result known to be in range) */
+#define SM_SLOW		4	/* scaled (result must be range-checked) */
 
 static void sigmap_cleanup(void)
 {
     int i;
 
-    need_sigmap = nvsig = tspf = vspfmax = 0;
+    need_sigmap = sigmap_direct = nvsig = tspf = vspfmax = 0;
     SFREE(ovec);
     if (smi) {
 	for (i = 0; i < tspf; i += smi[i].spf)
@@ -603,8 +664,11 @@ static int sigmap_init(int first_segment)
 	    smi[s].scale = 0.;
 	    smi[s].offset = 0.;
 	    smi[s].sample_offset = WFDB_INVALID_SAMPLE;
+	    smi[s].shift = 0;
+	    smi[s].map = SM_ABSENT;
 	}
 	ispfmax = vspfmax;
+	sigmap_direct = 0;
 
 	if (isd[0]->info.fmt == 0 && nisig == 1)
 	    return (0);    /* the current segment is a null record */
@@ -663,6 +727,19 @@ static int sigmap_init(int first_segment)
 			else {
 			    ps->sample_offset = 0;
 			}
+
+			/* If the gains match, no scaling is needed;  the
+			   baselines differ by an integer, if at all. */
+			ps->shift = ps->baseline - isd[i]->info.baseline;
+			if (ps->scale != 1.0)
+			    ps->map = ps->sample_offset ? SM_FAST : SM_SLOW;
+			else if (ps->shift == 0)
+			    ps->map = SM_COPY;
+			else if ((double)ivmin + ps->shift > WFDB_SAMPLE_MIN &&
+				 (double)ivmax + ps->shift <= WFDB_SAMPLE_MAX)
+			    ps->map = SM_SHIFT;
+			else
+			    ps->map = ps->sample_offset ? SM_FAST : SM_SLOW;
 		    }
 		    break;
 		}
@@ -671,6 +748,15 @@ static int sigmap_init(int first_segment)
 		       segp->recname);
 	    return (-1);
 	}
+
+	/* If the segment's signals are a prefix of the virtual signals, in
+	   the same order and with the same gains and baselines, getvec can
+	   read frames directly into the caller's vector. */
+	for (s = 0; s < tspf; s++)
+	    if (s < j ? (smi[s].map != SM_COPY || smi[s].index != s) :
+		smi[s].map != SM_ABSENT)
+		break;
+	sigmap_direct = (s == tspf);
     }
 
     else if (in_msrec && !first_segment && framelen == 0) {
@@ -710,8 +796,13 @@ static int sigmap(WFDB_Sample *vector, const WFDB_Sample *ivec)
     double v;
 
     for (i = 0; i < tspf; i++) {
-	if (ivec[smi[i].index] == WFDB_INVALID_SAMPLE)
+	if (smi[i].map == SM_ABSENT ||
+	    ivec[smi[i].index] == WFDB_INVALID_SAMPLE)
 	    vector[i] = WFDB_INVALID_SAMPLE;
+	else if (smi[i].map == SM_COPY)
+	    vector[i] = ivec[smi[i].index];
+	else if (smi[i].map == SM_SHIFT)
+	    vector[i] = ivec[smi[i].index] + smi[i].shift;
 	else {
 	    /* Scale the input sample and round it to the nearest
 	       integer.  Halfway cases are always rounded up (10.5 is
@@ -719,7 +810,7 @@ static int sigmap(WFDB_Sample *vector, const WFDB_Sample *ivec)
 	       smi[i].offset already includes an extra 0.5, so we
 	       simply need to calculate the floor of v. */
 	    v = ivec[smi[i].index] * smi[i].scale + smi[i].offset;
-	    if (smi[i].sample_offset) {
+	    if (smi[i].map == SM_FAST) {
 		/* Fast case: if we can guarantee that v is always
 		   positive and the following calculation cannot
 		   overflow, we can avoid additional floating-point
@@ -924,6 +1015,475 @@ static int edfparse(WFDB_FILE *ifile)
     return (nsig);
 }
 
+/* The fields of the first (record) line of the most recently parsed header
+   are saved in rinfo by readheader, so that they can be applied by setrecinfo
+   and recorded in a compiled header (see below). */
+static struct recinfo {
+    WFDB_Frequency ffreq;	/* frame rate (0 if not specified) */
+    WFDB_Frequency cfreq;	/* counter frequency (0 if not specified) */
+    double bcount;		/* base counter value */
+    WFDB_Time nsamp;		/* number of samples per signal */
+    int has_nsamp;		/* non-zero if nsamp was specified */
+    char *btstr;		/* base time and date (NULL if not specified) */
+} rinfo;
+
+static int setrecinfo(const char *record, const struct recinfo *r)
+{
+    if (r->ffreq > (WFDB_Frequency)0.) {
+	if (ffreq > (WFDB_Frequency)0. && r->ffreq != ffreq) {
+	    wfdb_error("warning (init):\n");
+	    wfdb_error(" record %s sampling frequency differs", record);
+	    wfdb_error(" from that of previously opened record\n");
+	}
+	else
+	    ffreq = r->ffreq;
+    }
+    else if (ffreq == (WFDB_Frequency)0.)
+	ffreq = WFDB_DEFFREQ;
+
+    /* Set the sampling rate to the frame rate for now.  This may be
+       changed later by isigopen or by setgvmode, if this is a multi-
+       frequency record and WFDB_HIGHRES mode is in effect. */
+    sfreq = ffreq;
+
+    cfreq = r->cfreq;
+    bcount = r->bcount;
+    if (cfreq <= 0.0) cfreq = ffreq;
+
+    if (r->has_nsamp) {
+	if (nsamples == (WFDB_Time)0L)
+	    nsamples = r->nsamp;
+	else if (r->nsamp > (WFDB_Time)0L && r->nsamp != nsamples &&
+		 !in_msrec) {
+	    wfdb_error("warning (init):\n");
+	    wfdb_error(" record %s duration differs", record);
+	    wfdb_error(" from that of previously opened record\n");
+	    /* nsamples must match the shortest record duration. */
+	    if (nsamples > r->nsamp)
+		nsamples = r->nsamp;
+	}
+    }
+
+    /* setbasetime modifies its argument, so pass it a copy of btstr. */
+    if (r->btstr && btime == 0L) {
+	char *p = NULL;
+	int stat;
+
+	SSTRCPY(p, r->btstr);
+	stat = setbasetime(p);
+	SFREE(p);
+	if (stat < 0)
+	    return (-2);    /* error message will come from setbasetime */
+    }
+    return (0);
+}
+
+static int allochsd(unsigned int nsig)
+{
+    if (maxhsig < nsig) {
+	unsigned m = maxhsig;
+
+	SREALLOC(hsd, nsig, sizeof(struct hsdata *));
+	while (m < nsig) {
+	    SUALLOC(hsd[m], 1, sizeof(struct hsdata));
+	    m++;
+	}
+	maxhsig = nsig;
+    }
+    return (maxhsig);
+}
+
+/* Compiled headers for multi-segment records
+
+   Opening a multi-segment record requires reading its master header, and the
+   header of each segment is found and parsed again whenever getvec or
+   isigsettime enters that segment.  For records with many thousands of
+   segments, this can take much longer than reading the samples.  A compiled
+   header ("record.hec", in the same directory as "record.hea") contains the
+   segment table and the parsed contents of each segment's header in binary
+   form, so that readheader can load all of them with a single read.
+
+   A compiled header is used only if the validator recorded within it (see
+   wfdb_fileval in wfdbio.c) matches that of the master header, and only if
+   its contents are consistent;  otherwise the master header is parsed as
+   usual.  The headers of the individual segments are not checked, so a
+   compiled header must be removed (or the master header touched) whenever a
+   segment header is changed.  Compiled headers are written in native byte
+   order, and those written on a platform with a different byte order or
+   structure layout are ignored.
+
+   The environment variable WFDBHEC determines how compiled headers are used
+   (0: never;  1: if present and up to date;  2: as for 1, but also create or
+   replace them as needed when opening a multi-segment record).  If WFDBHEC is
+   not set, DEFWFDBHEC (see wfdblib.h) determines the behavior.
+
+   A compiled header contains a hechdr structure, followed by 'nseg'
+   WFDB_Seginfo structures, 'nrec' hecrec structures, 'nsig' hecsig
+   structures, 'nseg' ints (the hecrec index for each segment, or -1 for null
+   segments), and a string table of 'nstr' bytes.  Strings are stored as
+   offsets into the string table (-1 if NULL).  The sizes of all of these
+   structures are multiples of 8 bytes on all supported platforms, so each
+   section is properly aligned if the file is read into a malloc'ed buffer. */
+
+#define HEC_MAGIC	"WFDBHEC2"
+#define HEC_ORDER	0x01020304
+
+struct hecrec {			/* record line of a compiled segment header */
+    double ffreq, cfreq, bcount;
+    WFDB_Time nsamp;
+    int has_nsamp;
+    int btstr;			/* string offset of base time and date */
+    int nsig;			/* number of signals */
+    int sig;			/* index of first hecsig for this segment */
+};
+
+struct hecsig {			/* signal line of a compiled segment header */
+    int fname, desc, units;	/* string offsets */
+    int group, fmt, spf, skew, bsize, adcres, adczero, baseline, cksum;
+    WFDB_Sample initval;
+    int pad;
+    long start;
+    WFDB_Gain gain;
+    long nsamp;
+};
+
+struct hechdr {
+    char magic[8];		/* HEC_MAGIC */
+    unsigned int order;		/* HEC_ORDER, in the writer's byte order */
+    unsigned int sizes;		/* encoded sizes of the structures below */
+    struct wfdb_fileval heaval;	/* validator of master header */
+    int nseg, nrec, nsig, nstr;	/* section lengths */
+    struct hecrec master;	/* record line of master header */
+};
+
+#define HEC_SIZES ((unsigned)(sizeof(struct hechdr) << 20 | \
+			      sizeof(struct hecrec) << 12 | \
+			      sizeof(struct hecsig) << 4 | sizeof(WFDB_Time)))
+
+static char *hecname;		/* name of compiled header for current record */
+static struct wfdb_fileval heaval;	/* validator of master header */
+static char *hecbuf;		/* contents of compiled header, if loaded */
+static struct hecrec *hecrecs;	/* compiled segment record lines */
+static struct hecsig *hecsigs;	/* compiled segment signal lines */
+static int *hecsegrec;		/* hecrecs index for each segment */
+static char *hecstr;		/* string table */
+
+static void hec_free(void)
+{
+    SFREE(hecbuf);
+    hecrecs = NULL;
+    hecsigs = NULL;
+    hecsegrec = NULL;
+    hecstr = NULL;
+}
+
+/* hec_init is invoked by readheader once the master header file has been
+   opened.  It determines the name of the compiled header, and returns the
+   value of WFDBHEC (or 0 if the master header is not a local file). */
+static int hec_init(void)
+{
+    char *p;
+    int mode = DEFWFDBHEC;
+    size_t len;
+
+    SFREE(hecname);
+    if ((p = getenv("WFDBHEC")) != NULL)
+	mode = strtol(p, NULL, 10);
+    if (mode <= 0 || hheader->type != WFDB_LOCAL || hheader->fp == stdin ||
+	(p = wfdbfile(NULL, NULL)) == NULL || (len = strlen(p)) < 4 ||
+	strcmp(p + len - 4, ".hea") || wfdb_fileval(p, &heaval) < 0)
+	return (0);
+    SSTRCPY(hecname, p);
+    hecname[len-1] = 'c';
+    return (mode);
+}
+
+/* hec_strok returns 1 if offset is the offset of a string in a string table
+   of nstr bytes, or if it is -1 (a NULL string) and nullok is non-zero. */
+static int hec_strok(int offset, int nstr, int nullok)
+{
+    return ((offset == -1 && nullok) || (offset >= 0 && offset < nstr));
+}
+
+/* hec_load reads the compiled header for a multi-segment record, and sets
+   the variables that readheader would set after parsing the master header.
+   It returns 0 if successful, or -1 if there is no usable compiled header. */
+static int hec_load(const char *record)
+{
+    WFDB_FILE *ifile;
+    struct hechdr *hh;
+    struct hecrec *hr;
+    struct hecsig *hg;
+    struct recinfo r;
+    struct stat st;
+    WFDB_Seginfo *sp;
+    size_t n;
+    int i, ok;
+
+    if (stat(hecname, &st) < 0 || st.st_size < sizeof(struct hechdr) ||
+	(ifile = wfdb_fopen(hecname, "rb")) == NULL)
+	return (-1);
+    n = st.st_size;
+    SALLOC(hecbuf, 1, n);
+    if (wfdb_fread(hecbuf, 1, n, ifile) != n) {
+	wfdb_fclose(ifile);
+	hec_free();
+	return (-1);
+    }
+    wfdb_fclose(ifile);
+
+    hh = (struct hechdr *)hecbuf;
+    if (strncmp(hh->magic, HEC_MAGIC, sizeof(hh->magic)) ||
+	hh->order != HEC_ORDER || hh->sizes != HEC_SIZES ||
+	memcmp(&hh->heaval, &heaval, sizeof(heaval)) ||
+	hh->nseg <= 0 || hh->nrec < 0 || hh->nsig < 0 || hh->nstr < 0 ||
+	n != sizeof(struct hechdr) + hh->nseg * sizeof(WFDB_Seginfo) +
+	     hh->nrec * sizeof(struct hecrec) +
+	     hh->nsig * sizeof(struct hecsig) +
+	     hh->nseg * sizeof(int) + hh->nstr) {
+	hec_free();
+	return (-1);
+    }
+    hecrecs = (struct hecrec *)(hecbuf + sizeof(struct hechdr) +
+				hh->nseg * sizeof(WFDB_Seginfo));
+    hecsigs = (struct hecsig *)(hecrecs + hh->nrec);
+    hecsegrec = (int *)(hecsigs + hh->nsig);
+    hecstr = (char *)(hecsegrec + hh->nseg);
+
+    /* Reject the file unless its contents are consistent, so that a damaged
+       compiled header cannot cause out-of-bounds accesses later.  (Since the
+       string table must end with a null, every string within it does.) */
+    ok = (hh->nstr == 0 || hecstr[hh->nstr-1] == '\0') &&
+	hec_strok(hh->master.btstr, hh->nstr, 1);
+    sp = (WFDB_Seginfo *)(hecbuf + sizeof(struct hechdr));
+    for (i = 0; ok && i < hh->nseg; i++, sp++)
+	ok = memchr(sp->recname, '\0', sizeof(sp->recname)) != NULL &&
+	    sp->nsamp >= 0 && hecsegrec[i] >= -1 && hecsegrec[i] < hh->nrec;
+    for (i = 0, hr = hecrecs; ok && i < hh->nrec; i++, hr++)
+	ok = hec_strok(hr->btstr, hh->nstr, 1) && hr->nsig >= 0 &&
+	    hr->sig >= 0 && hr->sig <= hh->nsig - hr->nsig;
+    for (i = 0, hg = hecsigs; ok && i < hh->nsig; i++, hg++)
+	ok = hec_strok(hg->fname, hh->nstr, 0) &&
+	    hec_strok(hg->desc, hh->nstr, 0) &&
+	    hec_strok(hg->units, hh->nstr, 1);
+    if (!ok) {
+	hec_free();
+	return (-1);
+    }
+
+    r.ffreq = hh->master.ffreq;
+    r.cfreq = hh->master.cfreq;
+    r.bcount = hh->master.bcount;
+    r.nsamp = hh->master.nsamp;
+    r.has_nsamp = hh->master.has_nsamp;
+    r.btstr = (hh->master.btstr >= 0) ? hecstr + hh->master.btstr : NULL;
+    if (setrecinfo(record, &r) < 0) {
+	hec_free();
+	return (-1);
+    }
+
+    segments = hh->nseg;
+    msbtime = btime;
+    msbdate = bdate;
+    msnsamples = nsamples;
+    SALLOC(segarray, segments, sizeof(WFDB_Seginfo));
+    memcpy(segarray, hecbuf + sizeof(struct hechdr),
+	   segments * sizeof(WFDB_Seginfo));
+    SFREE(segarray_L);
+    segp = segarray;
+    segend = segarray + segments - 1;
+    if (msnsamples == 0L)
+	msnsamples = segend->samp0 + segend->nsamp;
+    return (0);
+}
+
+/* hec_readheader fills in hsd from a compiled segment header, and returns
+   the number of signals (as readheader does). */
+static int hec_readheader(const char *record, const struct hecrec *hr)
+{
+    struct hecsig *hg;
+    struct hsdata *hs;
+    struct recinfo r;
+    int s;
+
+    r.ffreq = hr->ffreq;
+    r.cfreq = hr->cfreq;
+    r.bcount = hr->bcount;
+    r.nsamp = hr->nsamp;
+    r.has_nsamp = hr->has_nsamp;
+    r.btstr = (hr->btstr >= 0) ? hecstr + hr->btstr : NULL;
+    if (setrecinfo(record, &r) < 0)
+	return (-2);
+
+    allochsd(hr->nsig);
+    for (s = 0, hg = hecsigs + hr->sig; s < hr->nsig; s++, hg++) {
+	hs = hsd[s];
+	SSTRCPY(hs->info.fname, hecstr + hg->fname);
+	SSTRCPY(hs->info.desc, hecstr + hg->desc);
+	if (hg->units >= 0)
+	    SSTRCPY(hs->info.units, hecstr + hg->units);
+	else
+	    SFREE(hs->info.units);
+	hs->info.group = hg->group;
+	hs->info.fmt = hg->fmt;
+	hs->info.spf = hg->spf;
+	hs->info.bsize = hg->bsize;
+	hs->info.adcres = hg->adcres;
+	hs->info.adczero = hg->adczero;
+	hs->info.baseline = hg->baseline;
+	hs->info.cksum = hg->cksum;
+	hs->info.initval = hg->initval;
+	hs->info.gain = hg->gain;
+	hs->info.nsamp = hg->nsamp;
+	hs->skew = hg->skew;
+	hs->start = hg->start;
+	if (hs->info.spf > spfmax) spfmax = hs->info.spf;
+    }
+    setgvmode(gvmode);		/* Reset sfreq if appropriate. */
+    return (hr->nsig);
+}
+
+/* hec_putstr appends a string to the string table of a compiled header that
+   is under construction, and returns its offset. */
+static int hec_putstr(char **str, int *nstr, int *maxstr, const char *s)
+{
+    int n, offset = *nstr;
+
+    if (s == NULL)
+	return (-1);
+    n = strlen(s) + 1;
+    if (*nstr + n > *maxstr) {
+	while (*nstr + n > *maxstr)
+	    *maxstr = (*maxstr) ? 2 * *maxstr : 4096;
+	SREALLOC(*str, *maxstr, 1);
+    }
+    memcpy(*str + offset, s, n);
+    *nstr += n;
+    return (offset);
+}
+
+/* hec_compile is invoked by readheader after it has parsed a master header
+   (and while rinfo contains the master header's record line).  It parses the
+   header of each segment and writes the results to a new compiled header.
+   The variables set by readheader are restored before returning. */
+static void hec_compile(const char *record)
+{
+    struct hechdr hh;
+    struct hecrec *recs = NULL, *hr;
+    struct hecsig *sigs = NULL, *hg;
+    struct hsdata *hs;
+    struct recinfo master;
+    int i, n, s, *segrec = NULL, maxsig = 0, maxstr = 0, ok = 1;
+    char *str = NULL, *tmpname = NULL;
+    WFDB_FILE *ofile;
+    WFDB_Frequency sffreq = ffreq, ssfreq = sfreq, scfreq = cfreq;
+    double sbcount = bcount;
+    long sbtime = btime;
+    WFDB_Date sbdate = bdate;
+    WFDB_Time snsamples = nsamples;
+    int sspfmax = spfmax;
+
+    memset(&hh, 0, sizeof(hh));
+    master = rinfo;
+    rinfo.btstr = NULL;		/* master now owns the base time string */
+    SUALLOC(recs, segments, sizeof(struct hecrec));
+    SUALLOC(segrec, segments, sizeof(int));
+    in_msrec = 1;
+    for (i = 0; i < segments && ok; i++) {
+	if (strcmp(segarray[i].recname, "~") == 0) {
+	    segrec[i] = -1;
+	    continue;
+	}
+	if ((n = readheader(segarray[i].recname)) < 0 || isedf) {
+	    ok = 0;
+	    break;
+	}
+	segrec[i] = hh.nrec;
+	hr = &recs[hh.nrec++];
+	hr->ffreq = rinfo.ffreq;
+	hr->cfreq = rinfo.cfreq;
+	hr->bcount = rinfo.bcount;
+	hr->nsamp = rinfo.nsamp;
+	hr->has_nsamp = rinfo.has_nsamp;
+	hr->btstr = hec_putstr(&str, &hh.nstr, &maxstr, rinfo.btstr);
+	hr->nsig = n;
+	hr->sig = hh.nsig;
+	if (hh.nsig + n > maxsig) {
+	    while (hh.nsig + n > maxsig)
+		maxsig = maxsig ? 2 * maxsig : 256;
+	    SREALLOC(sigs, maxsig, sizeof(struct hecsig));
+	}
+	for (s = 0; s < n; s++) {
+	    hs = hsd[s];
+	    hg = &sigs[hh.nsig++];
+	    memset(hg, 0, sizeof(struct hecsig));
+	    hg->fname = hec_putstr(&str, &hh.nstr, &maxstr, hs->info.fname);
+	    hg->desc = hec_putstr(&str, &hh.nstr, &maxstr, hs->info.desc);
+	    hg->units = hec_putstr(&str, &hh.nstr, &maxstr, hs->info.units);
+	    hg->group = hs->info.group;
+	    hg->fmt = hs->info.fmt;
+	    hg->spf = hs->info.spf;
+	    hg->bsize = hs->info.bsize;
+	    hg->adcres = hs->info.adcres;
+	    hg->adczero = hs->info.adczero;
+	    hg->baseline = hs->info.baseline;
+	    hg->cksum = hs->info.cksum;
+	    hg->initval = hs->info.initval;
+	    hg->gain = hs->info.gain;
+	    hg->nsamp = hs->info.nsamp;
+	    hg->skew = hs->skew;
+	    hg->start = hs->start;
+	}
+    }
+    in_msrec = 0;
+
+    /* Restore the variables set by readheader for the master header. */
+    ffreq = sffreq;
+    sfreq = ssfreq;
+    cfreq = scfreq;
+    bcount = sbcount;
+    btime = sbtime;
+    bdate = sbdate;
+    nsamples = snsamples;
+    spfmax = sspfmax;
+    isedf = 0;
+
+    if (ok) {
+	memcpy(hh.magic, HEC_MAGIC, sizeof(hh.magic));
+	hh.order = HEC_ORDER;
+	hh.sizes = HEC_SIZES;
+	hh.heaval = heaval;
+	hh.nseg = segments;
+	hh.master.ffreq = master.ffreq;
+	hh.master.cfreq = master.cfreq;
+	hh.master.bcount = master.bcount;
+	hh.master.nsamp = master.nsamp;
+	hh.master.has_nsamp = master.has_nsamp;
+	hh.master.btstr = hec_putstr(&str, &hh.nstr, &maxstr, master.btstr);
+
+	/* Write the compiled header under a temporary name, then rename it,
+	   so that other processes never see an incomplete file. */
+	wfdb_asprintf(&tmpname, "%s.%ld", hecname, (long)getpid());
+	if (tmpname && (ofile = wfdb_fopen(tmpname, "wb")) != NULL) {
+	    wfdb_fwrite(&hh, sizeof(hh), 1, ofile);
+	    wfdb_fwrite(segarray, sizeof(WFDB_Seginfo), segments, ofile);
+	    wfdb_fwrite(recs, sizeof(struct hecrec), hh.nrec, ofile);
+	    wfdb_fwrite(sigs, sizeof(struct hecsig), hh.nsig, ofile);
+	    wfdb_fwrite(segrec, sizeof(int), segments, ofile);
+	    wfdb_fwrite(str, 1, hh.nstr, ofile);
+	    if (wfdb_ferror(ofile) | wfdb_fclose(ofile) ||
+		rename(tmpname, hecname))
+		(void)remove(tmpname);
+	}
+    }
+    SFREE(tmpname);
+    SFREE(str);
+    SFREE(sigs);
+    SFREE(segrec);
+    SFREE(recs);
+    SFREE(master.btstr);
+}
+
 static int readheader(const char *record)
 {
     char *p, *q;
@@ -931,7 +1491,9 @@ static int readheader(const char *record)
     WFDB_Signal s;
     WFDB_Time ns;
     unsigned int i, nsig;
+    int hecmode, hecidx;
     static char sep[] = " \t\n\r";
+    WFDB_TRACE_FUNCTION("readheader");
 
     /* If another input header file was opened, close it. */
     if (hheader) {
@@ -957,6 +1519,14 @@ static int readheader(const char *record)
 	return (0);
     }
 
+    /* If a compiled header has been loaded for the current multi-segment
+       record, use it to obtain the segment's signal information. */
+    if (in_msrec && hecbuf && segp && strcmp(record, segp->recname) == 0 &&
+	(hecidx = hecsegrec[segp - segarray]) >= 0)
+	return (hec_readheader(record, &hecrecs[hecidx]));
+    if (!in_msrec)
+	hec_free();
+
     /* If the final component of the record name includes a '.', assume it is a
        file name. */
     q = (char *)record + strlen(record) - 1;
@@ -967,8 +1537,10 @@ static int readheader(const char *record)
 	    wfdb_error("init: can't open %s\n", record);
 	    return (-1);
 	}
-	else if (strcmp(q+1, "hea"))	/* assume EDF if suffix is not '.hea' */
+	else if (strcmp(q+1, "hea")) {	/* assume EDF if suffix is not '.hea' */
+	    WFDB_COUNT(headers_parsed, 1);
 	    return (edfparse(hheader));
+	}
     }
 
     /* Otherwise, assume the file name is record.hea. */
@@ -977,6 +1549,12 @@ static int readheader(const char *record)
 	return (-1);
     }
 
+    /* Use the compiled header for a multi-segment record if possible. */
+    hecmode = in_msrec ? 0 : hec_init();
+    if (hecmode > 0 && hec_load(record) == 0)
+	return (0);
+    WFDB_COUNT(headers_parsed, 1);
+
     /* Read the first line and check for a magic string. */
     if (wfdb_getline(&linebuf, &linebufsize, hheader) == 0) {
         wfdb_error("init: record %s header is empty\n", record);
@@ -1059,7 +1637,8 @@ static int readheader(const char *record)
        specifies the number of signals. */
     nsig = (unsigned)strtol(p, NULL, 10);
 
-    /* Determine the frame rate, if present and not set already. */
+    /* Determine the frame rate, if present. */
+    rinfo.ffreq = (WFDB_Frequency)0.;
     if (p = strtok((char *)NULL, sep)) {
 	if ((f = (WFDB_Frequency)strtod(p, NULL)) <= (WFDB_Frequency)0.) {
 	    wfdb_error(
@@ -1067,39 +1646,24 @@ static int readheader(const char *record)
 		 record);
 	    return (-2);
 	}
-	if (ffreq > (WFDB_Frequency)0. && f != ffreq) {
-	    wfdb_error("warning (init):\n");
-	    wfdb_error(" record %s sampling frequency differs", record);
-	    wfdb_error(" from that of previously opened record\n");
-	}
-	else
-	    ffreq = f;
+	rinfo.ffreq = f;
     }
-    else if (ffreq == (WFDB_Frequency)0.)
-	ffreq = WFDB_DEFFREQ;
-
-    /* Set the sampling rate to the frame rate for now.  This may be
-       changed later by isigopen or by setgvmode, if this is a multi-
-       frequency record and WFDB_HIGHRES mode is in effect. */
-    sfreq = ffreq;
 
     /* Determine the counter frequency and the base counter value. */
-    cfreq = bcount = 0.0;
+    rinfo.cfreq = rinfo.bcount = 0.0;
     if (p) {
 	for ( ; *p && *p != '/'; p++)
 	    ;
 	if (*p == '/') {
-	    cfreq = strtod(++p, NULL);
+	    rinfo.cfreq = strtod(++p, NULL);
 	    for ( ; *p && *p != '('; p++)
 		;
 	    if (*p == '(')
-		bcount = strtod(++p, NULL);
+		rinfo.bcount = strtod(++p, NULL);
 	}
     }
-    if (cfreq <= 0.0) cfreq = ffreq;
 
-    /* Determine the number of samples per signal, if present and not
-       set already. */
+    /* Determine the number of samples per signal, if present. */
     if (p = strtok((char *)NULL, sep)) {
 	if ((ns = strtotime(p, NULL, 10)) < 0L) {
 	    wfdb_error(
@@ -1107,24 +1671,23 @@ static int readheader(const char *record)
 		record);
 	    return (-2);
 	}
-	if (nsamples == (WFDB_Time)0L)
-	    nsamples = ns;
-	else if (ns > (WFDB_Time)0L && ns != nsamples && !in_msrec) {
-	    wfdb_error("warning (init):\n");
-	    wfdb_error(" record %s duration differs", record);
-	    wfdb_error(" from that of previously opened record\n");
-	    /* nsamples must match the shortest record duration. */
-	    if (nsamples > ns)
-		nsamples = ns;
-	}
+	rinfo.has_nsamp = 1;
     }
-    else
+    else {
 	ns = (WFDB_Time)0L;
+	rinfo.has_nsamp = 0;
+    }
+    rinfo.nsamp = ns;
+
+    /* Determine the base time and date, if present. */
+    SFREE(rinfo.btstr);
+    if ((p = strtok((char *)NULL,"\n\r")) != NULL)
+	SSTRCPY(rinfo.btstr, p);
 
-    /* Determine the base time and date, if present and not set already. */
-    if ((p = strtok((char *)NULL,"\n\r")) != NULL &&
-	btime == 0L && setbasetime(p) < 0)
-	return (-2);	/* error message will come from setbasetime */
+    /* Set the frame rate, counter frequency, number of samples, and base
+       time and date, unless they have been set already. */
+    if (setrecinfo(record, &rinfo) < 0)
+	return (-2);
 
     /* Special processing for master header of a multi-segment record. */
     if (segments && !in_msrec) {
@@ -1187,20 +1750,14 @@ static int readheader(const char *record)
 	    wfdb_error(" does not match sum of segment lengths "
 		       "(%"WFDB_Pd_TIME")\n", ns);
 	}
+	/* Create a compiled header if requested. */
+	if (hecmode > 1)
+	    hec_compile(record);
 	return (0);
     }
 
     /* Allocate workspace. */
-    if (maxhsig < nsig) {
-	unsigned m = maxhsig;
-
-	SREALLOC(hsd, nsig, sizeof(struct hsdata *));
-	while (m < nsig) {
-	    SUALLOC(hsd[m], 1, sizeof(struct hsdata));
-	    m++;
-	}
-	maxhsig = nsig;
-    }
+    allochsd(nsig);
 
     /* Now get information for each signal. */
     for (s = 0; s < nsig; s++) {
@@ -1631,13 +2188,16 @@ static int flac_getsamp(struct igdata *g)
        the input file. */
     while (g->bp == g->packptr) {
 	oldcount = g->packcount;
+	WFDB_TRACE_BEGIN("flac_getsamp: decode frame");
 	if (!FLAC__stream_decoder_process_single(g->flacdec)) {
+	    WFDB_TRACE_END("flac_getsamp: decode frame");
 	    if (g->stat != -2) {
 		wfdb_error("getvec: unexpected FLAC decoding error\n");
 		g->stat = -2;
 	    }
 	    return (0);
 	}
+	WFDB_TRACE_END("flac_getsamp: decode frame");
 	if (g->stat <= 0) {
 	    return (0);
 	}
@@ -2057,6 +2617,305 @@ static int flac_osclose(struct ogdata *og)
 
 #endif
 
+/* Routines for writing EDF and BDF signal files.  An output signal group is
+   written as EDF if its format is 16 and its file name ends in ".edf", or as
+   BDF if its format is 24 and its file name ends in ".bdf".  The group's
+   output buffer holds exactly one EDF data record;  putvec stores each
+   sample in place, and the record is written as soon as it is complete.
+   Since the sampling frequency and base time are often set after the output
+   signals have been opened, the data record length is chosen when the first
+   frame is written, and the header written at that time (with an unknown
+   number of data records) is rewritten in place when the file is closed.
+   If any signal in the group is named "EDF Annotations" (or "BDF
+   Annotations"), the file is written as EDF+ (or BDF+), and that signal
+   carries the time-keeping annotations required by EDF+ in place of the
+   values passed to putvec.  No WFDB header file is needed to read such a
+   file; the name of the file can be given as the record name.  Since the
+   samples of each signal are stored contiguously within each data record,
+   a WFDB header cannot describe the file, and newheader and setheader fail
+   (without creating a header) if any output signal is written in this
+   way. */
+
+#define EDF_RECMAX	61440	/* recommended maximum data record size */
+#define EDF_TALMIN	16	/* minimum length of an annotation signal, in
+				   samples per data record */
+
+static const char *edf_month[] = { "JAN", "FEB", "MAR", "APR", "MAY", "JUN",
+				   "JUL", "AUG", "SEP", "OCT", "NOV", "DEC" };
+
+/* edf_osfmt: return the number of bytes per sample if a signal file with the
+   specified format and name is to be written as EDF or BDF, or 0 otherwise */
+static int edf_osfmt(int fmt, const char *fname)
+{
+    size_t n;
+
+    if (fname == NULL || (n = strlen(fname)) < 4)
+	return (0);
+    fname += n - 4;
+    if (fmt == 16 && (strcmp(fname, ".edf") == 0 || strcmp(fname, ".EDF") == 0))
+	return (2);
+    if (fmt == 24 && (strcmp(fname, ".bdf") == 0 || strcmp(fname, ".BDF") == 0))
+	return (3);
+    return (0);
+}
+
+/* edf_spr: return the number of samples of an output signal in each EDF
+   data record */
+static unsigned edf_spr(const struct ogdata *og, const struct osdata *os)
+{
+    if (os->edfann)
+	return (os->info.spf > EDF_TALMIN ? os->info.spf : EDF_TALMIN);
+    return (os->info.spf * og->edfnf);
+}
+
+/* edf_recdur: return the duration of an EDF data record, in seconds */
+static double edf_recdur(const struct ogdata *og)
+{
+    return (og->edfnf / (ffreq > 0.0 ? ffreq : WFDB_DEFFREQ));
+}
+
+/* edf_putstr: copy a string into a blank-padded EDF header field */
+static void edf_putstr(char *p, int width, const char *s)
+{
+    for ( ; width > 0; width--, p++) {
+	if (s && *s) {
+	    *p = (*s < ' ' || *s > '~') ? ' ' : *s;
+	    s++;
+	}
+	else
+	    *p = ' ';
+    }
+}
+
+/* edf_putnum: write a number into an EDF header field, with as many
+   significant digits as will fit */
+static void edf_putnum(char *p, int width, double v)
+{
+    char buf[32];
+    int prec;
+
+    for (prec = width; prec > 1; prec--) {
+	sprintf(buf, "%.*g", prec, v);
+	if (strlen(buf) <= width)
+	    break;
+    }
+    edf_putstr(p, width, buf);
+}
+
+/* edf_putheader: write the header of an EDF or BDF file for output signal
+   group g, at the current position in the file */
+static int edf_putheader(struct ogdata *og, WFDB_Group g, long nrec)
+{
+    char buf[48], *h, *p;
+    double gain, pmin, pmax;
+    int d, m, y, plus = 0;
+    long dmin, dmax, hlen, n, ns = 0;
+    struct osdata *os;
+    WFDB_Signal s, i;
+
+    for (s = 0; s < nosig; s++)
+	if (osd[s]->info.group == g) {
+	    ns++;
+	    if (osd[s]->edfann) plus = 1;
+	}
+    hlen = 256 * (ns + 1);
+    SUALLOC(h, hlen, 1);
+    if (h == NULL)
+	return (-1);
+    memset(h, ' ', hlen);
+
+    /* Write the fixed-size section of the header. */
+    if (og->edf == 2)
+	h[0] = '0';
+    else
+	memcpy(h, "\377BIOSEMI", 8);
+    edf_putstr(h+8, 80, "X X X X");
+    if (bdate) {
+	sscanf(datstr(bdate), "%d/%d/%d", &d, &m, &y);
+	sprintf(buf, "Startdate %02d-%s-%04d X X X", d, edf_month[m-1], y);
+    }
+    else {
+	d = m = 1;
+	y = 1985;
+	strcpy(buf, "Startdate X X X X");
+    }
+    edf_putstr(h+88, 80, buf);
+    sprintf(buf, "%02d.%02d.%02d", d, m, y % 100);
+    edf_putstr(h+168, 8, buf);
+    n = (btime / 1000) % 86400L;
+    sprintf(buf, "%02ld.%02ld.%02ld", n / 3600, (n / 60) % 60, n % 60);
+    edf_putstr(h+176, 8, buf);
+    sprintf(buf, "%ld", hlen);
+    edf_putstr(h+184, 8, buf);
+    if (plus)
+	edf_putstr(h+192, 44, og->edf == 2 ? "EDF+C" : "BDF+C");
+    else if (og->edf == 3)
+	edf_putstr(h+192, 44, "24BIT");
+    sprintf(buf, "%ld", nrec);
+    edf_putstr(h+236, 8, buf);
+    edf_putnum(h+244, 8, edf_recdur(og));
+    sprintf(buf, "%ld", ns);
+    edf_putstr(h+252, 4, buf);
+
+    /* Write the signal descriptions. */
+    n = 1L << (8*og->edf - 1);
+    for (s = i = 0; s < nosig; s++) {
+	if ((os = osd[s])->info.group != g)
+	    continue;
+	if (os->edfann) {
+	    dmin = -n;
+	    dmax = n - 1;
+	    pmin = -1.0;
+	    pmax = 1.0;
+	}
+	else {
+	    if (os->info.adcres > 0 && os->info.adcres < 8*og->edf) {
+		dmin = os->info.adczero - (1L << (os->info.adcres - 1));
+		dmax = os->info.adczero + (1L << (os->info.adcres - 1)) - 1;
+		if (dmin < -n) dmin = -n;
+		if (dmax > n - 1) dmax = n - 1;
+	    }
+	    else {
+		dmin = -n;
+		dmax = n - 1;
+	    }
+	    gain = (os->info.gain != 0.0) ? os->info.gain : WFDB_DEFGAIN;
+	    pmin = (dmin - os->info.baseline) / gain;
+	    pmax = (dmax - os->info.baseline) / gain;
+	}
+	p = h + 256;
+	edf_putstr(p + i*16, 16, os->edfann ? (og->edf == 2 ?
+		   "EDF Annotations" : "BDF Annotations") : os->info.desc);
+	p += ns*96;	/* skip transducer type */
+	if (!os->edfann)
+	    edf_putstr(p + i*8, 8, os->info.units ? os->info.units : "mV");
+	p += ns*8;
+	edf_putnum(p + i*8, 8, pmin);
+	p += ns*8;
+	edf_putnum(p + i*8, 8, pmax);
+	p += ns*8;
+	sprintf(buf, "%ld", dmin);
+	edf_putstr(p + i*8, 8, buf);
+	p += ns*8;
+	sprintf(buf, "%ld", dmax);
+	edf_putstr(p + i*8, 8, buf);
+	p += ns*88;	/* skip prefiltering */
+	sprintf(buf, "%u", edf_spr(og, os));
+	edf_putstr(p + i*8, 8, buf);
+	i++;
+    }
+
+    (void)wfdb_fwrite(h, 1, hlen, og->fp);
+    SFREE(h);
+    return (wfdb_ferror(og->fp) ? -1 : 0);
+}
+
+/* edf_osinit: choose the data record length for an EDF or BDF output file,
+   allocate the data record buffer, and write a provisional header.  A data
+   record lasts one second if the frame rate is an integer (or a tenth, a
+   hundredth, ... of a second, if necessary to keep the data record size
+   within the recommended limit), or one frame otherwise. */
+static int edf_osinit(struct ogdata *og, WFDB_Group g)
+{
+    long fbytes = 0, abytes = 0, reclen = 0;
+    struct osdata *os;
+    WFDB_Signal s;
+
+    og->edfnf = 1;
+    if (ffreq >= 1.0 && ffreq <= (double)UINT_MAX && ffreq == (long)ffreq)
+	og->edfnf = (unsigned)ffreq;
+    for (s = 0; s < nosig; s++)
+	if ((os = osd[s])->info.group == g) {
+	    if (os->edfann)
+		abytes += edf_spr(og, os) * og->edf;
+	    else
+		fbytes += os->info.spf * og->edf;
+	}
+    while (og->edfnf % 10 == 0 && og->edfnf * fbytes + abytes > EDF_RECMAX)
+	og->edfnf /= 10;
+
+    for (s = 0; s < nosig; s++)
+	if ((os = osd[s])->info.group == g) {
+	    os->edfoff = reclen;
+	    reclen += edf_spr(og, os) * og->edf;
+	}
+    SREALLOC(og->buf, reclen, 1);
+    if (og->buf == NULL)
+	return (-1);
+    memset(og->buf, 0, reclen);
+    og->bp = og->buf;
+    og->be = og->buf + reclen;
+    og->edfif = 0;
+    og->edfnrec = 0L;
+    return (edf_putheader(og, g, -1L));
+}
+
+/* edf_putsamp: store sample v as sample i of signal os in the current EDF
+   data record */
+static void edf_putsamp(struct ogdata *og, struct osdata *os, unsigned i,
+			WFDB_Sample v)
+{
+    char *p = og->buf + os->edfoff + i * og->edf;
+
+    p[0] = (char)v;
+    p[1] = (char)(v >> 8);
+    if (og->edf == 3)
+	p[2] = (char)(v >> 16);
+}
+
+/* edf_putrec: write the current data record of an EDF or BDF file */
+static int edf_putrec(struct ogdata *og, WFDB_Group g)
+{
+    char tal[32];
+    int first = 1;
+    size_t n;
+    struct osdata *os;
+    WFDB_Signal s;
+
+    /* Fill the annotation signals;  the first one begins with the record's
+       time-keeping annotation. */
+    for (s = 0; s < nosig; s++)
+	if ((os = osd[s])->info.group == g && os->edfann) {
+	    n = edf_spr(og, os) * og->edf;
+	    memset(og->buf + os->edfoff, 0, n);
+	    if (first) {
+		sprintf(tal, "+%.12g\024\024", og->edfnrec * edf_recdur(og));
+		memcpy(og->buf + os->edfoff, tal,
+		       strlen(tal) < n ? strlen(tal) : n - 1);
+		first = 0;
+	    }
+	}
+    (void)wfdb_fwrite(og->buf, 1, og->be - og->buf, og->fp);
+    og->edfnrec++;
+    og->edfif = 0;
+    return (wfdb_ferror(og->fp) ? -1 : 0);
+}
+
+/* edf_osclose: complete the last data record of an EDF or BDF file (padding
+   it with invalid samples), and rewrite the header with the final number of
+   data records */
+static int edf_osclose(struct ogdata *og, WFDB_Group g)
+{
+    struct osdata *os;
+    unsigned i;
+    WFDB_Signal s;
+    int stat = 0;
+
+    if (og->edfnf == 0 && edf_osinit(og, g) < 0)
+	return (-1);
+    if (og->edfif > 0) {
+	for (s = 0; s < nosig; s++)
+	    if ((os = osd[s])->info.group == g && !os->edfann)
+		for (i = og->edfif * os->info.spf; i < edf_spr(og, os); i++)
+		    edf_putsamp(og, os, i, -1 << (8*og->edf - 1));
+	stat = edf_putrec(og, g);
+    }
+    if (wfdb_fseek(og->fp, 0L, SEEK_SET) == 0 &&
+	edf_putheader(og, g, og->edfnrec) < 0)
+	stat = -1;
+    return (stat);
+}
+
 static void isigclose(void)
 {
     struct isdata *is;
@@ -2091,6 +2950,7 @@ static void isigclose(void)
 	SFREE(igd);
     }
     maxigroup = nigroup = 0;
+    edfblock = 0;
 
     istime = 0L;
     gvc = ispfmax = 1;
@@ -2111,8 +2971,13 @@ static int osigclose(void)
     int stat = 0, errflag;
 
     for (g = 0; g < nogroup; g++)
-	if (ogd && (og = ogd[g]))
+	if (ogd && (og = ogd[g])) {
 	    og->force_flush = 1;
+	    if (og->edf && og->fp && edf_osclose(og, g) < 0) {
+		wfdb_error("osigclose: write error in signal group %d\n", g);
+		stat = -4;
+	    }
+	}
 
     wfdb_osflush();
 
@@ -2190,16 +3055,53 @@ static int _l;		    /* macro temporary storage for low byte of word */
 static int _lw;		    /* macro temporary storage for low 16 bits of int */
 static int _n;		    /* macro temporary storage for byte count */
 
+/* igfill refills the input buffer for signal group g, reading at most n bytes,
+   and returns the number of bytes now available.  If the signal file is held
+   in memory (see wfdb_fmap), its contents are used in place of the buffer, so
+   that the samples are decoded where they are, without being copied.  This is
+   not done for groups that do not permit seeks, since isgsetframe locates the
+   samples of such groups by their positions within the buffer. */
+static int igfill(struct igdata *g, int n)
+{
+    const char *data;
+    long len;
+    WFDB_TRACE_FUNCTION("igfill");
+
+    len = g->seek ? wfdb_fmap(g->fp, &data, INT_MAX) : -1L;
+    if (len > 0) {
+	g->bp = (char *)data;
+	g->be = g->bp + len;
+	return ((int)len);
+    }
+    if (len < 0)
+	n = wfdb_fread(g->buf, 1, n, g->fp);
+    else
+	n = 0;
+    g->be = (g->bp = g->buf) + n;
+    return (n);
+}
+
 #define r8(G)	((G->bp < G->be) ? *(G->bp++) : \
 		  ((_n = (G->bsize > 0) ? G->bsize : ibsize), \
-		   (G->stat = _n = wfdb_fread(G->buf, 1, _n, G->fp)), \
-		   (G->be = (G->bp = G->buf) + _n),\
+		   (G->stat = _n = igfill(G, _n)), \
 		  *(G->bp++)))
 
+/* ogflush writes the n bytes in the output buffer for signal group g, which
+   is full, and resets the buffer pointer. */
+static size_t ogflush(struct ogdata *g, int n)
+{
+    size_t count;
+
+    WFDB_TRACE_BEGIN("putvec: write block");
+    count = wfdb_fwrite((g->bp = g->buf), 1, n, g->fp);
+    WFDB_TRACE_END("putvec: write block");
+    return (count);
+}
+
 #define w8(V,G)	(((*(G->bp++) = (char)V)), \
 		  (_l = (G->bp != G->be) ? 0 : \
 		   ((_n = (G->bsize > 0) ? G->bsize : obsize), \
-		    wfdb_fwrite((G->bp = G->buf), 1, _n, G->fp))))
+		    ogflush(G, _n))))
 
 /* If a short integer is not 16 bits, it may be necessary to redefine r16() and
 r61() in order to obtain proper sign extension. */
@@ -2461,6 +3363,7 @@ static int isgsetframe(WFDB_Group g, WFDB_Time t)
     if (nigroup < 2 && istime == t && gvc == ispfmax &&
 	igd[g]->start == 0)
 	return (0);
+    WFDB_COUNT(isgsetframe_seeks, 1);
 
     /* Find the first signal that belongs to group g. */
     for (s = 0; s < nisig && g != isd[s]->info.group; s++)
@@ -2486,11 +3389,15 @@ static int isgsetframe(WFDB_Group g, WFDB_Time t)
 	    tseg++;
 	if (segp != tseg) {
 	    segp = tseg;
+	    WFDB_COUNT(segment_switches, 1);
+	    WFDB_TRACE_BEGIN("segment change");
 	    if (isigopen(segp->recname, NULL, (int)nvsig) <= 0) {
+		WFDB_TRACE_END("segment change");
 	        wfdb_error("isigsettime: can't open segment %s\n",
 			   segp->recname);
 		return (-1);
 	    }
+	    WFDB_TRACE_END("segment change");
 	    /* Following isigopen(), nigroup may have changed and
 	       group numbers may not make any sense anymore.  However,
 	       isigsettime() will still call isgsettime() once for
@@ -2729,6 +3636,81 @@ static int isgsetframe(WFDB_Group g, WFDB_Time t)
    invalid sample */
 #define VFILL	((gvmode & WFDB_GVPAD) ? is->samp : WFDB_INVALID_SAMPLE)
 
+/* edf_getframe reads an input frame from an EDF or BDF file.  Each frame is
+   one EDF data record, in which all samples of each signal are contiguous, so
+   the entire record is copied from the input buffer at once and its samples
+   are converted in a single pass, rather than one at a time as by
+   getskewedframe.  This is possible only if the signals in the file form a
+   single open input signal group (as isigopen determines when setting
+   edfblock). */
+static int edf_getframe(WFDB_Sample *vector)
+{
+    int c, n, nb, bps, stat = nisig;
+    struct isdata *is;
+    struct igdata *ig = igd[0];
+    unsigned char *p;
+    WFDB_Sample *v, vmin;
+    WFDB_Signal s;
+
+    bps = (isd[0]->info.fmt == 24) ? 3 : 2;
+    if ((nb = framelen * bps) > edfbuflen) {
+	SREALLOC(edfbuf, nb, 1);
+	edfbuflen = nb;
+    }
+
+    /* Copy the data record from the input buffer, refilling it as needed. */
+    for (n = 0; n < nb; n += c) {
+	if (ig->bp >= ig->be) {
+	    c = (ig->bsize > 0) ? ig->bsize : ibsize;
+	    if ((ig->stat = c = igfill(ig, c)) <= 0) break;
+	}
+	if ((c = ig->be - ig->bp) > nb - n)
+	    c = nb - n;
+	memcpy(edfbuf + n, ig->bp, c);
+	ig->bp += c;
+    }
+    if (n < nb) {
+	/* End of file -- reset input counter. */
+	ig->stat = 0;
+	ig->count = 0;
+	for (s = 0; s < nisig; s++)
+	    if (isd[s]->info.nsamp > (WFDB_Time)0L) {
+		wfdb_error("getvec: unexpected EOF in signal %d\n", s);
+		return (-3);
+	    }
+	return (-1);
+    }
+
+    /* Convert the little-endian samples. */
+    p = edfbuf;
+    if (bps == 2) {
+	for (n = 0; n < framelen; n++, p += 2)
+	    vector[n] = ((p[0] | (p[1] << 8)) ^ 0x8000) - 0x8000;
+	vmin = -1 << 15;
+    }
+    else {
+	for (n = 0; n < framelen; n++, p += 3)
+	    vector[n] = ((p[0] | (p[1] << 8) | (p[2] << 16)) ^ 0x800000)
+		- 0x800000;
+	vmin = -1 << 23;
+    }
+
+    /* Replace invalid samples and record the most recent valid sample of
+       each signal. */
+    for (s = 0, v = vector; s < nisig; s++) {
+	is = isd[s];
+	for (c = 0; c < is->info.spf; c++, v++) {
+	    if (*v == vmin)
+		*v = VFILL;
+	    else
+		is->samp = *v;
+	}
+	if (is->info.nsamp >= 0)
+	    --is->info.nsamp;
+    }
+    return (stat);
+}
+
 static int getskewedframe(WFDB_Sample *vector)
 {
     int c, stat;
@@ -2750,9 +3732,12 @@ static int getskewedframe(WFDB_Sample *vector)
 	    isgsetframe(g, (in_msrec ? segp->samp0 : 0));
     }
 
+    if (edfblock)
+	return (edf_getframe(vector));
+
     /* If the vector needs to be rearranged (variable-layout record),
        then read samples into a temporary buffer. */
-    if (need_sigmap)
+    if (need_sigmap && !sigmap_direct)
 	vector = ovec;
 
     for (s = 0; s < nisig; s++) {
@@ -2865,13 +3850,17 @@ static int getskewedframe(WFDB_Sample *vector)
 		}
 		else if (in_msrec && segp && segp < segend) {
 		    segp++;
+		    WFDB_COUNT(segment_switches, 1);
+		    WFDB_TRACE_BEGIN("segment change");
 		    if (isigopen(segp->recname, NULL, (int)nvsig) <= 0) {
+			WFDB_TRACE_END("segment change");
 			wfdb_error("getvec: error opening segment %s\n",
 				   segp->recname);
 			stat = -3;
 			return (stat);  /* avoid looping if segment is bad */
 		    }
 		    else {
+			WFDB_TRACE_END("segment change");
 			istime = segp->samp0;
 			return (getskewedframe(vecstart));
 		    }
@@ -2890,7 +3879,7 @@ static int getskewedframe(WFDB_Sample *vector)
 	}
     }
 
-    if (need_sigmap)
+    if (need_sigmap && !sigmap_direct)
 	sigmap(vecstart, ovec);
     else if (framelen != tspf)
 	for (s = framelen; s < tspf; s++)
@@ -3007,6 +3996,7 @@ FINT isigopen(char *record, WFDB_Siginfo *siarray, int nsig)
     struct igdata *ig;
     WFDB_Signal s, si, sj;
     WFDB_Group g;
+    WFDB_TRACE_FUNCTION("isigopen");
 
     /* Close previously opened input signals unless otherwise requested. */
     if (*record == '+') record++;
@@ -3176,6 +4166,11 @@ FINT isigopen(char *record, WFDB_Siginfo *siarray, int nsig)
     for (si = framelen = 0; si < nisig; si++)
 	framelen += isd[si]->info.spf;
 
+    /* Read EDF and BDF data records by blocks if the file is the only open
+       input signal group. */
+    edfblock = (isedf && !in_msrec && nigroup == 1 &&
+		(isd[0]->info.fmt == 16 || isd[0]->info.fmt == 24));
+
     /* Allocate workspace for getvec, isgsettime, and tnextvec. */
     if (tspf > tuvlen) {
 	SALLOC(tvector, tspf, sizeof(WFDB_Sample));
@@ -3232,6 +4227,9 @@ static int openosig(const char *func, WFDB_Siginfo *si_out,
 	os->info.cksum = 0;
 	os->info.nsamp = (WFDB_Time)0L;
 	os->info.group += ga;
+	os->edfann = (os->info.desc &&
+		      (strcmp(os->info.desc, "EDF Annotations") == 0 ||
+		       strcmp(os->info.desc, "BDF Annotations") == 0));
 	if (si_out) {
 	    copysi(si_out, &os->info);
 	    si_out++;
@@ -3268,6 +4266,12 @@ static int openosig(const char *func, WFDB_Siginfo *si_out,
 		else
 		    os->info.fmt = 16;
 	    }
+	    /* Signals written to a .edf or .bdf file are stored by EDF data
+	       records rather than by frames. */
+	    if (og->edf = edf_osfmt(os->info.fmt, os->info.fname))
+		og->bsize = 0;
+	    og->edfnf = og->edfif = 0;
+	    og->edfnrec = 0L;
 	    if (os->info.fmt != 0) {
 		/* An error in opening an output file is fatal. */
 		og->fp = wfdb_open(os->info.fname,(char *)NULL, WFDB_WRITE);
@@ -3439,7 +4443,7 @@ FVOID setgvmode(int mode)
 	    mode = DEFWFDBGVMODE;
     }
 
-    gvmode = mode & (WFDB_HIGHRES | WFDB_GVPAD);
+    gvmode = mode & (WFDB_HIGHRES | WFDB_GVPAD | WFDB_GVCOMPACT);
 
     if ((mode & WFDB_HIGHRES) == WFDB_HIGHRES) {
 	if (spfmax == 0) spfmax = 1;
@@ -3585,6 +4589,13 @@ FINT putvec(const WFDB_Sample *vector)
     WFDB_Group g;
     WFDB_Sample samp;
 
+    /* Set up any EDF or BDF output files before writing the first frame. */
+    for (g = 0; g < nogroup; g++)
+	if ((og = ogd[g])->edf && og->edfnf == 0 && edf_osinit(og, g) < 0) {
+	    wfdb_error("putvec: write error in signal group %d\n", g);
+	    return (-1);
+	}
+
     for (s = 0; s < nosig; s++) {
 	os = osd[s];
 	g = os->info.group;
@@ -3617,7 +4628,12 @@ FINT putvec(const WFDB_Sample *vector)
 		  case 32:
 		    samp = -1 << 31; break;
 		}
-	    switch (os->info.fmt) {
+	    if (og->edf) {	/* EDF or BDF data record */
+		if (!os->edfann)
+		    edf_putsamp(og, os, og->edfif * os->info.spf + c, samp);
+		os->samp = samp;
+	    }
+	    else switch (os->info.fmt) {
 	      case 0:	/* null signal (do not write) */
 		os->samp = samp; break;
 	      case 8:	/* 8-bit first differences */
@@ -3663,10 +4679,113 @@ FINT putvec(const WFDB_Sample *vector)
 		os->info.cksum += os->samp;
 	}
     }
+    for (g = 0; g < nogroup; g++)
+	if ((og = ogd[g])->edf && ++og->edfif == og->edfnf &&
+	    edf_putrec(og, g) < 0) {
+	    wfdb_error("putvec: write error in signal group %d\n", g);
+	    stat = -1;
+	}
     ostime++;
     return (stat);
 }
 
+/* The bulk I/O functions below transfer nvec consecutive vectors, stored
+contiguously in the caller's array.  getvecs and getvecs16 return the number
+of vectors read (fewer than nvec only at the end of the input), or the getvec
+error code if none could be read.  putvecs and putvecs16 return the number of
+vectors written, or -1 if a write error occurred.
+
+getvecs16 and putvecs16 use WFDB_Sample16 arrays, which need half the memory
+of WFDB_Sample arrays.  This is sufficient for signals in 8-, 10-, 12-, and
+16-bit formats.  Samples read by getvecs16 that do not fit in 16 bits are
+clamped to -32767 or 32767 (WFDB_INVALID_SAMPLE is reserved for invalid
+samples), and the number of samples clamped is reported via wfdb_error. */
+
+/* getvec16: read an input vector, store it as 16-bit samples, and add the
+   number of samples that were clamped to *nsat */
+static int getvec16(WFDB_Sample16 *vector, long *nsat)
+{
+    int i, n = (nvsig > nisig) ? nvsig : nisig, stat;
+    WFDB_Sample v;
+
+    if (n > v16len) {
+	SREALLOC(v16buf, n, sizeof(WFDB_Sample));
+	if (v16buf == NULL)
+	    return (-3);
+	v16len = n;
+    }
+    if ((stat = getvec(v16buf)) > 0)
+	for (i = 0; i < stat; i++) {
+	    if ((v = v16buf[i]) > 32767) {
+		v = 32767;
+		(*nsat)++;
+	    }
+	    else if (v < -32767 && v != WFDB_INVALID_SAMPLE) {
+		v = -32767;
+		(*nsat)++;
+	    }
+	    vector[i] = (WFDB_Sample16)v;
+	}
+    return (stat);
+}
+
+FINT getvecs(WFDB_Sample *vector, int nvec)
+{
+    int i, stat = 0;
+
+    for (i = 0; i < nvec && (stat = getvec(vector)) > 0; i++)
+	vector += stat;
+    return (i > 0 ? i : stat);
+}
+
+FINT getvecs16(WFDB_Sample16 *vector, int nvec)
+{
+    int i, stat = 0;
+    long nsat = 0L;
+
+    for (i = 0; i < nvec && (stat = getvec16(vector, &nsat)) > 0; i++)
+	vector += stat;
+    if (nsat > 0L)
+	wfdb_error("getvecs16: %ld sample%s out of 16-bit range (clamped)\n",
+		   nsat, nsat == 1L ? "" : "s");
+    return (i > 0 ? i : stat);
+}
+
+FINT putvecs(const WFDB_Sample *vector, int nvec)
+{
+    int i, n;
+    WFDB_Signal s;
+
+    for (s = n = 0; s < nosig; s++)
+	n += osd[s]->info.spf;
+    for (i = 0; i < nvec; i++, vector += n)
+	if (putvec(vector) < 0)
+	    return (-1);
+    return (i);
+}
+
+FINT putvecs16(const WFDB_Sample16 *vector, int nvec)
+{
+    int i, j, n;
+    WFDB_Signal s;
+
+    for (s = n = 0; s < nosig; s++)
+	n += osd[s]->info.spf;
+    if (n > v16len) {
+	SREALLOC(v16buf, n, sizeof(WFDB_Sample));
+	if (v16buf == NULL)
+	    return (-1);
+	v16len = n;
+    }
+    for (i = 0; i < nvec; i++) {
+	for (j = 0; j < n; j++)
+	    v16buf[j] = *vector++;
+	if (putvec(v16buf) < 0)
+	    return (-1);
+    }
+    return (i);
+}
+
 FINT isigsettime(WFDB_Time t)
 {
     WFDB_Group g;
@@ -3868,6 +4987,17 @@ FINT setheader(char *record, const WFDB_Siginfo *siarray, unsigned int nsig)
     if (wfdb_checkname(record, "record"))
 	return (-1);
 
+    /* Quit if any signal is written to an EDF or BDF file, since a WFDB
+       header cannot describe its layout (see edf_osfmt). */
+    for (s = 0; s < nsig; s++)
+	if (edf_osfmt(siarray[s].fmt, siarray[s].fname)) {
+	    wfdb_error("newheader: signal file %s is in EDF or BDF format\n",
+		       siarray[s].fname);
+	    wfdb_error(" (use %s as the record name to read it)\n",
+		       siarray[s].fname);
+	    return (-1);
+	}
+
     /* Try to create the header file. */
     if ((oheader = wfdb_open("hea", record, WFDB_WRITE)) == NULL) {
 	wfdb_error("newheader: can't create header for record %s\n", record);
@@ -4604,7 +5734,9 @@ sample_vflag is true (non-zero) if the requested sample is not beyond the end
 of the record, false (zero) otherwise.  The caller must open the input signals
 and must set the global variable nisig to the number of input signals before
 invoking sample().  Once this has been done, the caller may request samples in
-any order. */
+any order.  In WFDB_GVCOMPACT mode (see setgvmode), the buffer holds 16-bit
+samples;  samples that do not fit are clamped as by getvecs16, and this is
+reported (once) via wfdb_error. */
 
 #define BUFLN   4096	/* must be a power of 2, see sample() */
 
@@ -4612,11 +5744,22 @@ FSAMPLE sample(WFDB_Signal s, WFDB_Time t)
 {
     static WFDB_Sample v;
     static WFDB_Time tt;
-    int nsig = (nvsig > nisig) ? nvsig : nisig;
-
-    /* Allocate the sample buffer on the first call. */
-    if (sbuf == NULL) {
-	SALLOC(sbuf, nsig, BUFLN*sizeof(WFDB_Sample));
+    int nsig = (nvsig > nisig) ? nvsig : nisig, stat;
+    int compact = (gvmode & WFDB_GVCOMPACT) != 0;
+    long nsat = 0L;
+
+    /* Allocate the sample buffer on the first call.  If the caller has
+       switched to or from WFDB_GVCOMPACT mode since the previous call,
+       discard the buffer contents and start again from sample 0. */
+    if (compact ? (sbuf16 == NULL) : (sbuf == NULL)) {
+	if (sbuf || sbuf16)
+	    (void)isigsettime(0L);
+	SFREE(sbuf);
+	SFREE(sbuf16);
+	if (compact)
+	    SALLOC(sbuf16, nsig, BUFLN*sizeof(WFDB_Sample16));
+	else
+	    SALLOC(sbuf, nsig, BUFLN*sizeof(WFDB_Sample));
 	tt = (WFDB_Time)-1L;
     }
 
@@ -4650,16 +5793,34 @@ FSAMPLE sample(WFDB_Signal s, WFDB_Time t)
     /* If the requested sample is not yet in the buffer, read and buffer
        more samples.  If we reach the end of the record, clear sample_vflag
        and return the last valid value. */
-    while (t > tt)
-        if (getvec(sbuf + nsig * ((++tt)&(BUFLN-1))) < 0) {
+    if (t > tt)
+	WFDB_COUNT(sample_refills, 1);
+    while (t > tt) {
+	++tt;
+	if (compact)
+	    stat = getvec16(sbuf16 + nsig * (tt&(BUFLN-1)), &nsat);
+	else
+	    stat = getvec(sbuf + nsig * (tt&(BUFLN-1)));
+        if (stat < 0) {
 	    --tt;
 	    sample_vflag = 0;
+	    if (compact)
+		return (*(sbuf16 + nsig * (tt&(BUFLN-1)) + s));
 	    return (*(sbuf + nsig * (tt&(BUFLN-1)) + s));
 	}
+    }
+    if (nsat > 0L && !sample_clamped) {
+	wfdb_error("sample: input samples out of 16-bit range (clamped)\n");
+	sample_clamped = 1;
+    }
 
     /* The requested sample is in the buffer.  Set sample_vflag and
        return the requested sample. */
-    if ((v = *(sbuf + nsig * (t&(BUFLN-1)) + s)) == WFDB_INVALID_SAMPLE)
+    if (compact)
+	v = *(sbuf16 + nsig * (t&(BUFLN-1)) + s);
+    else
+	v = *(sbuf + nsig * (t&(BUFLN-1)) + s);
+    if (v == WFDB_INVALID_SAMPLE)
         sample_vflag = -1;
     else
         sample_vflag = 1;
@@ -4675,9 +5836,10 @@ FINT sample_valid(void)
 
 void wfdb_sampquit(void)
 {
-    if (sbuf) {
+    if (sbuf || sbuf16) {
 	SFREE(sbuf);
-	sample_vflag = 0;
+	SFREE(sbuf16);
+	sample_vflag = sample_clamped = 0;
     }
 }
 
@@ -4711,6 +5873,13 @@ void wfdb_sigclose(void)
     SFREE(uvector);
     SFREE(vvector);
     tuvlen = 0;
+    hec_free();
+    SFREE(hecname);
+    SFREE(rinfo.btstr);
+    SFREE(edfbuf);
+    edfbuflen = 0;
+    SFREE(v16buf);
+    v16len = 0;
 
     sigmap_cleanup();
 }
@@ -4721,6 +5890,7 @@ void wfdb_osflush(void)
     WFDB_Signal s;
     struct ogdata *og;
     struct osdata *os;
+    WFDB_TRACE_FUNCTION("wfdb_osflush");
 
     if (!osd || !ogd)
 	return;
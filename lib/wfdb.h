@@ -69,6 +69,7 @@ _______________________________________________________________________________
 
 /* Simple data types */
 typedef int	     WFDB_Sample;   /* units are adus */
+typedef short	     WFDB_Sample16; /* compact sample (see getvecs16) */
 typedef long	     WFDB_Date;	    /* units are days */
 typedef double	     WFDB_Frequency;/* units are Hz (samples/second/signal) */
 typedef double	     WFDB_Gain;	    /* units are adus per physical unit */
@@ -135,6 +136,12 @@ typedef long long    WFDB_Time;
 # define strtim       wfdb_strtim_LL
 # define sample       wfdb_sample_LL
 # define getann       wfdb_getann_LL
+# define getanns      wfdb_getanns_LL
+# define wfdb_getanntab wfdb_getanntab_LL
+# define wfdb_anntabfind wfdb_anntabfind_LL
+# define wfdb_anntabindex wfdb_anntabindex_LL
+# define wfdb_anntabrange wfdb_anntabrange_LL
+# define wfdb_getmergedann wfdb_getmergedann_LL
 # define ungetann     wfdb_ungetann_LL
 # define putann       wfdb_putann_LL
 # define getseginfo   wfdb_getseginfo_LL
@@ -222,6 +229,8 @@ typedef long long    WFDB_Time;
 #define WFDB_AHA_READ  2   /* AHA-format input annotation file */
 #define WFDB_AHA_WRITE 3   /* AHA-format output annotation file */
 #define WFDB_APPEND    4   /* for output info files */
+#define WFDB_COMPACT_READ  5 /* compact-format input annotation file */
+#define WFDB_COMPACT_WRITE 6 /* compact-format output annotation file */
 
 /* WFDB_siginfo '.fmt' values
 FMT_LIST is suitable as an initializer for a static array; it lists all of
@@ -257,6 +266,14 @@ the legal values for the format field in a WFDB_siginfo structure.
 				   duplicating samples of other signals */
 #define WFDB_GVPAD	2	/* replace invalid samples with previous valid
 				   samples */
+#define WFDB_GVCOMPACT	4	/* buffer samples for sample() as 16-bit
+				   values, clamping any that don't fit */
+
+/* wfdb_setauxmode modes */
+#define WFDB_AUX_RING	0	/* aux strings are valid until a few more
+				   annotations have been read (default) */
+#define WFDB_AUX_STABLE	1	/* aux strings are valid until the annotator
+				   is closed */
 
 /* calinfo '.caltype' values
 WFDB_AC_COUPLED and WFDB_DC_COUPLED are used in combination with the pulse
@@ -316,12 +333,72 @@ struct WFDB_seginfo {	/* segment record structure */
     WFDB_Time samp0;		   /* sample number of first sample */
 };
 
+struct WFDB_backend {	/* I/O backend (see wfdb_register_backend) */
+    void *(*open)(void *context, const char *name, const char *mode);
+			/* open the named file, return a handle or NULL */
+    long (*read)(void *file, void *buffer, long nbytes);
+			/* read up to nbytes, return number read or -1 */
+    int (*seek)(void *file, long offset);
+			/* move to offset from start of file, return 0 or -1 */
+    long (*tell)(void *file);	/* return current offset, or -1 */
+    long (*size)(void *file);	/* return length of file, or -1 */
+    const void *(*map)(void *file, long *size);
+			/* (optional) return a pointer to the entire contents
+			   of the file, and set *size to its length, or return
+			   NULL if the file cannot be mapped */
+    long (*write)(void *file, const void *buffer, long nbytes);
+			/* (optional) write nbytes, return number written */
+    int (*close)(void *file);	/* close the file, return 0 or EOF */
+    void *context;	/* passed to open */
+};
+
+struct WFDB_stats {	/* library statistics (see wfdb_getstats) */
+    unsigned long bytes_read[4];    /* bytes read from local [0], remote [1],
+				       compressed [2], and backend [3] files */
+    unsigned long bytes_written[4]; /* bytes written, indexed as above */
+    unsigned long freads;	    /* wfdb_fread calls */
+    unsigned long fseeks;	    /* wfdb_fseek calls */
+    unsigned long http_requests;    /* HTTP (or other remote) requests */
+    unsigned long http_bytes;	    /* bytes received in response to these */
+    unsigned long page_hits;	    /* remote file pages found in the cache */
+    unsigned long page_misses;	    /* remote file pages not in the cache */
+    unsigned long sample_refills;   /* sample() buffer refills */
+    unsigned long isgsetframe_seeks; /* seeks within input signal groups */
+    unsigned long segment_switches; /* multi-segment record segment changes */
+    unsigned long headers_parsed;   /* header files read */
+};
+
+struct WFDB_anntab {	/* columnar annotation table (see wfdb_getanntab) */
+    long n;		/* number of annotations */
+    WFDB_Time *time;	/* time[i] is the time of annotation i */
+    char *anntyp;	/* anntyp[i] is its type, and so on */
+    signed char *subtyp;
+    unsigned char *chan;
+    signed char *num;
+    long *auxoff;	/* aux + auxoff[i] is the aux string of annotation i
+			   (a length byte, followed by the data and a null),
+			   or auxoff[i] is -1 if it has none */
+    unsigned char *aux;	/* aux strings of all annotations */
+    long auxlen;	/* total length of aux strings */
+};
+
+struct WFDB_anntabidx {	/* annotation type index (see wfdb_anntabindex) */
+    long start[257];	/* pos[start[k]] ... pos[start[k+1]-1] are the
+			   positions of annotations of type k in the table */
+    long *pos;		/* positions of annotations, grouped by type */
+    WFDB_Time *time;	/* time[i] is the time of annotation pos[i] */
+};
+
 /* Composite data types */
 typedef struct WFDB_siginfo WFDB_Siginfo;
 typedef struct WFDB_calinfo WFDB_Calinfo;
 typedef struct WFDB_anninfo WFDB_Anninfo;
 typedef struct WFDB_ann WFDB_Annotation;
 typedef struct WFDB_seginfo WFDB_Seginfo;
+typedef struct WFDB_backend WFDB_Backend;
+typedef struct WFDB_stats WFDB_Stats;
+typedef struct WFDB_anntab WFDB_Anntab;
+typedef struct WFDB_anntabidx WFDB_Anntabidx;
 
 /* Dynamic memory allocation macros. */
 #define MEMERR(P, N, S)                                                 \
@@ -425,7 +502,22 @@ extern FFREQUENCY getifreq(void);
 extern FINT getvec(WFDB_Sample *vector);
 extern FINT getframe(WFDB_Sample *vector);
 extern FINT putvec(const WFDB_Sample *vector);
+extern FINT getvecs(WFDB_Sample *vector, int nvec);
+extern FINT getvecs16(WFDB_Sample16 *vector, int nvec);
+extern FINT putvecs(const WFDB_Sample *vector, int nvec);
+extern FINT putvecs16(const WFDB_Sample16 *vector, int nvec);
 extern FINT getann(WFDB_Annotator a, WFDB_Annotation *annot);
+extern FINT getanns(WFDB_Annotator a, WFDB_Annotation *annot, int max);
+extern FLONGINT wfdb_getanntab(WFDB_Annotator a, WFDB_Anntab *tab);
+extern FLONGINT wfdb_anntabfind(const WFDB_Anntab *tab, WFDB_Time t);
+extern FVOID wfdb_freeanntab(WFDB_Anntab *tab);
+extern FINT wfdb_anntabindex(const WFDB_Anntab *tab, WFDB_Anntabidx *idx);
+extern FLONGINT wfdb_anntabrange(const WFDB_Anntabidx *idx, int type,
+				 WFDB_Time t0, WFDB_Time t1, const long **pos);
+extern FVOID wfdb_freeanntabidx(WFDB_Anntabidx *idx);
+extern FINT wfdb_annmerge(const WFDB_Annotator *alist, unsigned int n);
+extern FINT wfdb_getmergedann(WFDB_Annotator *a, WFDB_Annotation *annot);
+extern FINT wfdb_setauxmode(WFDB_Annotator a, int mode);
 extern FINT ungetann(WFDB_Annotator a, const WFDB_Annotation *annot);
 extern FINT putann(WFDB_Annotator a, const WFDB_Annotation *annot);
 extern FINT isigsettime(WFDB_Time t);
@@ -512,6 +604,11 @@ extern FINT setobsize(int output_buffer_size);
 extern FSTRING wfdbfile(const char *file_type, char *record);
 extern FVOID wfdbflush(void);
 extern FVOID wfdbmemerr(int exit_on_error);
+extern FINT wfdb_register_backend(const char *scheme,
+				  const WFDB_Backend *backend);
+extern FINT wfdb_memfile(const char *name, const void *data, long size);
+extern FINT wfdb_getstats(WFDB_Stats *stats);
+extern FINT wfdb_trace_export(const char *file);
 #if __GNUC__ >= 3
 __attribute__((__format__(__printf__, 1, 2)))
 #endif
@@ -530,7 +627,8 @@ extern FCONSTSTRING wfdbdefwfdbcal(void);
 
 #ifdef wfdb_KRC	/* declare only function return types for K&R C compilers */
 extern FINT annopen(), isigopen(), osigopen(), wfdbinit(), findsig(), getspf(),
-    setifreq(), getvec(), getframe(), getgvmode(), putvec(), getann(),
+    setifreq(), getvec(), getframe(), getgvmode(), putvec(), getvecs(),
+    getvecs16(), putvecs(), putvecs16(), getann(), getanns(),
     ungetann(), putann(), isigsettime(), isgsettime(), iannsettime(), strecg(),
     setecgstr(), strann(), setannstr(), setanndesc(), wfdb_isann(),
     wfdb_isqrs(), wfdb_setisqrs(), wfdb_map1(), wfdb_setmap1(), wfdb_map2(),
@@ -538,8 +636,11 @@ extern FINT annopen(), isigopen(), osigopen(), wfdbinit(), findsig(), getspf(),
     adumuv(), newheader(), setheader(), setmsheader(), getseginfo(),
     wfdbputprolog(), setsampfreq(), setbasetime(), putinfo(), setinfo(),
     setibsize(), setobsize(), calopen(), getcal(), putcal(), newcal(),
-    wfdbgetskew(), sample_valid(), wfdb_me_fatal();
-extern FLONGINT wfdbgetstart();
+    wfdbgetskew(), sample_valid(), wfdb_me_fatal(), wfdb_register_backend(),
+    wfdb_memfile(), wfdb_getstats(), wfdb_trace_export(), wfdb_annmerge(),
+    wfdb_getmergedann(), wfdb_setauxmode(), wfdb_anntabindex();
+extern FLONGINT wfdbgetstart(), wfdb_getanntab(), wfdb_anntabfind(),
+    wfdb_anntabrange();
 extern FSAMPLE muvadu(), physadu(), sample();
 extern FSTRING ecgstr(), annstr(), anndesc(), timstr(), mstimstr(),
     datstr(), getwfdb(), getinfo(), wfdberror(), wfdbfile();
@@ -548,7 +649,7 @@ extern FDATE strdat();
 extern FVOID setafreq(), setgvmode(), wfdb_freeinfo(), wfdbquit(), wfdbquiet(),
     wfdbverbose(), setdb(), wfdbflush(), setcfreq(), setbasecount(), flushcal(),
     wfdbsetiskew(), wfdbsetskew(), wfdbsetstart(), wfdbmemerr(), wfdb_error(),
-    setiafreq();
+    setiafreq(), wfdb_freeanntab(), wfdb_freeanntabidx();
 extern FFREQUENCY getafreq(), getifreq(), sampfreq(), getcfreq(), getiafreq(),
     getiaorigfreq();
 extern FDOUBLE aduphys(), getbasecount();
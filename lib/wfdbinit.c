@@ -49,6 +49,8 @@ FVOID wfdbquit(void)
     resetwfdb();	/* restore the WFDB path */
     wfdb_sampquit();	/* release sample data buffer */
     wfdb_freeinfo();	/* release info strings */
+    wfdb_printstats();	/* print library statistics, if requested */
+    wfdb_trace_export(NULL);	/* write trace events, if requested */
 }
 
 FVOID wfdbflush(void)	/* write all buffered output to files */
@@ -38,6 +38,10 @@ This file contains definitions of the following WFDB library functions:
  wfdberror [4.5]	(returns the most recent WFDB library error message)
  wfdbfile [4.3]		(returns the complete pathname of a WFDB file)
  wfdbmemerr [10.4.6]    (set behavior on memory errors)
+ wfdb_getstats [10.7.1]	(returns library I/O statistics)
+ wfdb_trace_export [10.7.1] (writes traced spans to a Chrome trace file)
+ wfdb_register_backend [10.7.1] (supplies I/O functions for a URL scheme)
+ wfdb_memfile [10.7.1]	(makes a block of memory readable as a file)
 
 These functions expose config strings needed by the WFDB Toolkit for Matlab:
  wfdbversion [10.4.20]  (return the string defined by VERSION)
@@ -50,6 +54,11 @@ These functions, also defined here, are intended only for the use of WFDB
 library functions defined elsewhere:
 
  wfdb_me_fatal [10.4.6] (indicates if memory errors are fatal)
+ wfdb_printstats [10.7.1] (prints library statistics, if requested)
+ wfdb_trace_begin [10.7.1] (records the beginning of a traced span)
+ wfdb_trace_end [10.7.1] (records the end of a traced span)
+ wfdb_trace_enter [10.7.1] (begins a span that ends when a function returns)
+ wfdb_trace_leave [10.7.1] (ends a span begun by wfdb_trace_enter)
  wfdb_g16		(reads a 16-bit integer)
  wfdb_g32		(reads a 32-bit integer)
  wfdb_p16		(writes a 16-bit integer)
@@ -67,6 +76,7 @@ library functions defined elsewhere:
  wfdb_open		(finds and opens database files)
  wfdb_checkname		(checks record and annotator names for validity)
  wfdb_striphea [10.4.5] (removes trailing '.hea' from a record name, if present)
+ wfdb_fileval [10.7.1]	(computes a validator for a local file)
  wfdb_setirec [9.7]	(saves current record name)
  wfdb_getirec [10.5.12]	(gets current record name)
 
@@ -121,6 +131,7 @@ files. Unlike other private functions in the WFDB library, the interfaces to
 these are not likely to change, since they are designed to emulate the
 similarly-named ANSI/ISO C standard I/O functions:
  wfdb_clearerr		(emulates clearerr)
+ wfdb_fmap [10.7.1]	(gets the unread contents of an in-memory file)
  wfdb_feof		(emulates feof)
  wfdb_ferror		(emulates ferror)
  wfdb_fflush		(emulates fflush, for local files only)
@@ -158,6 +169,7 @@ module.
 
 #include "wfdblib.h"
 #include <time.h>
+#include <sys/stat.h>
 
 /* WFDB library functions */
 
@@ -261,6 +273,179 @@ FVOID wfdbmemerr(int behavior)
     wfdb_mem_behavior = behavior;
 }
 
+/* The WFDB library keeps count of its I/O operations (bytes read and written,
+wfdb_fread and wfdb_fseek calls, remote file requests and cache hits) and of
+some of the more expensive operations on input signals (sample buffer refills,
+seeks, segment changes, and headers read), if the environment variable
+WFDB_STATS is set to a value other than "0" when the first WFDB file is
+opened, or once wfdb_getstats(NULL) has been called.  The counters are updated
+by the WFDB_COUNT macro (defined in wfdblib.h);  when counting is disabled,
+this costs only a test of wfdb_stats_on.
+
+wfdb_getstats copies the current counts into *stats and returns 1 if counting
+is enabled, or 0 otherwise.  If stats is NULL, wfdb_getstats resets the
+counts to zero and enables counting.  If counting was enabled by WFDB_STATS,
+the counts are printed on the standard error output by wfdbquit. */
+
+#ifndef WFDB_NO_STATS
+int wfdb_stats_on = -1;	/* 1: counting enabled, 0: disabled, -1: not yet
+			   determined */
+WFDB_Stats wfdb_stats;
+static int wfdb_stats_print;	/* if non-zero, wfdbquit prints the counts */
+
+static void wfdb_stats_init(void)
+{
+    char *p;
+
+    if (wfdb_stats_on < 0) {
+	wfdb_stats_print = ((p = getenv("WFDB_STATS")) && *p && strcmp(p,"0"));
+	wfdb_stats_on = wfdb_stats_print;
+    }
+}
+#else
+# define wfdb_stats_init()	((void) 0)
+#endif
+
+FINT wfdb_getstats(WFDB_Stats *stats)
+{
+#ifndef WFDB_NO_STATS
+    if (stats == NULL) {
+	memset(&wfdb_stats, 0, sizeof(wfdb_stats));
+	wfdb_stats_on = 1;
+	return (1);
+    }
+    wfdb_stats_init();
+    *stats = wfdb_stats;
+    return (wfdb_stats_on);
+#else
+    if (stats)
+	memset(stats, 0, sizeof(WFDB_Stats));
+    return (0);
+#endif
+}
+
+/* If the library was compiled with WFDB_TRACE defined, the spans marked by the
+WFDB_TRACE_* macros (see wfdblib.h) are recorded in a ring buffer belonging to
+the thread in which they occur.  Only that thread writes to its buffer, so no
+locking is needed;  a buffer is added to the list of buffers (using an atomic
+compare-and-swap) the first time its thread records an event.
+
+wfdb_trace_export writes the recorded events to the named file in the Chrome
+trace event format (JSON), which can be viewed using chrome://tracing,
+Perfetto, or other timeline viewers.  It returns the number of events written,
+or -1 if the file can't be written or if tracing was not compiled in.  If file
+is NULL, the events are written to the file named by the environment variable
+WFDB_TRACEFILE, if it is set (wfdbquit does this).  wfdb_trace_export should be
+called while no other thread is using the library. */
+
+#ifdef WFDB_TRACE
+struct trace_event {
+    const char *name;	/* name of span (a string constant) */
+    long long ts;	/* time of event, in nanoseconds */
+    char ph;		/* 'B' (begin) or 'E' (end) */
+};
+
+static struct trace_ring {
+    struct trace_event ev[WFDB_TRACE_EVENTS];
+    unsigned long n;		/* number of events recorded */
+    int tid;			/* thread number */
+    struct trace_ring *next;
+} *trace_rings;
+static __thread struct trace_ring *trace_ring;
+static int trace_nthreads;
+
+static void trace_event(const char *name, char ph)
+{
+    struct trace_ring *r;
+    struct trace_event *e;
+    struct timespec t;
+
+    if ((r = trace_ring) == NULL) {
+	if ((r = calloc(1, sizeof(struct trace_ring))) == NULL)
+	    return;
+	r->tid = __sync_add_and_fetch(&trace_nthreads, 1);
+	do {
+	    r->next = trace_rings;
+	} while (!__sync_bool_compare_and_swap(&trace_rings, r->next, r));
+	trace_ring = r;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    e = &r->ev[r->n++ & (WFDB_TRACE_EVENTS-1)];
+    e->name = name;
+    e->ts = t.tv_sec * 1000000000LL + t.tv_nsec;
+    e->ph = ph;
+}
+
+void wfdb_trace_begin(const char *name)
+{
+    trace_event(name, 'B');
+}
+
+void wfdb_trace_end(const char *name)
+{
+    trace_event(name, 'E');
+}
+
+struct wfdb_trace_span wfdb_trace_enter(const char *name)
+{
+    struct wfdb_trace_span span;
+
+    trace_event(span.name = name, 'B');
+    return (span);
+}
+
+void wfdb_trace_leave(struct wfdb_trace_span *span)
+{
+    trace_event(span->name, 'E');
+}
+#endif
+
+FINT wfdb_trace_export(const char *file)
+{
+#ifdef WFDB_TRACE
+    struct trace_ring *r;
+    struct trace_event *e;
+    unsigned long i;
+    int depth, n = 0;
+    FILE *ofile;
+
+    if (file == NULL && ((file = getenv("WFDB_TRACEFILE")) == NULL ||
+			 *file == '\0'))
+	return (0);
+    if ((ofile = fopen(file, "w")) == NULL) {
+	wfdb_error("wfdb_trace_export: can't write %s\n", file);
+	return (-1);
+    }
+    fprintf(ofile, "{\"traceEvents\":[");
+    for (r = trace_rings; r; r = r->next) {
+	i = (r->n > WFDB_TRACE_EVENTS) ? r->n - WFDB_TRACE_EVENTS : 0;
+	for (depth = 0; i < r->n; i++) {
+	    e = &r->ev[i & (WFDB_TRACE_EVENTS-1)];
+	    /* Skip the ends of spans whose beginnings have been overwritten. */
+	    if (e->ph == 'E' && depth == 0)
+		continue;
+	    depth += (e->ph == 'B') ? 1 : -1;
+	    fprintf(ofile, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,"
+		    "\"pid\":1,\"tid\":%d}", n++ ? "," : "", e->name, e->ph,
+		    e->ts / 1000, e->ts % 1000, r->tid);
+	}
+    }
+    fprintf(ofile, "\n]}\n");
+    if (fclose(ofile)) {
+	wfdb_error("wfdb_trace_export: error writing %s\n", file);
+	return (-1);
+    }
+    return (n);
+#else
+    if (file) {
+	wfdb_error("wfdb_trace_export: tracing is not supported by this "
+		   "version of the WFDB library\n");
+	return (-1);
+    }
+    return (0);
+#endif
+}
+
 /* Functions that expose configuration constants used by the WFDB Toolkit for
    Matlab. */
 
@@ -308,6 +493,37 @@ FINT wfdb_me_fatal()	/* used by the MEMERR macro defined in wfdblib.h */
     return (wfdb_mem_behavior);
 }
 
+/* wfdb_printstats is invoked by wfdbquit. */
+void wfdb_printstats(void)
+{
+#ifndef WFDB_NO_STATS
+    static const char *ftype[4] = { "local", "remote", "compressed",
+				    "backend" };
+    int i;
+
+    if (!wfdb_stats_print)
+	return;
+    fprintf(stderr, "WFDB library statistics:\n");
+    for (i = 0; i < 4; i++)
+	if (wfdb_stats.bytes_read[i] || wfdb_stats.bytes_written[i])
+	    fprintf(stderr, " %s files: %lu bytes read, %lu bytes written\n",
+		    ftype[i], wfdb_stats.bytes_read[i],
+		    wfdb_stats.bytes_written[i]);
+    fprintf(stderr, " wfdb_fread calls: %lu\n", wfdb_stats.freads);
+    fprintf(stderr, " wfdb_fseek calls: %lu\n", wfdb_stats.fseeks);
+    fprintf(stderr, " remote requests: %lu (%lu bytes received)\n",
+	    wfdb_stats.http_requests, wfdb_stats.http_bytes);
+    fprintf(stderr, " remote page cache: %lu hits, %lu misses\n",
+	    wfdb_stats.page_hits, wfdb_stats.page_misses);
+    fprintf(stderr, " sample buffer refills: %lu\n",
+	    wfdb_stats.sample_refills);
+    fprintf(stderr, " signal group seeks: %lu\n",
+	    wfdb_stats.isgsetframe_seeks);
+    fprintf(stderr, " segment changes: %lu\n", wfdb_stats.segment_switches);
+    fprintf(stderr, " headers read: %lu\n", wfdb_stats.headers_parsed);
+#endif
+}
+
 /* The next four functions read and write integers in PDP-11 format, which is
 common to both MIT and AHA database files.  The purpose is to achieve
 interchangeability of binary database files between machines which may use
@@ -388,10 +604,14 @@ size_t wfdb_getline(char **buffer, size_t *buffer_size, WFDB_FILE *fp)
 struct wfdb_path_component {
     char *prefix;
     struct wfdb_path_component *next, *prev;
-    int type;		/* WFDB_LOCAL or WFDB_NET */
+    int type;		/* WFDB_LOCAL, WFDB_NET, or WFDB_BACKEND */
 };
 static struct wfdb_path_component *wfdb_path_list;
 
+/* Registered I/O backends (see wfdb_register_backend, below) */
+struct wfdb_backend_entry;
+static struct wfdb_backend_entry *bk_find(const char *name);
+
 /* wfdb_free_path_list clears out the path list, freeing all memory allocated
    to it. */
 void wfdb_free_path_list(void)
@@ -556,6 +776,8 @@ int wfdb_parse_path(const char *p)
 	SUALLOC(c1, 1, sizeof(struct wfdb_path_component));
 	SALLOC(c1->prefix, q-p+1, sizeof(char));
 	memcpy(c1->prefix, p, q-p);
+	if (current_type == WFDB_NET && bk_find(c1->prefix))
+	    current_type = WFDB_BACKEND;
 	c1->type = current_type;
 	c1->prev = c0;
 	if (c0) c0->next = c1;
@@ -745,7 +967,8 @@ void wfdb_addtopath(const char *s)
  	SUALLOC(c1, 1, sizeof(struct wfdb_path_component));
 	SALLOC(c1->prefix, p-s+1, sizeof(char));
 	memcpy(c1->prefix, s, p-s);
-	if (strstr(c1->prefix, "://")) c1->type = WFDB_NET;
+	if (bk_find(c1->prefix)) c1->type = WFDB_BACKEND;
+	else if (strstr(c1->prefix, "://")) c1->type = WFDB_NET;
 	else c1->type = WFDB_LOCAL;
     }
     /* (Re)link the unlinked node. */
@@ -923,12 +1146,28 @@ int wfdb_fprintf(WFDB_FILE *wp, const char *format, ...)
     va_list args;
 
     va_start(args, format);
+    if (wp->type == WFDB_COMPRESSED) {
+	errno = EROFS;	/* compressed files are read-only */
+	ret = -1;
+    }
+    else if (wp->type == WFDB_BACKEND || wp->wbp) {
+	char *buf = NULL;
+
+	if ((ret = wfdb_vasprintf(&buf, format, args)) > 0 &&
+	    wfdb_fwrite(buf, 1, ret, wp) != ret)
+	    ret = -1;
+	SFREE(buf);
+    }
+    else {
 #if WFDB_NETFILES
-    if (wp->type == WFDB_NET)
-	ret = nf_vfprintf(wp->netfp, format, args);
-    else
+	if (wp->type == WFDB_NET)
+	    ret = nf_vfprintf(wp->netfp, format, args);
+	else
 #endif
 	ret = vfprintf(wp->fp, format, args);
+	if (ret > 0)
+	    WFDB_COUNT(bytes_written[wp->type], ret);
+    }
     va_end(args);
     return (ret);
 }
@@ -948,6 +1187,159 @@ int wfdb_fprintf(WFDB_FILE *wp, const char *format, ...)
 
 static char irec[WFDB_MAXRNL+1]; /* current record name, set by wfdb_setirec */
 
+#if WFDB_NETFILES
+static int nf_known_record(const char *dir, const char *record);
+static int nf_probe_enabled(void);
+static void nf_probe_all(char **urls, int n);
+static void nf_probe_clear(void);
+#endif
+#ifdef WFDB_COMPRESSION
+static WFDB_FILE *wfdb_zopen(const char *fname);
+#endif
+
+/* wfdb_pathdir returns an allocated string containing the directory prefix
+   of the names of files in WFDB path component c0, after any substitutions
+   for '%' sequences, or NULL if there is insufficient memory. */
+static char *wfdb_pathdir(struct wfdb_path_component *c0)
+{
+    char *buf = NULL, *wfdb;
+    int bufsize, len, ireclen;
+
+    ireclen = strlen(irec);
+    bufsize = 64;
+    SALLOC(buf, 1, bufsize);
+    len = 0;
+    wfdb = c0->prefix;
+    while (*wfdb) {
+	while (len + ireclen >= bufsize) {
+	    bufsize *= 2;
+	    SREALLOC(buf, bufsize, 1);
+	}
+	if (!buf)
+	    break;
+
+	if (*wfdb == '%') {
+	    /* Perform substitutions in the WFDB path where '%' is found */
+	    wfdb++;
+	    if (*wfdb == 'r') {
+		/* '%r' -> record name */
+		(void)strcpy(buf + len, irec);
+		len += ireclen;
+		wfdb++;
+	    }
+	    else if ('1' <= *wfdb && *wfdb <= '9' && *(wfdb+1) == 'r') {
+		/* '%Nr' -> first N characters of record name */
+		int n = *wfdb - '0';
+
+		if (ireclen < n) n = ireclen;
+		(void)strncpy(buf + len, irec, n);
+		len += n;
+		buf[len] = '\0';
+		wfdb += 2;
+	    }
+	    else    /* '%X' -> X, if X is neither 'r', nor a non-zero digit
+		       followed by 'r' */
+		buf[len++] = *wfdb++;
+	}
+	else buf[len++] = *wfdb++;
+    }
+    /* Unless the WFDB component was empty, or it ended with a directory
+       separator, append a directory separator (the record and type
+       components are appended by the caller).  Note that names of remote
+       files (URLs) are always constructed using '/' separators, even if
+       the native directory separator is '\' (MS-DOS) or ':' (Macintosh).
+    */
+    if (len + 2 >= bufsize) {
+	bufsize = len + 2;
+	SREALLOC(buf, bufsize, 1);
+    }
+    if (!buf)
+	return (NULL);
+    if (len > 0) {
+	if (c0->type == WFDB_NET || c0->type == WFDB_BACKEND) {
+	    if (buf[len-1] != '/') buf[len++] = '/';
+	}
+#ifndef MSDOS
+	else if (buf[len-1] != DSEP)
+#else
+	else if (buf[len-1] != DSEP && buf[len-1] != ':')
+#endif
+	    buf[len++] = DSEP;
+    }
+    buf[len] = 0;
+    return (buf);
+}
+
+#if WFDB_NETFILES
+/* wfdb_probe_path is used by wfdb_open, if parallel probing is enabled, to
+request all of the remote files that wfdb_open may try to open (those named
+by remote components of the WFDB path that precede the first local component
+in which the file exists) at once, rather than one after another.  wfdb_open
+then tries each possible file name in the usual order, so that the file found
+is the same as it would be otherwise;  the only difference is that the
+responses for remote files are already available when needed.  Nothing is
+done (and in particular, no local files are opened) unless the WFDB path
+contains at least two remote components. */
+static void wfdb_probe_path(const char *r, const char *s)
+{
+    struct wfdb_path_component *c0;
+    char *buf, *name = NULL, *name2 = NULL, **urls = NULL;
+    int found = FALSE, i, n = 0;
+    FILE *fp;
+
+    for (c0 = wfdb_path_list; c0; c0 = c0->next)
+	if (c0->type == WFDB_NET)
+	    n++;
+    if (n < 2 || !nf_probe_enabled())
+	return;
+    n = 0;
+    for (c0 = wfdb_path_list; c0 && !found; c0 = c0->next) {
+	if ((buf = wfdb_pathdir(c0)) == NULL)
+	    continue;
+	if (c0->type == WFDB_NET && *s && !nf_known_record(buf, r)) {
+	    SFREE(buf);
+	    continue;
+	}
+	wfdb_asprintf(&buf, "%s%s", buf, r);
+	if (buf) {
+	    spr1(&name, buf, s);
+	    spr2(&name2, buf, s);
+	}
+	if (buf && name && name2) {
+	    if (c0->type == WFDB_NET) {
+		SREALLOC(urls, n + 2, sizeof(char *));
+		if (urls) {
+		    urls[n] = urls[n+1] = NULL;
+		    SSTRCPY(urls[n], name);
+		    n++;
+		    if (strcmp(name, name2)) {
+			SSTRCPY(urls[n], name2);
+			n++;
+		    }
+		}
+		else
+		    n = 0;
+	    }
+	    else if ((fp = fopen(name, RB)) ||
+		     (strcmp(name, name2) && (fp = fopen(name2, RB)))) {
+		fclose(fp);	/* no need to look any further */
+		found = TRUE;
+	    }
+	}
+	SFREE(buf);
+    }
+    if (n > 1)
+	nf_probe_all(urls, n);
+    else
+	nf_probe_clear();	/* discard any left from earlier searches */
+    for (i = 0; i < n; i++)
+	SFREE(urls[i]);
+    SFREE(urls);
+    SFREE(name);
+    SFREE(name2);
+}
+#endif
+
 /* wfdb_open is used by other WFDB library functions to open a database file
 for reading or writing.  wfdb_open accepts two string arguments and an integer
 argument.  The first string specifies the file type ("hea", "atr", etc.),
@@ -986,7 +1378,10 @@ constructed by spr1, does not match that of an existing file, wfdb_open uses
 spr2 to construct an alternate file name.  In this form, the file type is
 truncated to no more than 3 characters (as MS-DOS does).  When searching for
 input files, wfdb_open tries both forms with each component of the WFDB path
-before going on to the next path component.
+before going on to the next path component.  If neither form matches an
+existing file, and the library has been compiled with support for compressed
+files, wfdb_open also looks for a compressed copy (with ".gz" or ".zst"
+appended to the name constructed by spr1) in the same directory.
 
 If the record name is empty, wfdb_open swaps the record name and the type
 string.  If the type string (after swapping, if necessary) is empty, spr1 uses
@@ -1006,12 +1401,13 @@ is no longer supported. */
 
 WFDB_FILE *wfdb_open(const char *s, const char *record, int mode)
 {
-    char *wfdb, *p, *q, *r, *buf = NULL;
+    char *p, *q, *r, *buf = NULL;
     int rlen;
     struct wfdb_path_component *c0;
-    int bufsize, len, ireclen;
     WFDB_FILE *ifile;
 
+    wfdb_stats_init();
+
     /* If the type (s) is empty, replace it with an empty string so that
        strcmp(s, ...) will not segfault. */
     if (s == NULL) s = "";
@@ -1090,73 +1486,34 @@ WFDB_FILE *wfdb_open(const char *s, const char *record, int mode)
 	    SFREE(r);
 	    return (ifile);
 	}
+#ifdef WFDB_COMPRESSION
+	SFREE(buf);
+	SSTRCPY(buf, wfdb_filename);
+	if ((ifile = wfdb_zopen(buf)) != NULL) {
+	    wfdb_addtopath(wfdb_filename);
+	    SFREE(buf);
+	    SFREE(r);
+	    return (ifile);
+	}
+	SFREE(buf);
+#endif
     }
 
+#if WFDB_NETFILES
+    wfdb_probe_path(r, s);
+#endif
     for (c0 = wfdb_path_list; c0; c0 = c0->next) {
 	char *long_filename = NULL;
 
-	ireclen = strlen(irec);
-	bufsize = 64;
-	SALLOC(buf, 1, bufsize);
-	len = 0;
-	wfdb = c0->prefix;
-	while (*wfdb) {
-	    while (len + ireclen >= bufsize) {
-		bufsize *= 2;
-		SREALLOC(buf, bufsize, 1);
-	    }
-	    if (!buf)
-		break;
-
-	    if (*wfdb == '%') {
-		/* Perform substitutions in the WFDB path where '%' is found */
-		wfdb++;
-		if (*wfdb == 'r') {
-		    /* '%r' -> record name */
-		    (void)strcpy(buf + len, irec);
-		    len += ireclen;
-		    wfdb++;
-		}
-		else if ('1' <= *wfdb && *wfdb <= '9' && *(wfdb+1) == 'r') {
-		    /* '%Nr' -> first N characters of record name */
-		    int n = *wfdb - '0';
-
-		    if (ireclen < n) n = ireclen;
-		    (void)strncpy(buf + len, irec, n);
-		    len += n;
-		    buf[len] = '\0';
-		    wfdb += 2;
-		}
-		else    /* '%X' -> X, if X is neither 'r', nor a non-zero digit
-			   followed by 'r' */
-		    buf[len++] = *wfdb++;
-	    }
-	    else buf[len++] = *wfdb++;
-	}
-	/* Unless the WFDB component was empty, or it ended with a directory
-	   separator, append a directory separator to wfdb_filename;  then
-	   append the record and type components.  Note that names of remote
-	   files (URLs) are always constructed using '/' separators, even if
-	   the native directory separator is '\' (MS-DOS) or ':' (Macintosh).
-	*/
-	if (len + 2 >= bufsize) {
-	    bufsize = len + 2;
-	    SREALLOC(buf, bufsize, 1);
-	}
-	if (!buf)
+	if ((buf = wfdb_pathdir(c0)) == NULL)
+	    continue;
+#if WFDB_NETFILES
+	/* Skip remote directories in which the record is known to be absent. */
+	if (c0->type == WFDB_NET && *s && !nf_known_record(buf, r)) {
+	    SFREE(buf);
 	    continue;
-	if (len > 0) {
-	    if (c0->type == WFDB_NET) {
-		if (buf[len-1] != '/') buf[len++] = '/';
-	    }
-#ifndef MSDOS
-	    else if (buf[len-1] != DSEP)
-#else
-	    else if (buf[len-1] != DSEP && buf[len-1] != ':')
-#endif
-		buf[len++] = DSEP;
 	}
-	buf[len] = 0;
+#endif
 	wfdb_asprintf(&buf, "%s%s", buf, r);
 	if (!buf)
 	    continue;
@@ -1181,6 +1538,16 @@ WFDB_FILE *wfdb_open(const char *s, const char *record, int mode)
 	    SFREE(r);
 	    return (ifile);
 	}
+#ifdef WFDB_COMPRESSION
+	/* Still not found -- look for a compressed copy of the file. */
+	if ((ifile = wfdb_zopen(long_filename)) != NULL) {
+	    wfdb_addtopath(wfdb_filename);
+	    SFREE(long_filename);
+	    SFREE(buf);
+	    SFREE(r);
+	    return (ifile);
+	}
+#endif
 	SFREE(long_filename);
 	SFREE(buf);
     }
@@ -1253,6 +1620,61 @@ void wfdb_striphea(char *p)
     }
 }
 
+/* wfdb_fileval fills in *v with a validator for the local file fname:  its
+   size, modification time, and inode number, and hashes of its first and last
+   FVSPAN bytes (or of its entire contents, if it is no longer than 2*FVSPAN
+   bytes).  A derived file (such as a compiled header or an annotation index)
+   records the validator of the file from which it was derived, and is used
+   only if that validator still matches.  The hashes detect most changes that
+   preserve the size and modification time (for example, those made within
+   the same second on file systems that record only whole seconds), without
+   requiring large files to be read in their entirety.  wfdb_fileval returns 0
+   if successful, or -1 if fname cannot be read. */
+
+#define FVSPAN	65536L
+
+int wfdb_fileval(const char *fname, struct wfdb_fileval *v)
+{
+    char buf[4096];
+    unsigned long h1 = 2166136261UL, h2 = 5381UL;
+    long len, n, pos;
+    size_t i, m;
+    struct stat st;
+    FILE *fp;
+
+    memset(v, 0, sizeof(*v));
+    if (stat(fname, &st) < 0 || (fp = fopen(fname, RB)) == NULL)
+	return (-1);
+    v->size = (double)st.st_size;
+    v->mtime = (double)st.st_mtime;
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+    defined(__OpenBSD__)
+    v->mtimens = (double)st.st_mtim.tv_nsec;
+#endif
+    v->ino = (double)st.st_ino;
+    len = (long)st.st_size;
+    for (pos = 0L; pos < len; ) {
+	if (pos == FVSPAN && len > 2*FVSPAN) {	/* skip to the last FVSPAN */
+	    pos = len - FVSPAN;
+	    if (fseek(fp, pos, SEEK_SET))
+		break;
+	}
+	n = (pos < FVSPAN) ? FVSPAN - pos : len - pos;
+	if (n > sizeof(buf)) n = sizeof(buf);
+	if ((m = fread(buf, 1, n, fp)) == 0)
+	    break;
+	for (i = 0; i < m; i++) {
+	    h1 = ((h1 ^ (buf[i] & 0xff)) * 16777619UL) & 0xffffffffUL;
+	    h2 = ((h2 << 5) + h2 + (buf[i] & 0xff)) & 0xffffffffUL;
+	}
+	pos += m;
+    }
+    fclose(fp);
+    v->hash[0] = h1;
+    v->hash[1] = h2;
+    return (pos == len ? 0 : -1);
+}
+
 
 /* WFDB file I/O functions
 
@@ -1302,21 +1724,81 @@ struct netfile {
   char *url;
   char *data;
   int mode;
-  long base_addr;
+  struct nf_page *pages;
+  long lastpage;
+  int seq;			/* TRUE if lastpage was read after the page
+				   preceding it */
   long cont_len;
   long pos;
   long err;
   int fd;
   char *redirect_url;
   unsigned int redirect_time;
+  char *cache;			/* prefix of the names of this file's entry in
+				   the disk cache, or NULL */
+  char *cacheval;		/* validator of the disk cache entry (see
+				   nf_disk_val) */
+  netfile *next;		/* next open netfile */
 };
 
 static int nf_open_files = 0;		/* number of open netfiles */
+static netfile *nf_list;		/* list of open netfiles */
 static long page_size = NF_PAGE_SIZE;	/* bytes per range request (0: disable
 					   range requests) */
+
+/* In NF_CHUNK_MODE, the contents of remote files are cached in pages of
+   page_size bytes, aligned on multiples of page_size.  The pages of all open
+   netfiles are kept on a single list in order of most recent use, and the
+   least recently used pages are discarded as needed to keep the total size
+   of the cache within cache_size bytes.  When a file is read sequentially
+   (from one page to the next), the following readahead pages are fetched
+   using the same range request, and the next readahead pages of any other
+   open netfile that is being read sequentially and is about to run out of
+   cached pages are requested concurrently (up to max_connections requests
+   at a time). */
+struct nf_page {
+  netfile *nf;			/* file to which this page belongs */
+  long addr;			/* byte offset of the page within the file */
+  long len;			/* number of bytes in the page */
+  char *data;
+  struct nf_page *prev, *next;	/* neighbors in the cache (most recently used
+				   first) */
+  struct nf_page *fnext;	/* next page of the same file */
+};
+
+static struct nf_page *nf_mru, *nf_lru;	/* most and least recently used
+					   pages */
+static long cache_bytes;		/* total size of cached pages */
+static long cache_size = NF_CACHE_SIZE;	/* maximum value of cache_bytes */
+static long readahead = NF_READAHEAD;	/* pages to read ahead */
+static int max_connections = NF_MAX_CONNECTIONS; /* maximum number of
+					   concurrent range requests */
+static long lookup_ttl = NF_LOOKUP_TTL;	/* seconds to remember that a remote
+					   file does not exist */
+static int use_records;			/* TRUE if RECORDS files are used to
+					   skip searches for absent records */
+static int probe_all;			/* TRUE if wfdb_open requests remote
+					   files in the WFDB path in parallel */
+static char *disk_cache_dir;		/* directory for the disk cache, or NULL
+					   if it is disabled */
+static long disk_cache_ttl = NF_CACHE_TTL; /* seconds before an entry in the
+					   disk cache must be revalidated */
 static int www_done_init = FALSE;	/* TRUE once libcurl is initialized */
 
 static CURL *curl_ua = NULL;
+static long www_status;		/* HTTP status of the last completed request,
+				   or 0 if no response was received */
+
+/* Range requests are performed using the curl "multi" interface, by a pool
+   of max_connections "easy" handles (copies of curl_ua, created as needed).
+   The handles are reused for later requests, so that connections to the
+   server are kept alive. */
+static CURLM *curl_multi = NULL;
+static struct www_handle {
+    CURL *c;
+    struct www_request *req;	/* request in progress, or NULL if idle */
+    char errbuf[CURL_ERROR_SIZE];
+} *www_pool;
 
 /* Construct the User-Agent string to be sent with HTTP requests. */
 static char *curl_get_ua_string(void)
@@ -1363,6 +1845,7 @@ struct chunk {
     unsigned long start_pos, end_pos, total_size;
     char *data;
     char *url;
+    char *etag, *modified;	/* validators (ETag and Last-Modified) */
 };
 
 /* This is a dummy write callback, for when we don't care about the
@@ -1448,11 +1931,123 @@ static const char *www_userpwd(const char *url)
     return NULL;
 }
 
+/* Remote lookup cache.  While searching the WFDB path, wfdb_open usually
+   tries to open several remote files that do not exist.  Each URL for which
+   the server reports that no such file exists (HTTP status 404 or 410) is
+   remembered for lookup_ttl seconds, during which nf_fopen fails at once
+   rather than asking the server again.  (The cache is keyed by URL rather
+   than by record and file type, since the URLs tried for a given record
+   depend on the order of the WFDB path, which wfdb_addtopath changes as
+   files are found.)
+
+   If WFDB_RECORDS is set, wfdb_open also reads the RECORDS file (if any) in
+   each remote directory in the WFDB path the first time it searches there,
+   and does not look for files of records that are not listed in it (or
+   within a subdirectory listed in it).  This avoids a request for every
+   miss, but is correct only for databases in which every record (including
+   each segment of a multi-segment record) is listed in a RECORDS file. */
+
+struct nf_miss {
+    char *url;
+    unsigned int time;		/* when the server reported it missing */
+    struct nf_miss *next;
+};
+static struct nf_miss *nf_misses[NF_LOOKUP_HASH];
+static int nf_nmisses;
+
+struct nf_records {
+    char *dir;			/* URL of the directory */
+    char *list;			/* contents of RECORDS (NULL if none) */
+    unsigned int time;		/* when RECORDS was read */
+    struct nf_records *next;
+};
+static struct nf_records *nf_records_list;
+
+/* nf_miss_hash returns the hash table index of url. */
+static unsigned int nf_miss_hash(const char *url)
+{
+    unsigned long h = 2166136261UL;
+
+    while (*url)
+	h = ((h ^ (*url++ & 0xff)) * 16777619UL) & 0xffffffffUL;
+    return ((unsigned int)(h % NF_LOOKUP_HASH));
+}
+
+/* nf_miss_free empties the lookup cache. */
+static void nf_miss_free(void)
+{
+    struct nf_miss *m;
+    struct nf_records *r;
+    int i;
+
+    for (i = 0; i < NF_LOOKUP_HASH; i++)
+	while (m = nf_misses[i]) {
+	    nf_misses[i] = m->next;
+	    SFREE(m->url);
+	    SFREE(m);
+	}
+    nf_nmisses = 0;
+    while (r = nf_records_list) {
+	nf_records_list = r->next;
+	SFREE(r->dir);
+	SFREE(r->list);
+	SFREE(r);
+    }
+}
+
+/* nf_missing returns TRUE if url was recently found not to exist.  Expired
+   entries are removed from the cache as they are found. */
+static int nf_missing(const char *url)
+{
+    struct nf_miss *m, **mp;
+    unsigned int now = www_time();
+
+    for (mp = &nf_misses[nf_miss_hash(url)]; m = *mp; ) {
+	if (now - m->time >= lookup_ttl) {
+	    *mp = m->next;
+	    SFREE(m->url);
+	    SFREE(m);
+	    nf_nmisses--;
+	}
+	else if (strcmp(m->url, url) == 0)
+	    return (TRUE);
+	else
+	    mp = &m->next;
+    }
+    return (FALSE);
+}
+
+/* nf_add_miss records that url does not exist. */
+static void nf_add_miss(const char *url)
+{
+    struct nf_miss *m;
+    unsigned int h;
+
+    if (lookup_ttl <= 0L || nf_nmisses >= NF_LOOKUP_MAX)
+	return;
+    SUALLOC(m, 1, sizeof(struct nf_miss));
+    if (m == NULL)
+	return;
+    SSTRCPY(m->url, url);
+    m->time = www_time();
+    h = nf_miss_hash(url);
+    m->next = nf_misses[h];
+    nf_misses[h] = m;
+    nf_nmisses++;
+}
+
 static void wfdb_wwwquit(void)
 {
     int i;
     if (www_done_init) {
 #ifndef _WINDOWS
+	for (i = 0; www_pool && i < max_connections; i++)
+	    if (www_pool[i].c)
+		curl_easy_cleanup(www_pool[i].c);
+	SFREE(www_pool);
+	if (curl_multi)
+	    curl_multi_cleanup(curl_multi);
+	curl_multi = NULL;
 	curl_easy_cleanup(curl_ua);
 	curl_ua = NULL;
 	curl_global_cleanup();
@@ -1461,6 +2056,9 @@ static void wfdb_wwwquit(void)
 	for (i = 0; passwords && passwords[i]; i++)
 	    SFREE(passwords[i]);
 	SFREE(passwords);
+	SFREE(disk_cache_dir);
+	nf_miss_free();
+	nf_probe_clear();
     }
 }
 
@@ -1471,6 +2069,26 @@ static void www_init(void)
 
 	if ((p = getenv("WFDB_PAGESIZE")) && *p)
 	    page_size = strtol(p, NULL, 10);
+	if ((p = getenv("WFDB_CACHESIZE")) && *p)
+	    cache_size = strtol(p, NULL, 10);
+	if ((p = getenv("WFDB_READAHEAD")) && *p &&
+	    (readahead = strtol(p, NULL, 10)) < 0)
+	    readahead = 0;
+	if ((p = getenv("WFDB_MAXCONN")) && *p &&
+	    (max_connections = strtol(p, NULL, 10)) < 1)
+	    max_connections = 1;
+	if ((p = getenv("WFDB_CACHEDIR")) && *p) {
+	    SSTRCPY(disk_cache_dir, p);
+	    (void)MKDIR(disk_cache_dir, 0755);	/* fails if it exists already */
+	}
+	if ((p = getenv("WFDB_CACHETTL")) && *p)
+	    disk_cache_ttl = strtol(p, NULL, 10);
+	if ((p = getenv("WFDB_LOOKUPTTL")) && *p)
+	    lookup_ttl = strtol(p, NULL, 10);
+	if ((p = getenv("WFDB_RECORDS")) && *p && strcmp(p, "0"))
+	    use_records = TRUE;
+	if ((p = getenv("WFDB_PROBE")) && *p && strcmp(p, "0"))
+	    probe_all = TRUE;
 
 	/* Initialize the curl "easy" handle. */
 	curl_global_init(CURL_GLOBAL_ALL);
@@ -1502,6 +2120,11 @@ static void www_init(void)
 	if ((p = getenv("WFDB_NET_DEBUG")) && *p)
 	    curl_easy_setopt(curl_ua, CURLOPT_VERBOSE, 1L);
 
+	/* Initialize the "multi" handle and the (empty) pool of handles
+	   for range requests. */
+	curl_multi = curl_multi_init();
+	SALLOC(www_pool, max_connections, sizeof(struct www_handle));
+
 	atexit(wfdb_wwwquit);
 	www_done_init = TRUE;
     }
@@ -1512,10 +2135,13 @@ static void www_init(void)
 static int www_perform_request(CURL *c)
 {
     long code;
+    www_status = 0L;
+    WFDB_COUNT(http_requests, 1);
     if (curl_easy_perform(c))
 	return (-1);
     if (curl_easy_getinfo(c, CURLINFO_HTTP_CODE, &code))
 	return (0);
+    www_status = code;
     return (code < 400 ? 0 : -1);
 }
 
@@ -1562,6 +2188,7 @@ static CHUNK *curl_chunk_new(long len)
     c->end_pos = 0;
     c->total_size = 0;
     c->url = NULL;
+    c->etag = c->modified = NULL;
     return c;
 }
 
@@ -1571,10 +2198,27 @@ static void curl_chunk_delete(struct chunk *c)
     if (c) {
 	SFREE(c->data);
 	SFREE(c->url);
+	SFREE(c->etag);
+	SFREE(c->modified);
 	SFREE(c);
     }
 }
 
+/* Save the value of an HTTP header (the n bytes starting at s, less any
+   surrounding white space) in *value. */
+static void curl_chunk_header_value(char **value, char *s, long n)
+{
+    while (n > 0 && (*s == ' ' || *s == '\t'))
+	s++, n--;
+    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\t' || s[n-1] == '\r' ||
+		     s[n-1] == '\n'))
+	n--;
+    SFREE(*value);
+    SALLOC(*value, n + 1, 1);
+    if (*value)
+	memcpy(*value, s, n);
+}
+
 /* Write metadata (e.g., HTTP headers) into a chunk.  This function is
    called by curl and must take the same arguments as fwrite().  ptr
    points to the data received, size*nmemb is the number of bytes, and
@@ -1593,6 +2237,10 @@ static size_t curl_chunk_header_write(void *ptr, size_t size, size_t nmemb,
 	    sscanf(s + 6, "%lu-%lu/%lu",
 		   &c->start_pos, &c->end_pos, &c->total_size);
     }
+    else if (0 == strncasecmp(s, "ETag:", 5))
+	curl_chunk_header_value(&c->etag, s + 5, size*nmemb - 5);
+    else if (0 == strncasecmp(s, "Last-Modified:", 14))
+	curl_chunk_header_value(&c->modified, s + 14, size*nmemb - 14);
     return (size * nmemb);
 }
 
@@ -1607,6 +2255,7 @@ static size_t curl_chunk_write(void *ptr, size_t size, size_t nmemb,
     char *p;
     struct chunk *c = (struct chunk *) stream;
 
+    WFDB_COUNT(http_bytes, size * nmemb);
     while (nmemb > 0) {
 	while ((c->size + size) > c->buffer_size) {
 	    c->buffer_size += 1024;
@@ -1629,135 +2278,763 @@ static void curl_chunk_putb(struct chunk *chunk, char *data, size_t len)
     curl_chunk_write(data, 1, len, chunk);
 }
 
-static CHUNK *www_get_url_range_chunk(const char *url, long startb, long len)
-{
-    CHUNK *chunk = NULL, *extra_chunk = NULL;
-    char range_req_str[6*sizeof(long) + 2];
-    const char *url2 = NULL;
-
-    if (url && *url) {
-	sprintf(range_req_str, "%ld-%ld", startb, startb+len-1);
-	chunk = chunk_new(len);
-	if (!chunk)
-	    return (NULL);
-
-	if (/* In this case we want to send a GET request rather than
-	       a HEAD */
-	    curl_try(curl_easy_setopt(curl_ua, CURLOPT_NOBODY, 0L))
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_HTTPGET, 1L))
-	    /* URL to retrieve */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_URL, url))
-	    /* Set username/password */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_USERPWD,
-	                                 www_userpwd(url)))
-	    /* Range request */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_RANGE,
-					 range_req_str))
-	    /* This function will be used to "write" data as it is received */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEFUNCTION,
-					 curl_chunk_write))
-	    /* The pointer to pass to the write function */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEDATA, chunk))
-	    /* This function will be used to parse HTTP headers */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_HEADERFUNCTION,
-					 curl_chunk_header_write))
-	    /* The pointer to pass to the header function */
-	    || curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEHEADER, chunk))
-	    /* Perform the request */
-	    || www_perform_request(curl_ua)) {
-
-	    chunk_delete(chunk);
-	    return (NULL);
-	}
-	if (!chunk->data) {
-	    chunk_delete(chunk);
-	    chunk = NULL;
-	}
-	else if (!curl_easy_getinfo(curl_ua, CURLINFO_EFFECTIVE_URL, &url2) &&
-		 url2 && *url2 && strcmp(url, url2)) {
-	    SSTRCPY(chunk->url, url2);
-	}
-    }
-    return (chunk);
-}
-
-static CHUNK *www_get_url_chunk(const char *url)
+/* www_get_validators sends a HEAD request for url, and returns an empty
+   chunk containing the validators sent by the server, or NULL if the request
+   failed. */
+static CHUNK *www_get_validators(const char *url)
 {
-    CHUNK *chunk = NULL;
+    CHUNK *chunk;
 
-    chunk = chunk_new(1024);
-    if (!chunk)
+    if ((chunk = chunk_new(1)) == NULL)
 	return (NULL);
-
-    if (/* Send a GET request */
-	curl_try(curl_easy_setopt(curl_ua, CURLOPT_NOBODY, 0L))
-	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_HTTPGET, 1L))
-	/* URL to retrieve */
+    if (curl_try(curl_easy_setopt(curl_ua, CURLOPT_NOBODY, 1L))
 	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_URL, url))
-	/* Set username/password */
 	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_USERPWD,
 				     www_userpwd(url)))
-	/* No range request */
 	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_RANGE, NULL))
-	/* Write to the chunk specified ... */
 	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEFUNCTION,
-				     curl_chunk_write))
-	/* ... by this pointer */
-	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_HEADERFUNCTION,
 				     curl_null_write))
-	/* and ignore the header data */
-	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEDATA, chunk))
-	/* perform the request */
+	/* Parse the headers */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_HEADERFUNCTION,
+				     curl_chunk_header_write))
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEHEADER, chunk))
 	|| www_perform_request(curl_ua)) {
-
 	chunk_delete(chunk);
 	return (NULL);
     }
-    if (!chunk->data) {
-	chunk_delete(chunk);
-	chunk = NULL;
-    }
-
     return (chunk);
 }
 
-static void nf_delete(netfile *nf)
+/* A www_request describes a range request to be performed by
+   www_get_url_ranges.  The nf, page, and npages fields are not used by
+   www_get_url_ranges, but identify the pages being requested for the
+   caller's benefit. */
+struct www_request {
+    const char *url;		/* URL to retrieve */
+    long startb, len;		/* byte range requested */
+    CHUNK *chunk;		/* response (NULL if the request failed) */
+    long status;		/* HTTP status (0 if no response) */
+    netfile *nf;
+    long page, npages;
+};
+
+/* Like curl_try, but reports the error message recorded by handle h, and
+   the name of the option that could not be set. */
+static int www_try(struct www_handle *h, const char *opt, CURLcode err)
+{
+    if (err) {
+      wfdb_error("curl error: %s (setting %s)\n",
+		 *h->errbuf ? h->errbuf : curl_easy_strerror(err), opt);
+    }
+    return err;
+}
+
+#define www_setopt(H, OPT, VAL) \
+    www_try((H), #OPT, curl_easy_setopt((H)->c, OPT, VAL))
+
+/* Set up an idle handle from the pool to perform a range request, and add
+   it to the multi handle.  Returns 0 if successful, -1 otherwise. */
+static int www_start_request(struct www_handle *h, struct www_request *r)
+{
+    char range_req_str[6*sizeof(long) + 2];
+
+    if (h->c == NULL) {
+	if ((h->c = curl_easy_duphandle(curl_ua)) == NULL)
+	    return (-1);
+	curl_easy_setopt(h->c, CURLOPT_ERRORBUFFER, h->errbuf);
+    }
+    sprintf(range_req_str, "%ld-%ld", r->startb, r->startb + r->len - 1);
+    if ((r->chunk = chunk_new(r->len)) == NULL)
+	return (-1);
+    h->errbuf[0] = '\0';
+    if (/* Send a GET request rather than a HEAD */
+	www_setopt(h, CURLOPT_NOBODY, 0L)
+	|| www_setopt(h, CURLOPT_HTTPGET, 1L)
+	/* URL to retrieve */
+	|| www_setopt(h, CURLOPT_URL, r->url)
+	/* Set username/password */
+	|| www_setopt(h, CURLOPT_USERPWD, www_userpwd(r->url))
+	/* Range request */
+	|| www_setopt(h, CURLOPT_RANGE, range_req_str)
+	/* This function will be used to "write" data as it is received */
+	|| www_setopt(h, CURLOPT_WRITEFUNCTION, curl_chunk_write)
+	/* The pointer to pass to the write function */
+	|| www_setopt(h, CURLOPT_WRITEDATA, r->chunk)
+	/* This function will be used to parse HTTP headers */
+	|| www_setopt(h, CURLOPT_HEADERFUNCTION, curl_chunk_header_write)
+	/* The pointer to pass to the header function */
+	|| www_setopt(h, CURLOPT_WRITEHEADER, r->chunk)) {
+	chunk_delete(r->chunk);
+	r->chunk = NULL;
+	return (-1);
+    }
+    /* Queue the request */
+    if (curl_multi_add_handle(curl_multi, h->c)) {
+	wfdb_error("curl error: unable to queue request for %s\n", r->url);
+	chunk_delete(r->chunk);
+	r->chunk = NULL;
+	return (-1);
+    }
+    h->req = r;
+    WFDB_COUNT(http_requests, 1);
+    return (0);
+}
+
+/* Finish a request when its handle reports that the transfer is complete.
+   If the transfer failed, the request's chunk is discarded. */
+static void www_finish_request(struct www_handle *h, CURLcode result)
+{
+    struct www_request *r = h->req;
+    const char *url2 = NULL;
+    long code;
+
+    curl_multi_remove_handle(curl_multi, h->c);
+    h->req = NULL;
+    if (result != CURLE_OK || curl_easy_getinfo(h->c, CURLINFO_HTTP_CODE, &code))
+	code = 0L;
+    www_status = r->status = code;
+    if (result != CURLE_OK || code >= 400 ||
+	!r->chunk->data) {
+	chunk_delete(r->chunk);
+	r->chunk = NULL;
+    }
+    else if (!curl_easy_getinfo(h->c, CURLINFO_EFFECTIVE_URL, &url2) &&
+	     url2 && *url2 && strcmp(r->url, url2)) {
+	SSTRCPY(r->chunk->url, url2);
+    }
+}
+
+/* www_get_url_ranges performs the n range requests in rq concurrently, using
+   at most max_connections connections, and waits for all of them to finish.
+   On return, the chunk field of each request contains the response, or NULL
+   if the request failed. */
+static void www_get_url_ranges(struct www_request *rq, int n)
+{
+    CURLMsg *msg;
+    int active = 0, i, next = 0, nmsg, running;
+
+    for (i = 0; i < n; i++) {
+	rq[i].chunk = NULL;
+	rq[i].status = 0L;
+    }
+    while (next < n || active > 0) {
+	/* Start as many of the remaining requests as there are idle
+	   handles. */
+	for (i = 0; i < max_connections && next < n; i++)
+	    if (www_pool[i].req == NULL) {
+		if (rq[next].url && *rq[next].url &&
+		    www_start_request(&www_pool[i], &rq[next]) == 0)
+		    active++;
+		next++;
+	    }
+	if (active == 0)
+	    continue;
+	if (curl_multi_perform(curl_multi, &running) != CURLM_OK)
+	    running = 0;
+	while (msg = curl_multi_info_read(curl_multi, &nmsg))
+	    if (msg->msg == CURLMSG_DONE)
+		for (i = 0; i < max_connections; i++)
+		    if (www_pool[i].req && www_pool[i].c == msg->easy_handle) {
+			www_finish_request(&www_pool[i], msg->data.result);
+			active--;
+			break;
+		    }
+	if (running == 0) {
+	    /* Nothing remains in progress, so any request that has not been
+	       reported as finished has failed. */
+	    for (i = 0; i < max_connections; i++)
+		if (www_pool[i].req)
+		    www_finish_request(&www_pool[i], CURLE_RECV_ERROR);
+	    active = 0;
+	}
+	else if (active > 0)
+	    curl_multi_wait(curl_multi, NULL, 0, 1000, NULL);
+    }
+}
+
+static CHUNK *www_get_url_range_chunk(const char *url, long startb, long len)
+{
+    struct www_request r;
+
+    r.url = url;
+    r.startb = startb;
+    r.len = len;
+    www_get_url_ranges(&r, 1);
+    return (r.chunk);
+}
+
+static CHUNK *www_get_url_chunk(const char *url)
+{
+    CHUNK *chunk = NULL;
+
+    chunk = chunk_new(1024);
+    if (!chunk)
+	return (NULL);
+
+    if (/* Send a GET request */
+	curl_try(curl_easy_setopt(curl_ua, CURLOPT_NOBODY, 0L))
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_HTTPGET, 1L))
+	/* URL to retrieve */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_URL, url))
+	/* Set username/password */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_USERPWD,
+				     www_userpwd(url)))
+	/* No range request */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_RANGE, NULL))
+	/* Write to the chunk specified ... */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEFUNCTION,
+				     curl_chunk_write))
+	/* ... by this pointer */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_HEADERFUNCTION,
+				     curl_null_write))
+	/* and ignore the header data */
+	|| curl_try(curl_easy_setopt(curl_ua, CURLOPT_WRITEDATA, chunk))
+	/* perform the request */
+	|| www_perform_request(curl_ua)) {
+
+	chunk_delete(chunk);
+	return (NULL);
+    }
+    if (!chunk->data) {
+	chunk_delete(chunk);
+	chunk = NULL;
+    }
+
+    return (chunk);
+}
+
+/* nf_known_record returns FALSE if the RECORDS file in the remote directory
+   dir (a URL ending with '/') shows that record is not there, and TRUE
+   otherwise (including if RECORDS files are not being used, or if there is
+   no RECORDS file in dir). */
+static int nf_known_record(const char *dir, const char *record)
+{
+    struct nf_records *r, **rp;
+    CHUNK *chunk;
+    char *p, *q, *url = NULL;
+    unsigned int now;
+    long n;
+
+    if (!www_done_init)
+	www_init();
+    if (!use_records)
+	return (TRUE);
+    now = www_time();
+    for (rp = &nf_records_list; r = *rp; rp = &r->next)
+	if (strcmp(r->dir, dir) == 0)
+	    break;
+    if (r && now - r->time >= lookup_ttl) {	/* expired */
+	*rp = r->next;
+	SFREE(r->dir);
+	SFREE(r->list);
+	SFREE(r);
+	r = NULL;
+    }
+    if (r == NULL) {
+	SUALLOC(r, 1, sizeof(struct nf_records));
+	if (r == NULL)
+	    return (TRUE);
+	SSTRCPY(r->dir, dir);
+	r->time = now;
+	wfdb_asprintf(&url, "%sRECORDS", dir);
+	if (url && (chunk = www_get_url_chunk(url))) {
+	    SALLOC(r->list, chunk->size + 1, 1);
+	    if (r->list)
+		memcpy(r->list, chunk->data, chunk->size);
+	    chunk_delete(chunk);
+	}
+	SFREE(url);
+	r->next = nf_records_list;
+	nf_records_list = r;
+    }
+    if (r->list == NULL)
+	return (TRUE);
+
+    /* Search the list for the record, or for a directory containing it. */
+    for (p = r->list; *p; p = q) {
+	for (q = p; *q && *q != '\n' && *q != '\r'; q++)
+	    ;
+	n = q - p;
+	if (n > 0 && strncmp(p, record, n) == 0 &&
+	    (record[n] == '\0' || p[n-1] == '/'))
+	    return (TRUE);
+	while (*q == '\n' || *q == '\r')
+	    q++;
+    }
+    return (FALSE);
+}
+
+/* Remove a page from the cache and free it. */
+static void nf_page_delete(struct nf_page *pg)
+{
+    struct nf_page **pp;
+
+    for (pp = &pg->nf->pages; *pp; pp = &(*pp)->fnext)
+	if (*pp == pg) {
+	    *pp = pg->fnext;
+	    break;
+	}
+    if (pg->prev) pg->prev->next = pg->next;
+    else nf_mru = pg->next;
+    if (pg->next) pg->next->prev = pg->prev;
+    else nf_lru = pg->prev;
+    cache_bytes -= pg->len;
+    SFREE(pg->data);
+    SFREE(pg);
+}
+
+/* Add len bytes (starting at data) to the cache as the page of nf beginning
+   at addr, discarding the least recently used pages if necessary. */
+static struct nf_page *nf_page_add(netfile *nf, long addr, char *data,
+				   long len)
+{
+    struct nf_page *pg;
+
+    while (nf_lru && cache_bytes + len > cache_size)
+	nf_page_delete(nf_lru);
+    SUALLOC(pg, 1, sizeof(struct nf_page));
+    if (pg == NULL)
+	return (NULL);
+    SALLOC(pg->data, 1, len);
+    if (pg->data == NULL) {
+	SFREE(pg);
+	return (NULL);
+    }
+    memcpy(pg->data, data, len);
+    pg->nf = nf;
+    pg->addr = addr;
+    pg->len = len;
+    pg->fnext = nf->pages;
+    nf->pages = pg;
+    pg->prev = NULL;
+    if (pg->next = nf_mru) nf_mru->prev = pg;
+    else nf_lru = pg;
+    nf_mru = pg;
+    cache_bytes += len;
+    return (pg);
+}
+
+static void nf_delete(netfile *nf)
 {
     if (nf) {
+	while (nf->pages)
+	    nf_page_delete(nf->pages);
 	SFREE(nf->url);
 	SFREE(nf->data);
 	SFREE(nf->redirect_url);
+	SFREE(nf->cache);
+	SFREE(nf->cacheval);
 	SFREE(nf);
     }
 }
 
-static CHUNK *nf_get_url_range_chunk(netfile *nf, long startb, long len)
+/* nf_request_url returns the URL to be used for a request for (part of) nf.
+   If a previous request for this file was recently redirected, this is the
+   previous (redirected) URL; otherwise, it is the original URL.  (If the
+   system clock moves backwards, the cache is assumed to be out-of-date.) */
+static char *nf_request_url(netfile *nf, unsigned int request_time)
 {
-    char *url;
-    CHUNK *chunk;
-    unsigned int request_time;
-
-    /* If a previous request for this file was recently redirected,
-       use the previous (redirected) URL; otherwise, use the original
-       URL.  (If the system clock moves backwards, the cache is
-       assumed to be out-of-date.) */
-    request_time = www_time();
     if (request_time - nf->redirect_time > REDIRECT_CACHE_TIME) {
 	SFREE(nf->redirect_url);
     }
-    url = (nf->redirect_url ? nf->redirect_url : nf->url);
-
-    chunk = www_get_url_range_chunk(url, startb, len);
+    return (nf->redirect_url ? nf->redirect_url : nf->url);
+}
 
+/* nf_redirected records the URL to which a request for nf (made at
+   request_time) was redirected, if any. */
+static void nf_redirected(netfile *nf, CHUNK *chunk, unsigned int request_time)
+{
     if (chunk && chunk->url) {
 	/* don't update redirect_time if we didn't hit nf->url */
 	if (!nf->redirect_url)
 	    nf->redirect_time = request_time;
 	SSTRCPY(nf->redirect_url, chunk->url);
     }
+}
+
+static CHUNK *nf_get_url_range_chunk(netfile *nf, long startb, long len)
+{
+    CHUNK *chunk;
+    unsigned int request_time = www_time();
+
+    chunk = www_get_url_range_chunk(nf_request_url(nf, request_time),
+				    startb, len);
+    nf_redirected(nf, chunk, request_time);
     return (chunk);
 }
 
+/* The disk cache.  If WFDB_CACHEDIR names a directory, remote files are also
+   saved there as they are read, so that later processes can read them without
+   downloading them again.  The entry for each file consists of files with
+   names beginning with a key computed from its URL:  KEY.meta, which records
+   (on separate lines) the URL; the file's length, the page size, the mode, and
+   the time at which the entry was last checked; and the ETag and Last-Modified
+   validators sent by the server; and KEY.N, which contains page N of the file
+   (in NF_FULL_MODE, KEY.0 contains the entire file).  An entry that was checked
+   less than disk_cache_ttl seconds ago is used as is;  an older one is
+   revalidated by a HEAD request, and discarded if the server's validators no
+   longer match those recorded.
+
+   Since the pages of an entry are fetched at different times, each page file
+   begins with a line containing the validator of the response from which the
+   page was taken (see nf_disk_val).  A page whose validator does not match
+   that of the entry is discarded when it is read, and if the response to a
+   later request for a page does not match, the entire entry is discarded,
+   since the file has changed on the server. */
+
+/* nf_disk_key returns the (allocated) prefix of the names of the files in the
+   disk cache entry for url. */
+static char *nf_disk_key(const char *url)
+{
+    unsigned long h1 = 2166136261UL, h2 = 5381UL;
+    const char *p;
+    char *key = NULL;
+
+    for (p = url; *p; p++) {
+	h1 = ((h1 ^ (*p & 0xff)) * 16777619UL) & 0xffffffffUL;	/* FNV-1a */
+	h2 = ((h2 << 5) + h2 + (*p & 0xff)) & 0xffffffffUL;	/* djb2 */
+    }
+    wfdb_asprintf(&key, "%s/%08lx%08lx", disk_cache_dir, h1, h2);
+    return (key);
+}
+
+/* nf_disk_val returns the (allocated) validator of a response for a file of
+   len bytes with the given ETag and Last-Modified headers (either of which may
+   be NULL).  This consists of the length and the ETag, or the Last-Modified
+   time if there is no ETag. */
+static char *nf_disk_val(long len, const char *etag, const char *modified)
+{
+    char *val = NULL;
+
+    wfdb_asprintf(&val, "%ld %s", len, (etag && *etag) ? etag :
+		  (modified ? modified : ""));
+    return (val);
+}
+
+/* nf_disk_write saves len bytes, starting at data, as key.suffix, preceded
+   by a line containing val (unless val is NULL).  The data are written to a
+   temporary file first, so that other processes never see an incomplete
+   file.  Returns TRUE if successful. */
+static int nf_disk_write(const char *key, const char *suffix, const char *val,
+			 const char *data, long len)
+{
+    char *name = NULL, *tmp = NULL;
+    FILE *fp;
+    int ok = FALSE;
+
+    wfdb_asprintf(&name, "%s.%s", key, suffix);
+    wfdb_asprintf(&tmp, "%s.%s.tmp", key, suffix);
+    if (name && tmp && (fp = fopen(tmp, WB))) {
+	ok = (val == NULL || fprintf(fp, "%s\n", val) > 0) &&
+	    fwrite(data, 1, len, fp) == len;
+	if (fclose(fp) || !ok || rename(tmp, name)) {
+	    (void)remove(tmp);
+	    ok = FALSE;
+	}
+    }
+    SFREE(name);
+    SFREE(tmp);
+    return (ok);
+}
+
+/* nf_disk_read reads key.suffix into data, and returns TRUE if it begins with
+   a line containing val, followed by exactly len bytes.  Otherwise, the file
+   is stale or damaged, and it is removed. */
+static int nf_disk_read(const char *key, const char *suffix, const char *val,
+			char *data, long len)
+{
+    char *name = NULL, *v = NULL;
+    size_t n = strlen(val) + 1;
+    FILE *fp;
+    int ok = FALSE;
+
+    wfdb_asprintf(&name, "%s.%s", key, suffix);
+    SUALLOC(v, n, 1);
+    if (name && v && (fp = fopen(name, RB))) {
+	ok = (fread(v, 1, n, fp) == n && memcmp(v, val, n - 1) == 0 &&
+	      v[n-1] == '\n' && fread(data, 1, len, fp) == len &&
+	      getc(fp) == EOF);
+	fclose(fp);
+	if (!ok)
+	    (void)remove(name);
+    }
+    SFREE(v);
+    SFREE(name);
+    return (ok);
+}
+
+/* nf_disk_page_len returns the length of page p of nf. */
+static long nf_disk_page_len(netfile *nf, long p)
+{
+    if (nf->mode == NF_FULL_MODE || nf->cont_len - p*page_size < page_size)
+	return (nf->cont_len - p*page_size);
+    return (page_size);
+}
+
+/* nf_disk_put_meta records the metadata for nf's disk cache entry. */
+static int nf_disk_put_meta(netfile *nf, const char *etag, const char *modified,
+			    long checked)
+{
+    char *meta = NULL;
+    int ok = FALSE;
+
+    if (wfdb_asprintf(&meta, "%s\n%ld %ld %d %ld\n%s\n%s\n", nf->url,
+		      nf->cont_len, page_size, nf->mode, checked,
+		      etag ? etag : "", modified ? modified : "") > 0)
+	ok = nf_disk_write(nf->cache, "meta", NULL, meta, strlen(meta));
+    SFREE(meta);
+    return (ok);
+}
+
+/* nf_disk_discard removes a disk cache entry (with pages of psize bytes
+   covering len bytes). */
+static void nf_disk_discard(const char *key, long len, long psize)
+{
+    char *name = NULL;
+    long p;
+
+    wfdb_asprintf(&name, "%s.meta", key);
+    if (name)
+	(void)remove(name);
+    for (p = 0; p == 0 || (psize > 0 && p * psize < len); p++) {
+	wfdb_asprintf(&name, "%s.%ld", key, p);
+	if (name)
+	    (void)remove(name);
+    }
+    SFREE(name);
+}
+
+/* nf_disk_open looks for a disk cache entry for nf, revalidating it if
+   necessary.  If the entry is usable, nf_disk_open fills in the length and
+   mode of nf (and, in NF_FULL_MODE, its contents), and returns TRUE. */
+static int nf_disk_open(netfile *nf)
+{
+    char *buf = NULL, *key, *line[4], *p;
+    long checked, len, now = (long)time(NULL), psize, size;
+    int mode, n, valid = FALSE;
+    CHUNK *v;
+    FILE *fp;
+
+    if ((key = nf_disk_key(nf->url)) == NULL)
+	return (FALSE);
+    wfdb_asprintf(&buf, "%s.meta", key);
+    if (buf && (fp = fopen(buf, RB))) {
+	SFREE(buf);
+	if (fseek(fp, 0L, SEEK_END) == 0 && (size = ftell(fp)) > 0) {
+	    SALLOC(buf, size + 1, 1);
+	    rewind(fp);
+	    if (buf && fread(buf, 1, size, fp) != size)
+		SFREE(buf);
+	}
+	fclose(fp);
+    }
+    else
+	SFREE(buf);
+
+    /* Split the metadata into lines, and check that the entry is complete and
+       belongs to this URL (rather than another with the same key). */
+    for (n = 0, p = buf; n < 4 && p; n++) {
+	line[n] = p;
+	if (p = strchr(p, '\n'))
+	    *p++ = '\0';
+    }
+    if (n == 4 && p && strcmp(line[0], nf->url) == 0 &&
+	sscanf(line[1], "%ld %ld %d %ld", &len, &psize, &mode, &checked) == 4){
+	if (psize != page_size || len <= 0L ||
+	    (mode == NF_CHUNK_MODE && page_size <= 0L))
+	    nf_disk_discard(key, len, psize);
+	else if (now - checked < disk_cache_ttl && now >= checked)
+	    valid = TRUE;	/* checked recently */
+	else if (v = www_get_validators(nf->url)) {
+	    if (*line[2] && v->etag && *v->etag)
+		valid = (strcmp(line[2], v->etag) == 0);
+	    else if (*line[3] && v->modified && *v->modified)
+		valid = (strcmp(line[3], v->modified) == 0);
+	    chunk_delete(v);
+	    if (valid)
+		checked = now;
+	    else
+		nf_disk_discard(key, len, psize);
+	}
+    }
+
+    if (valid && (nf->cacheval = nf_disk_val(len, line[2], line[3]))) {
+	nf->cont_len = len;
+	nf->mode = mode;
+	nf->cache = key;
+	key = NULL;
+	if (checked == now)	/* revalidated just now */
+	    (void)nf_disk_put_meta(nf, line[2], line[3], now);
+	if (mode == NF_FULL_MODE) {
+	    SALLOC(nf->data, 1, len);
+	    if (nf->data == NULL ||
+		!nf_disk_read(nf->cache, "0", nf->cacheval, nf->data, len)) {
+		SFREE(nf->data);
+		SFREE(nf->cache);
+		SFREE(nf->cacheval);
+		valid = FALSE;
+	    }
+	}
+    }
+    else
+	valid = FALSE;
+    SFREE(key);
+    SFREE(buf);
+    return (valid);
+}
+
+/* nf_disk_store creates a disk cache entry for nf, containing the first len
+   bytes of nf (data) and the validators from chunk. */
+static void nf_disk_store(netfile *nf, const char *data, long len, CHUNK *chunk)
+{
+    if ((nf->cache = nf_disk_key(nf->url)) &&
+	(!(nf->cacheval = nf_disk_val(nf->cont_len, chunk->etag,
+				      chunk->modified)) ||
+	 !nf_disk_write(nf->cache, "0", nf->cacheval, data, len) ||
+	 !nf_disk_put_meta(nf, chunk->etag, chunk->modified,
+			   (long)time(NULL)))) {
+	nf_disk_discard(nf->cache, len, 0L);
+	SFREE(nf->cache);
+	SFREE(nf->cacheval);
+    }
+}
+
+/* nf_disk_put_page saves page p of nf (len bytes, starting at data) in the
+   disk cache, if the response (chunk) from which it was taken matches the
+   disk cache entry;  otherwise, it discards the entry. */
+static void nf_disk_put_page(netfile *nf, long p, const char *data, long len,
+			     CHUNK *chunk)
+{
+    char suffix[3*sizeof(long) + 2], *val;
+
+    if (nf->cache == NULL)
+	return;
+    val = nf_disk_val(chunk->total_size > 0 ? chunk->total_size : nf->cont_len,
+		      chunk->etag, chunk->modified);
+    if (val && strcmp(val, nf->cacheval) == 0) {
+	sprintf(suffix, "%ld", p);
+	(void)nf_disk_write(nf->cache, suffix, val, data, len);
+    }
+    else {		/* the file has changed since the entry was made */
+	nf_disk_discard(nf->cache, nf->cont_len, page_size);
+	SFREE(nf->cache);
+	SFREE(nf->cacheval);
+    }
+    SFREE(val);
+}
+
+/* Parallel probing.  If WFDB_PROBE is set, wfdb_open (using wfdb_probe_path)
+   passes nf_probe_all the list of remote files that it might need to try,
+   and nf_probe_all requests the first page of each of them concurrently.
+   The responses are kept on the nf_probes list until nf_new uses them, or
+   until a file is opened successfully (at which point any that remain are no
+   longer needed). */
+struct nf_probe {
+    char *url;
+    CHUNK *chunk;		/* response (NULL if the request failed) */
+    long status;		/* HTTP status (0 if no response) */
+    struct nf_probe *next;
+};
+static struct nf_probe *nf_probes;
+
+/* nf_probe_clear discards any unused probe responses. */
+static void nf_probe_clear(void)
+{
+    struct nf_probe *pr;
+
+    while (pr = nf_probes) {
+	nf_probes = pr->next;
+	SFREE(pr->url);
+	chunk_delete(pr->chunk);
+	SFREE(pr);
+    }
+}
+
+static int nf_probe_enabled(void)
+{
+    if (!www_done_init)
+	www_init();
+    return (probe_all && page_size > 0L);
+}
+
+/* nf_probe_all requests the first page of each of the n remote files named by
+   urls concurrently, except for those known not to exist and those in the
+   disk cache. */
+static void nf_probe_all(char **urls, int n)
+{
+    struct www_request *rq;
+    struct nf_probe *pr;
+    char *key, *name = NULL;
+    int i, nrq = 0;
+    FILE *fp;
+
+    nf_probe_clear();
+    SUALLOC(rq, n, sizeof(struct www_request));
+    if (rq == NULL)
+	return;
+    for (i = 0; i < n; i++) {
+	if (nf_missing(urls[i]))
+	    continue;
+	if (disk_cache_dir && (key = nf_disk_key(urls[i]))) {
+	    wfdb_asprintf(&name, "%s.meta", key);
+	    SFREE(key);
+	    if (name && (fp = fopen(name, RB))) {
+		fclose(fp);
+		continue;
+	    }
+	}
+	rq[nrq].url = urls[i];
+	rq[nrq].startb = 0L;
+	rq[nrq].len = page_size;
+	nrq++;
+    }
+    SFREE(name);
+    if (nrq > 1) {
+	www_get_url_ranges(rq, nrq);
+	for (i = nrq - 1; i >= 0; i--) {
+	    SUALLOC(pr, 1, sizeof(struct nf_probe));
+	    if (pr == NULL) {
+		chunk_delete(rq[i].chunk);
+		continue;
+	    }
+	    SSTRCPY(pr->url, rq[i].url);
+	    pr->chunk = rq[i].chunk;
+	    pr->status = rq[i].status;
+	    pr->next = nf_probes;
+	    nf_probes = pr;
+	}
+    }
+    SFREE(rq);
+}
+
+/* nf_probe_take removes the probe response for nf (if any) from the nf_probes
+   list, sets *chunk to point to it, and returns TRUE, or returns FALSE if
+   there is no probe response for nf.  If the probe failed for any reason other
+   than a client error (such as "404 Not Found"), its response is discarded
+   and nf_probe_take returns FALSE, so that the file is requested again in the
+   usual way. */
+static int nf_probe_take(netfile *nf, CHUNK **chunk)
+{
+    struct nf_probe *pr, **pp;
+
+    for (pp = &nf_probes; pr = *pp; pp = &pr->next)
+	if (strcmp(pr->url, nf->url) == 0) {
+	    *pp = pr->next;
+	    if (pr->chunk == NULL && (pr->status < 400 || pr->status >= 500)) {
+		SFREE(pr->url);
+		SFREE(pr);
+		return (FALSE);
+	    }
+	    *chunk = pr->chunk;
+	    www_status = pr->status;
+	    nf_redirected(nf, pr->chunk, www_time());
+	    SFREE(pr->url);
+	    SFREE(pr);
+	    return (TRUE);
+	}
+    return (FALSE);
+}
+
 /* nf_new attempts to read (at least part of) the file named by its
    argument (normally an http:// or ftp:// url).  If page_size is nonzero and
    the file can be read in segments (this will be true for files served by http
@@ -1783,16 +3060,27 @@ static netfile *nf_new(const char* url)
     SUALLOC(nf, 1, sizeof(netfile));
     if (nf && url && *url) {
 	SSTRCPY(nf->url, url);
-	nf->base_addr = 0;
+	nf->pages = NULL;
+	nf->lastpage = 0;
+	nf->seq = FALSE;
+	nf->next = NULL;
 	nf->pos = 0;
 	nf->data = NULL;
 	nf->err = NF_NO_ERR;
 	nf->fd = -1;
 	nf->redirect_url = NULL;
+	nf->cache = nf->cacheval = NULL;
 
-	if (page_size > 0L)
-	    /* Try to read the first part of the file. */
-	    chunk = nf_get_url_range_chunk(nf, 0L, page_size);
+	/* Use the disk cache if possible. */
+	if (disk_cache_dir && nf_disk_open(nf))
+	    return (nf);
+
+	if (page_size > 0L) {
+	    /* Try to read the first part of the file, unless it was requested
+	       already. */
+	    if (!nf_probe_take(nf, &chunk))
+		chunk = nf_get_url_range_chunk(nf, 0L, page_size);
+	}
 	else
 	    /* Try to read the entire file. */
 	    chunk = www_get_url_chunk(nf->url);
@@ -1833,10 +3121,14 @@ static netfile *nf_new(const char* url)
 	    return (NULL);
 	}
 	if (chunk->size > 0L) {
-	    nf->data = chunk->data;
-	    chunk->data = NULL;
+	    if (nf->mode == NF_CHUNK_MODE)
+		(void)nf_page_add(nf, 0L, chunk->data, chunk->size);
+	    else {
+		nf->data = chunk->data;
+		chunk->data = NULL;
+	    }
 	}
-	if (nf->data == NULL) {
+	if (nf->data == NULL && nf->pages == NULL) {
 	    if (chunk->size > 0L)
 		wfdb_error("nf_new: insufficient memory (needed %ld bytes)\n",
 			   chunk->size);
@@ -1850,230 +3142,1642 @@ static netfile *nf_new(const char* url)
 	    nf_delete(nf);
 	    nf = NULL;
 	}
-	if (chunk) chunk_delete(chunk);
+	else if (disk_cache_dir)
+	    nf_disk_store(nf, nf->data ? nf->data : chunk->data, chunk->size,
+			  chunk);
+	if (chunk) chunk_delete(chunk);
+    }
+    return(nf);
+}
+
+/* Find the cached page of nf beginning at addr, if any. */
+static struct nf_page *nf_page_find(netfile *nf, long addr)
+{
+    struct nf_page *pg;
+
+    for (pg = nf->pages; pg; pg = pg->fnext)
+	if (pg->addr == addr)
+	    break;
+    return (pg);
+}
+
+/* nf_disk_get_page reads page p of nf from the disk cache into the memory
+   cache, and returns it, or NULL if it is not in the disk cache. */
+static struct nf_page *nf_disk_get_page(netfile *nf, long p)
+{
+    char *data = NULL, suffix[3*sizeof(long) + 2];
+    struct nf_page *pg = NULL;
+    long len;
+
+    if (nf->cache == NULL || p * page_size >= nf->cont_len)
+	return (NULL);
+    len = nf_disk_page_len(nf, p);
+    sprintf(suffix, "%ld", p);
+    SALLOC(data, 1, len);
+    if (data && nf_disk_read(nf->cache, suffix, nf->cacheval, data, len))
+	pg = nf_page_add(nf, p * page_size, data, len);
+    SFREE(data);
+    return (pg);
+}
+
+/* nf_have_page returns TRUE if page p of nf is in the memory cache or in the
+   disk cache. */
+static int nf_have_page(netfile *nf, long p)
+{
+    char *name = NULL;
+    FILE *fp;
+    int found = FALSE;
+
+    if (nf_page_find(nf, p * page_size))
+	return (TRUE);
+    if (nf->cache) {
+	wfdb_asprintf(&name, "%s.%ld", nf->cache, p);
+	if (name && (fp = fopen(name, RB))) {
+	    found = TRUE;
+	    fclose(fp);
+	}
+	SFREE(name);
+    }
+    return (found);
+}
+
+/* nf_readahead returns the number of pages of nf, starting with page p, to
+   be requested together: page p and up to readahead following pages, but not
+   past the end of the file, past the next cached page, or beyond the capacity
+   of the cache. */
+static long nf_readahead(netfile *nf, long p)
+{
+    long n;
+
+    for (n = 1; n <= readahead && (p + n) * page_size < nf->cont_len &&
+	     (n + 1) * page_size <= cache_size; n++)
+	if (nf_have_page(nf, p + n))
+	    break;
+    return (n);
+}
+
+/* nf_request fills in a request for npages pages of nf, starting with page
+   p. */
+static void nf_request(struct www_request *r, netfile *nf, long p, long npages,
+		       unsigned int request_time)
+{
+    r->nf = nf;
+    r->page = p;
+    r->npages = npages;
+    r->url = nf_request_url(nf, request_time);
+    r->startb = p * page_size;
+    r->len = npages * page_size;
+    if (r->startb + r->len > nf->cont_len)
+	r->len = nf->cont_len - r->startb;
+}
+
+/* nf_prefetch returns the first page of nf that should be requested now, in
+   parallel with a request for another file, or -1 if there is none.  This is
+   the case if nf is being read sequentially and at most half of its readahead
+   pages remain in the cache ahead of the page that was read last. */
+static long nf_prefetch(netfile *nf)
+{
+    long p;
+
+    if (nf->mode != NF_CHUNK_MODE || !nf->seq || readahead == 0)
+	return (-1L);
+    for (p = nf->lastpage + 1; p * page_size < nf->cont_len; p++)
+	if (!nf_have_page(nf, p))
+	    break;
+	else if (p - nf->lastpage > readahead / 2)
+	    return (-1L);
+    return (p * page_size < nf->cont_len ? p : -1L);
+}
+
+/* nf_get_page returns page p (the page beginning at byte p*page_size) of a
+   file in NF_CHUNK_MODE, reading it if it is not in the cache. */
+static struct nf_page *nf_get_page(netfile *nf, long p)
+{
+    CHUNK *chunk;
+    netfile *f;
+    struct nf_page *pg, *result = NULL;
+    struct www_request *rq, *r;
+    long addr = p * page_size, bytes, i, len, q;
+    int n, nrq;
+    unsigned int request_time;
+
+    if ((pg = nf_page_find(nf, addr)) || (pg = nf_disk_get_page(nf, p))) {
+	/* Move the page to the front of the cache. */
+	if (pg != nf_mru) {
+	    pg->prev->next = pg->next;
+	    if (pg->next) pg->next->prev = pg->prev;
+	    else nf_lru = pg->prev;
+	    pg->prev = NULL;
+	    pg->next = nf_mru;
+	    nf_mru->prev = pg;
+	    nf_mru = pg;
+	}
+	if (p != nf->lastpage)
+	    nf->seq = (p == nf->lastpage + 1);
+	nf->lastpage = p;
+	WFDB_COUNT(page_hits, 1);
+	return (pg);
+    }
+    WFDB_COUNT(page_misses, 1);
+
+    /* Request page p, and if the previous read was from the preceding page,
+       the pages that follow it.  While waiting, also fetch the next pages of
+       other files that are being read sequentially, as long as the total
+       will fit in the cache. */
+    SUALLOC(rq, max_connections, sizeof(struct www_request));
+    if (rq == NULL)
+	return (NULL);
+    request_time = www_time();
+    if (p != nf->lastpage)
+	nf->seq = (p == nf->lastpage + 1);
+    nf_request(&rq[0], nf, p, nf->seq ? nf_readahead(nf, p) : 1L,
+	       request_time);
+    bytes = rq[0].len;
+    for (f = nf_list, nrq = 1; f && nrq < max_connections; f = f->next)
+	if (f != nf && (q = nf_prefetch(f)) >= 0L) {
+	    nf_request(&rq[nrq], f, q, nf_readahead(f, q), request_time);
+	    if (bytes + rq[nrq].len <= cache_size)
+		bytes += rq[nrq++].len;
+	}
+    www_get_url_ranges(rq, nrq);
+
+    /* Add the pages to the cache, leaving page p as the most recently used.
+       Pages that could not be fetched in advance will be requested again
+       when needed. */
+    for (r = rq + nrq - 1; r >= rq; r--) {
+	if ((chunk = r->chunk) == NULL) {
+	    if (r == rq)
+		wfdb_error(
+		  "nf_get_range: couldn't read %ld bytes of %s starting at %ld\n",
+		  r->len, nf->url, addr);
+	    continue;
+	}
+	nf_redirected(r->nf, chunk, request_time);
+	if (chunk_size(chunk) != r->len) {
+	    if (r == rq)
+		wfdb_error(
+		    "nf_get_range: requested %ld bytes, received %ld bytes\n",
+		    r->len, (long)chunk_size(chunk));
+	}
+	else {
+	    n = r->npages;
+	    for (i = n - 1; i >= 0; i--) {
+		len = (i < n - 1) ? page_size : r->len - i*page_size;
+		pg = nf_page_add(r->nf, r->startb + i * page_size,
+				 chunk_data(chunk) + i * page_size, len);
+		nf_disk_put_page(r->nf, r->page + i,
+				 chunk_data(chunk) + i * page_size, len, chunk);
+	    }
+	    if (r == rq) {
+		nf->lastpage = p;
+		result = pg;
+	    }
+	}
+	chunk_delete(chunk);
+    }
+    SFREE(rq);
+    return (result);
+}
+
+static long nf_get_range(netfile* nf, long startb, long len, char *rbuf)
+{
+    struct nf_page *pg;
+    long avail, count, n, offset;
+    WFDB_TRACE_FUNCTION("nf_get_range");
+
+    if (nf == NULL || nf->url == NULL || *nf->url == '\0' ||
+	startb < 0L || startb >= nf->cont_len || len <= 0L || rbuf == NULL)
+	return (0L);	/* invalid inputs -- fail silently */
+    avail = nf->cont_len - startb;
+    if (len > avail) len = avail;	/* limit request to available bytes */
+
+    if (nf->mode == NF_CHUNK_MODE) {	/* range requests acceptable */
+	for (count = 0L; count < len; count += n) {
+	    if ((pg = nf_get_page(nf, (startb + count) / page_size)) == NULL)
+		break;
+	    offset = startb + count - pg->addr;
+	    if ((n = pg->len - offset) > len - count)
+		n = len - count;
+	    if (n <= 0L)
+		break;
+	    memcpy(rbuf + count, pg->data + offset, n);
+	}
+	return (count);
+    }
+
+    /* cannot use range requests -- nf->data contains the full file */
+    memcpy(rbuf, nf->data + startb, len);
+    return (len);
+}
+
+/* nf_feof returns true after reading past the end of a file but before
+   repositioning the pos in the file. */
+static int nf_feof(netfile *nf)
+{
+    return ((nf->err == NF_EOF_ERR) ? TRUE : FALSE);
+}
+
+/* nf_eof returns true if the file pointer is at the EOF. */
+static int nf_eof(netfile *nf)
+{
+    return (nf->pos >= nf->cont_len) ? TRUE : FALSE;
+}
+
+static netfile* nf_fopen(const char *url, const char *mode)
+{
+    netfile* nf = NULL;
+
+    if (!www_done_init)
+	www_init();
+    if (*mode == 'w' || *mode == 'a')
+	errno = EROFS;	/* no support for output */
+    else if (*mode != 'r')
+	errno = EINVAL;	/* invalid mode string */
+    else if (nf_missing(url))
+	errno = ENOENT;	/* known not to exist */
+    else if (nf = nf_new(url)) {
+	nf->next = nf_list;
+	nf_list = nf;
+	nf_open_files++;
+	nf_probe_clear();	/* the search (if any) is over */
+    }
+    else if (www_status == 404 || www_status == 410)
+	nf_add_miss(url);
+    return (nf);
+}
+
+static int nf_fclose(netfile* nf)
+{
+    netfile **fp;
+
+    for (fp = &nf_list; *fp; fp = &(*fp)->next)
+	if (*fp == nf) {
+	    *fp = nf->next;
+	    break;
+	}
+    nf_delete(nf);
+    nf_open_files--;
+    return (0);
+}
+
+static int nf_fgetc(netfile *nf)
+{
+    char c;
+
+    if (nf_get_range(nf, nf->pos++, 1, &c))
+	return (c & 0xff);
+    nf->err = (nf->pos >= nf->cont_len) ? NF_EOF_ERR : NF_REAL_ERR;
+    return (EOF);
+}
+
+static char* nf_fgets(char *s, int size, netfile *nf)
+{
+    int c = 0, i = 0; 
+
+    if (s == NULL) return (NULL);
+    while (c != '\n' && i < (size-1) && (c = nf_fgetc(nf)) != EOF)
+	s[i++] = c;
+    if ((c == EOF) && (i == 0))	return (NULL);
+    s[i] = 0;
+    return (s);
+}
+
+static size_t nf_fread(void *ptr, size_t size, size_t nmemb, netfile *nf)
+{
+    long bytes_available, bytes_read = 0L, bytes_requested = size * nmemb;
+
+    if (nf == NULL || ptr == NULL || bytes_requested == 0) return ((size_t)0);
+    bytes_available = nf->cont_len - nf->pos;
+    if (bytes_requested > bytes_available) bytes_requested = bytes_available;
+    if (bytes_requested > page_size && page_size) bytes_requested = page_size;
+    nf->pos += bytes_read = nf_get_range(nf, nf->pos, bytes_requested, ptr);
+    return ((size_t)(bytes_read / size));
+}
+
+static int nf_fseek(netfile* nf, long offset, int whence)
+{
+  int ret = -1;
+
+  if (nf)
+    switch (whence) {
+      case SEEK_SET:
+	if (offset >= 0 && offset <= nf->cont_len) {
+	  nf->pos = offset;
+	  nf->err = NF_NO_ERR;
+	  ret = 0;
+	}
+	break;
+      case SEEK_CUR:
+	if (((unsigned long) nf->pos + offset) <= nf->cont_len) {
+	  nf->pos += offset;
+	  nf->err = NF_NO_ERR;
+	  ret = 0;
+	}
+	break;
+      case SEEK_END:
+	if (offset <= 0 && offset >= -nf->cont_len) {
+	  nf->pos = nf->cont_len + offset;
+	  nf->err = NF_NO_ERR;
+	  ret = 0; 
+	}
+	break;
+      default:
+	break;
+    }
+  return (ret);
+}
+
+static long nf_ftell(netfile *nf)
+{
+    return (nf->pos);
+}
+
+static int nf_ferror(netfile *nf)
+{
+    return ((nf->err == NF_REAL_ERR) ? TRUE : FALSE);
+}
+
+static void nf_clearerr(netfile *nf)
+{
+    nf->err = NF_NO_ERR;
+}
+
+static int nf_fflush(netfile *nf)
+{
+    /* no support yet for writing to remote files */
+    errno = EROFS;
+    return (EOF);
+}
+
+static size_t nf_fwrite(const void *ptr, size_t size, size_t nmemb,netfile *nf)
+{
+    /* no support yet for writing to remote files */
+    errno = EROFS;
+    return (0);
+}
+
+static int nf_putc(int c, netfile *nf)
+{
+    /* no support yet for writing to remote files */
+    errno = EROFS;
+    return (EOF);
+}
+
+#else	/* !WFDB_NETFILES */
+# define nf_feof(nf)                      (0)
+# define nf_fgetc(nf)                     (EOF)
+# define nf_fgets(s, size, nf)            (NULL)
+# define nf_fread(ptr, size, nmemb, nf)   (0)
+# define nf_fseek(nf, offset, whence)     (-1)
+# define nf_ftell(nf)                     (-1)
+# define nf_ferror(nf)                    (0)
+# define nf_clearerr(nf)                  ((void) 0)
+# define nf_fflush(nf)                    (EOF)
+# define nf_fwrite(ptr, size, nmemb, nf)  (0)
+# define nf_putc(c, nf)                   (EOF)
+#endif
+
+/* Compressed input files
+
+If an input file cannot be found under the name constructed by wfdb_open, it
+looks for a copy of the file compressed by gzip (with ".gz" appended to its
+name) or by zstd (".zst") in the same directory, before going on to the next
+component of the WFDB path.  A compressed file, whether local or remote, is
+decompressed as it is read, so that the rest of the library sees only the
+original (uncompressed) contents.  Compressed files are read-only.
+
+Seeking is supported, but seeking forward in a compressed file generally
+requires decompressing all of the intervening data.  While a file is being
+decompressed, "access points" are recorded at intervals of ZF_SPAN bytes of
+output (for gzip files, each of these includes the 32K bytes of output that
+precede it, which are needed to resume decoding there);  a later seek to an
+earlier position resumes decoding from the nearest access point preceding
+it, rather than from the beginning of the file.
+
+A zstd file in the "seekable" format (a sequence of independently compressed
+frames followed by a seek table, as written by 'zstd --seekable' or by
+programs using the zstd seekable format library) needs no such help:  the seek
+table is read when the file is opened, and becomes the list of access points,
+so that a seek in either direction decompresses only part of a single frame.
+This makes it practical to use isigsettime and iannsettime with such files.
+*/
+
+#ifdef WFDB_COMPRESSION
+#ifdef WFDB_GZIP_SUPPORT
+#include <zlib.h>
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
+#define ZF_GZIP		1	/* gzip (or zlib) format */
+#define ZF_ZSTD		2	/* Zstandard format */
+#define ZF_INSIZE	16384	/* size of input (compressed data) buffer */
+#define ZF_OUTSIZE	131072	/* size of output (uncompressed data) buffer */
+#define ZF_WINSIZE	32768	/* size of history retained in output buffer */
+#define ZF_SPAN		1048576L /* minimum spacing of recorded access points */
+#define ZF_SEEKABLE	0x8F92EAB1UL	/* zstd seekable format magic number */
+#define ZF_SKIPPABLE	0x184D2A5EUL	/* magic number of zstd seek table */
+
+struct zf_point {
+    long out;		/* offset of access point in uncompressed data */
+    long in;		/* offset of access point in compressed data */
+    int bits;		/* (gzip) number of bits of data[in-1] to be used */
+    int wsize;		/* (gzip) length of window */
+    unsigned char *window;	/* (gzip) data preceding access point */
+};
+
+struct wfdb_zfile {
+    WFDB_FILE *src;	/* the compressed file */
+    int format;		/* ZF_GZIP or ZF_ZSTD */
+    int eof;		/* TRUE if an attempt was made to read past the end */
+    int err;		/* TRUE if a read or decoding error has occurred */
+    int done;		/* TRUE if the end of the compressed data was reached */
+    int idle;		/* TRUE if the decoder is between streams or frames */
+    int raw;		/* (gzip) TRUE if decoding raw deflate data */
+    int skip;		/* (gzip) number of trailer bytes yet to be skipped */
+    long pos;		/* current position in uncompressed data */
+    long size;		/* length of uncompressed data (-1 if unknown) */
+    long zin;		/* offset in compressed data of the end of in[] */
+    long zout;		/* offset in uncompressed data of the end of out[] */
+    unsigned char *in;	/* input buffer (compressed data) */
+    long inlen, inpos;	/* number of bytes in in[], number of them used */
+    unsigned char *out;	/* output buffer (uncompressed data) */
+    long outlen;	/* number of bytes in out[] */
+    struct zf_point *point;	/* access points, in order of position */
+    int npoints, maxpoints;	/* number of access points, allocated length */
+#ifdef WFDB_GZIP_SUPPORT
+    z_stream zs;
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+    ZSTD_DStream *zd;
+#endif
+};
+
+/* zf_add_point records an access point.  Access points are recorded in order
+   of increasing 'out' (but see zf_decode, which records them only when
+   decoding beyond the last one). */
+static void zf_add_point(struct wfdb_zfile *zf, long out, long in, int bits,
+			 const unsigned char *window, int wsize)
+{
+    struct zf_point *pt;
+
+    if (zf->npoints >= zf->maxpoints) {
+	zf->maxpoints = zf->maxpoints ? 2*zf->maxpoints : 16;
+	SREALLOC(zf->point, zf->maxpoints, sizeof(struct zf_point));
+    }
+    pt = &zf->point[zf->npoints++];
+    pt->out = out;
+    pt->in = in;
+    pt->bits = bits;
+    pt->wsize = wsize;
+    pt->window = NULL;
+    if (wsize > 0) {
+	SALLOC(pt->window, wsize, 1);
+	memcpy(pt->window, window, wsize);
+    }
+}
+
+/* zf_find_point returns the last access point at or before offset 'out' in
+   the uncompressed data, or NULL if there is none (in which case decoding
+   must begin at the start of the file). */
+static struct zf_point *zf_find_point(struct wfdb_zfile *zf, long out)
+{
+    int lo = 0, hi = zf->npoints, mid;
+
+    while (lo < hi) {
+	mid = (lo + hi)/2;
+	if (zf->point[mid].out <= out) lo = mid + 1;
+	else hi = mid;
+    }
+    return (lo > 0 ? &zf->point[lo-1] : NULL);
+}
+
+/* zf_restart prepares the decoder to resume at access point pt (or at the
+   start of the file, if pt is NULL).  It returns 0 if successful, or -1 if
+   the underlying file could not be repositioned. */
+static int zf_restart(struct wfdb_zfile *zf, struct zf_point *pt)
+{
+    long in = pt ? pt->in : 0L;
+    int c = 0;
+
+    if (pt && pt->bits) in--;
+    if (wfdb_fseek(zf->src, in, SEEK_SET) ||
+	(pt && pt->bits && (c = wfdb_getc(zf->src)) == EOF)) {
+	zf->err = TRUE;
+	return (-1);
+    }
+    if (pt && pt->bits) in++;
+    zf->zin = in;
+    zf->inlen = zf->inpos = 0;
+    zf->zout = pt ? pt->out : 0L;
+    zf->outlen = 0;
+    zf->done = zf->err = zf->skip = 0;
+    zf->idle = TRUE;
+#ifdef WFDB_GZIP_SUPPORT
+    if (zf->format == ZF_GZIP) {
+	if (pt == NULL) {
+	    inflateReset2(&zf->zs, 47);	/* gzip or zlib header expected */
+	    zf->raw = FALSE;
+	}
+	else {
+	    inflateReset2(&zf->zs, -15);	/* raw deflate data follows */
+	    zf->raw = TRUE;
+	    zf->idle = FALSE;
+	    if (pt->bits)
+		inflatePrime(&zf->zs, pt->bits, c >> (8 - pt->bits));
+	    inflateSetDictionary(&zf->zs, pt->window, pt->wsize);
+	    memcpy(zf->out, pt->window, pt->wsize);
+	    zf->outlen = pt->wsize;
+	}
+    }
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+    if (zf->format == ZF_ZSTD)
+	ZSTD_DCtx_reset(zf->zd, ZSTD_reset_session_only);
+#endif
+    return (0);
+}
+
+#ifdef WFDB_GZIP_SUPPORT
+/* zf_gzip_step decodes gzip data from in[] into out[], and returns the
+   number of bytes of output produced. */
+static long zf_gzip_step(struct wfdb_zfile *zf)
+{
+    z_stream *zs = &zf->zs;
+    long n;
+    int status;
+
+    /* Skip the trailer of a member that was decoded as raw deflate data,
+       then get ready for another member, if any. */
+    for ( ; zf->skip > 0 && zf->inpos < zf->inlen; zf->skip--)
+	zf->inpos++;
+    if (zf->skip > 0 || zf->inpos == zf->inlen)
+	return (0);
+    if (zf->idle) {
+	if (zf->raw) {
+	    inflateReset2(zs, 47);
+	    zf->raw = FALSE;
+	}
+	zf->idle = FALSE;
+    }
+
+    zs->next_in = zf->in + zf->inpos;
+    zs->avail_in = zf->inlen - zf->inpos;
+    zs->next_out = zf->out + zf->outlen;
+    zs->avail_out = ZF_OUTSIZE - zf->outlen;
+    status = inflate(zs, Z_BLOCK);
+    zf->inpos = zf->inlen - zs->avail_in;
+    n = ZF_OUTSIZE - zf->outlen - zs->avail_out;
+    zf->outlen += n;
+    zf->zout += n;
+    if (status == Z_STREAM_END) {
+	/* This is the end of a gzip member, but another may follow. */
+	if (zf->raw) zf->skip = 8;
+	else inflateReset(zs);
+	zf->idle = TRUE;
+    }
+    else if (status != Z_OK && status != Z_BUF_ERROR) {
+	wfdb_error("wfdb_fread: error decoding gzip data (%s)\n",
+		   zs->msg ? zs->msg : "invalid data");
+	zf->err = TRUE;
+    }
+    /* If a deflate block has just ended, and the last access point is far
+       enough behind, record a new one here. */
+    else if ((zs->data_type & 128) && !(zs->data_type & 64) &&
+	     zf->zout - (zf->npoints ? zf->point[zf->npoints-1].out : 0L) >=
+	     ZF_SPAN) {
+	long w = zf->outlen < ZF_WINSIZE ? zf->outlen : ZF_WINSIZE;
+
+	zf_add_point(zf, zf->zout, zf->zin - (zf->inlen - zf->inpos),
+		     zs->data_type & 7, zf->out + zf->outlen - w, (int)w);
+    }
+    return (n);
+}
+#endif
+
+#ifdef WFDB_ZSTD_SUPPORT
+/* zf_zstd_step decodes zstd data from in[] into out[], and returns the
+   number of bytes of output produced. */
+static long zf_zstd_step(struct wfdb_zfile *zf)
+{
+    ZSTD_inBuffer ib;
+    ZSTD_outBuffer ob;
+    size_t status;
+    long n;
+
+    if (zf->inpos == zf->inlen)
+	return (0);
+    ib.src = zf->in;
+    ib.size = zf->inlen;
+    ib.pos = zf->inpos;
+    ob.dst = zf->out;
+    ob.size = ZF_OUTSIZE;
+    ob.pos = zf->outlen;
+    status = ZSTD_decompressStream(zf->zd, &ob, &ib);
+    zf->inpos = ib.pos;
+    n = ob.pos - zf->outlen;
+    zf->outlen += n;
+    zf->zout += n;
+    if (ZSTD_isError(status)) {
+	wfdb_error("wfdb_fread: error decoding zstd data (%s)\n",
+		   ZSTD_getErrorName(status));
+	zf->err = TRUE;
+    }
+    else if ((zf->idle = (status == 0)) &&
+	     zf->zout - (zf->npoints ? zf->point[zf->npoints-1].out : 0L) >=
+	     ZF_SPAN)
+	/* Any frame boundary can serve as an access point. */
+	zf_add_point(zf, zf->zout, zf->zin - (zf->inlen - zf->inpos), 0,
+		     NULL, 0);
+    return (n);
+}
+#endif
+
+/* zf_decode appends the next part of the uncompressed data to out[], after
+   discarding all but the last ZF_WINSIZE bytes of its previous contents.  It
+   returns the number of bytes appended, or 0 at the end of the data or if an
+   error occurs. */
+static long zf_decode(struct wfdb_zfile *zf)
+{
+    long n = 0;
+
+    if (zf->outlen > ZF_WINSIZE) {
+	memmove(zf->out, zf->out + zf->outlen - ZF_WINSIZE, ZF_WINSIZE);
+	zf->outlen = ZF_WINSIZE;
+    }
+    while (n == 0 && !zf->done && !zf->err) {
+	if (zf->inpos == zf->inlen) {
+	    zf->inlen = wfdb_fread(zf->in, 1, ZF_INSIZE, zf->src);
+	    zf->inpos = 0;
+	    zf->zin += zf->inlen;
+	    if (zf->inlen == 0) {
+		if (wfdb_ferror(zf->src)) {
+		    wfdb_error("wfdb_fread: error reading compressed data\n");
+		    zf->err = TRUE;
+		}
+		else if (!zf->idle || zf->skip > 0) {
+		    wfdb_error("wfdb_fread: compressed data are truncated\n");
+		    zf->err = TRUE;
+		}
+		zf->done = TRUE;
+		break;
+	    }
+	}
+#ifdef WFDB_GZIP_SUPPORT
+	if (zf->format == ZF_GZIP)
+	    n = zf_gzip_step(zf);
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+	if (zf->format == ZF_ZSTD)
+	    n = zf_zstd_step(zf);
+#endif
+    }
+    return (n);
+}
+
+#ifdef WFDB_ZSTD_SUPPORT
+static unsigned long zf_get32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+	    ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24));
+}
+
+/* zf_zstd_seektable reads the seek table of a zstd file in the seekable
+   format, if there is one, and records the beginning of each frame as an
+   access point. */
+static void zf_zstd_seektable(struct wfdb_zfile *zf)
+{
+    unsigned char footer[9], *table = NULL, *p;
+    unsigned long i, nframes, esize;
+    long in = 0L, out = 0L, tlen;
+
+    if (wfdb_fseek(zf->src, -9L, SEEK_END) == 0 &&
+	wfdb_fread(footer, 1, 9, zf->src) == 9 &&
+	zf_get32(footer + 5) == ZF_SEEKABLE && (footer[4] & 0x7c) == 0 &&
+	(nframes = zf_get32(footer)) > 0 && nframes < LONG_MAX/12) {
+	esize = (footer[4] & 0x80) ? 12 : 8;	/* checksums present? */
+	tlen = nframes * esize;
+	SUALLOC(table, tlen + 8, 1);
+	if (wfdb_fseek(zf->src, -(tlen + 17), SEEK_END) == 0 &&
+	    wfdb_fread(table, 1, tlen + 8, zf->src) == tlen + 8 &&
+	    zf_get32(table) == ZF_SKIPPABLE &&
+	    zf_get32(table + 4) == tlen + 9) {
+	    for (i = 0, p = table + 8; i < nframes; i++, p += esize) {
+		if (i > 0)
+		    zf_add_point(zf, out, in, 0, NULL, 0);
+		in += zf_get32(p);
+		out += zf_get32(p + 4);
+	    }
+	    zf->size = out;
+	}
+	SFREE(table);
+    }
+    wfdb_clearerr(zf->src);
+}
+#endif
+
+/* zf_open prepares to decompress an open file, and returns a pointer to a
+   WFDB_FILE from which its uncompressed contents can be read. */
+static WFDB_FILE *zf_open(WFDB_FILE *src, int format)
+{
+    struct wfdb_zfile *zf;
+    WFDB_FILE *wp;
+
+    SUALLOC(zf, 1, sizeof(struct wfdb_zfile));
+    zf->src = src;
+    zf->format = format;
+    zf->size = -1L;
+    SUALLOC(zf->in, ZF_INSIZE, 1);
+    SUALLOC(zf->out, ZF_OUTSIZE, 1);
+#ifdef WFDB_GZIP_SUPPORT
+    if (format == ZF_GZIP && inflateInit2(&zf->zs, 47) != Z_OK) {
+	wfdb_error("wfdb_open: can't initialize gzip decoder\n");
+	zf->err = TRUE;
+    }
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+    if (format == ZF_ZSTD) {
+	if ((zf->zd = ZSTD_createDStream()) == NULL) {
+	    wfdb_error("wfdb_open: can't initialize zstd decoder\n");
+	    zf->err = TRUE;
+	}
+	else
+	    zf_zstd_seektable(zf);
+    }
+#endif
+    if (zf->err || zf_restart(zf, NULL)) {
+#ifdef WFDB_GZIP_SUPPORT
+	if (format == ZF_GZIP) inflateEnd(&zf->zs);
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+	if (zf->zd) ZSTD_freeDStream(zf->zd);
+#endif
+	SFREE(zf->in);
+	SFREE(zf->out);
+	SFREE(zf);
+	return (NULL);
+    }
+    SUALLOC(wp, 1, sizeof(WFDB_FILE));
+    wp->type = WFDB_COMPRESSED;
+    wp->zfp = zf;
+    return (wp);
+}
+
+static int zf_close(struct wfdb_zfile *zf)
+{
+    int i, status = wfdb_fclose(zf->src);
+
+#ifdef WFDB_GZIP_SUPPORT
+    if (zf->format == ZF_GZIP) inflateEnd(&zf->zs);
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+    if (zf->zd) ZSTD_freeDStream(zf->zd);
+#endif
+    for (i = 0; i < zf->npoints; i++)
+	SFREE(zf->point[i].window);
+    SFREE(zf->point);
+    SFREE(zf->in);
+    SFREE(zf->out);
+    SFREE(zf);
+    return (status);
+}
+
+static int zf_feof(struct wfdb_zfile *zf)
+{
+    return (zf->eof);
+}
+
+static int zf_ferror(struct wfdb_zfile *zf)
+{
+    return (zf->err);
+}
+
+static void zf_clearerr(struct wfdb_zfile *zf)
+{
+    zf->eof = zf->err = FALSE;
+}
+
+static long zf_ftell(struct wfdb_zfile *zf)
+{
+    return (zf->pos);
+}
+
+static size_t zf_fread(void *ptr, size_t size, size_t nmemb,
+		       struct wfdb_zfile *zf)
+{
+    size_t n, total = size * nmemb, count = 0;
+
+    while (count < total) {
+	if (zf->pos >= zf->zout && zf_decode(zf) == 0) {
+	    zf->eof = TRUE;
+	    break;
+	}
+	if ((n = zf->zout - zf->pos) > total - count)
+	    n = total - count;
+	memcpy((char *)ptr + count, zf->out + zf->outlen - (zf->zout-zf->pos),
+	       n);
+	zf->pos += n;
+	count += n;
+    }
+    return (size ? count / size : 0);
+}
+
+static int zf_fgetc(struct wfdb_zfile *zf)
+{
+    if (zf->pos >= zf->zout && zf_decode(zf) == 0) {
+	zf->eof = TRUE;
+	return (EOF);
+    }
+    return (zf->out[zf->outlen - (zf->zout - zf->pos++)]);
+}
+
+static char *zf_fgets(char *s, int size, struct wfdb_zfile *zf)
+{
+    int c = 0, i = 0;
+
+    while (i < size - 1 && c != '\n' && (c = zf_fgetc(zf)) != EOF)
+	s[i++] = c;
+    if (i == 0 || zf->err)
+	return (NULL);
+    s[i] = '\0';
+    return (s);
+}
+
+static int zf_fseek(struct wfdb_zfile *zf, long offset, int whence)
+{
+    struct zf_point *pt;
+
+    switch (whence) {
+      case SEEK_SET:
+	break;
+      case SEEK_CUR:
+	offset += zf->pos;
+	break;
+      case SEEK_END:
+	/* If the length of the uncompressed data is unknown, the only way
+	   to find it is to decode everything. */
+	if (zf->size < 0) {
+	    while (zf_decode(zf) > 0)
+		;
+	    if (zf->err)
+		return (-1);
+	    zf->size = zf->zout;
+	}
+	offset += zf->size;
+	break;
+      default:
+	errno = EINVAL;
+	return (-1);
+    }
+    if (offset < 0) {
+	errno = EINVAL;
+	return (-1);
+    }
+    zf->eof = FALSE;
+    /* Unless the desired position is in the output buffer, or not far ahead
+       of it, restart decoding from the nearest preceding access point. */
+    if (offset < zf->zout - zf->outlen ||
+	(offset > zf->zout && (pt = zf_find_point(zf, offset)) &&
+	 pt->out > zf->zout)) {
+	if (zf_restart(zf, zf_find_point(zf, offset)))
+	    return (-1);
+    }
+    while (offset > zf->zout && zf_decode(zf) > 0)
+	;
+    zf->pos = offset;
+    return (zf->err ? -1 : 0);
+}
+
+/* wfdb_zopen looks for a compressed copy of the named file, and if one is
+   found, opens it for reading.  In this case, wfdb_filename is set to the name
+   of the compressed file. */
+static WFDB_FILE *wfdb_zopen(const char *fname)
+{
+    static struct { char *suffix; int format; } ztype[] = {
+#ifdef WFDB_GZIP_SUPPORT
+	{ ".gz", ZF_GZIP },
+#endif
+#ifdef WFDB_ZSTD_SUPPORT
+	{ ".zst", ZF_ZSTD },
+#endif
+    };
+    WFDB_FILE *src, *wp;
+    int i;
+
+    for (i = 0; i < sizeof(ztype)/sizeof(ztype[0]); i++) {
+	wfdb_asprintf(&wfdb_filename, "%s%s", fname, ztype[i].suffix);
+	if (wfdb_filename && (src = wfdb_fopen(wfdb_filename, RB))) {
+	    if (wp = zf_open(src, ztype[i].format))
+		return (wp);
+	    wfdb_fclose(src);
+	}
+    }
+    return (NULL);
+}
+
+#else	/* !WFDB_COMPRESSION */
+# define zf_feof(zf)                      (0)
+# define zf_ferror(zf)                    (0)
+# define zf_clearerr(zf)                  ((void) 0)
+# define zf_ftell(zf)                     (-1)
+# define zf_close(zf)                     (EOF)
+# define zf_fgetc(zf)                     (EOF)
+# define zf_fgets(s, size, zf)            (NULL)
+# define zf_fread(ptr, size, nmemb, zf)   (0)
+# define zf_fseek(zf, offset, whence)     (-1)
+#endif
+
+/* Custom I/O backends
+
+A WFDB application can supply its own functions for reading (and optionally
+writing) files, by filling in a WFDB_Backend structure (see <wfdb/wfdb.h>) and
+registering it using wfdb_register_backend, together with a URL scheme name
+such as "spiffs".  Files with names that begin with the scheme name followed
+by "://" (such as "spiffs://db/100.hea") are then accessed using the backend's
+functions, which receive the complete file name.  WFDB path components that
+begin in the same way are searched like other path components;  thus an
+embedded application might set the WFDB path to "spiffs://db" in order to read
+records stored in a flash filesystem.
+
+The open and close functions are always required, and read is required unless
+map is supplied;  the others may be NULL if the backend does not support the
+corresponding operations (in which case wfdb_fseek, etc., fail).  Files that
+are read using a backend's read function are read in blocks of BK_BUFSIZE
+bytes.  If a backend's map function returns a pointer to the entire contents
+of a file opened for reading, however, the WFDB library reads the file
+directly from memory, without calling the backend's read, seek, or tell
+functions;  the signal file readers in signal.c also use such files as their
+input buffers, so that samples are decoded without copying them.
+
+The built-in "mem" backend makes blocks of memory registered using wfdb_memfile
+available as read-only files.  For example, if a program registers the
+contents of record 100's header and signal files as "db/100.hea" and
+"db/100.dat", and sets the WFDB path to "mem://db", isigopen("100", ...) reads
+them directly from the program's memory.  wfdb_memfile does not copy the data,
+which must remain valid until the file is unregistered.
+*/
+
+#define BK_BUFSIZE	4096	/* size of read buffer for unmapped files */
+
+struct wfdb_backend_entry {
+    char *scheme;		/* URL scheme (the part before "://") */
+    WFDB_Backend backend;	/* I/O functions */
+    struct wfdb_backend_entry *next;
+};
+static struct wfdb_backend_entry *wfdb_backends;
+
+struct wfdb_bfile {
+    WFDB_Backend b;	/* backend's I/O functions */
+    void *file;		/* backend's handle for the file */
+    const char *map;	/* contents of mapped file (NULL if not mapped) */
+    long size;		/* length of mapped file */
+    long pos;		/* current position in mapped file */
+    char *buf;		/* read buffer (for files that are not mapped) */
+    long bufpos, buflen;	/* next unread byte, number of bytes in buf */
+    int eof, err;	/* end-of-file and error indicators */
+};
+
+/* In-memory files (for the built-in "mem" backend) */
+static struct wfdb_memfile {
+    char *name;		/* file name, without "mem://" */
+    const char *data;	/* file contents */
+    long size;		/* length of data */
+    struct wfdb_memfile *next;
+} *wfdb_memfiles;
+
+static void *mem_open(void *context, const char *name, const char *mode)
+{
+    struct wfdb_memfile *m;
+
+    if (*mode != 'r') {
+	errno = EROFS;
+	return (NULL);
+    }
+    name += strlen("mem://");
+    for (m = wfdb_memfiles; m; m = m->next)
+	if (strcmp(m->name, name) == 0)
+	    return (m);
+    errno = ENOENT;
+    return (NULL);
+}
+
+static const void *mem_map(void *file, long *size)
+{
+    struct wfdb_memfile *m = file;
+
+    *size = m->size;
+    return (m->data);
+}
+
+static long mem_size(void *file)
+{
+    return (((struct wfdb_memfile *)file)->size);
+}
+
+static int mem_close(void *file)
+{
+    return (0);
+}
+
+static WFDB_Backend mem_backend = {
+    mem_open, NULL, NULL, NULL, mem_size, mem_map, NULL, mem_close, NULL
+};
+
+/* bk_set adds, replaces, or (if backend is NULL) removes the backend for a
+   URL scheme. */
+static void bk_set(const char *scheme, const WFDB_Backend *backend)
+{
+    struct wfdb_backend_entry *e, **ep;
+
+    for (ep = &wfdb_backends; (e = *ep) != NULL; ep = &e->next)
+	if (strcmp(e->scheme, scheme) == 0)
+	    break;
+    if (backend == NULL) {
+	if (e) {
+	    *ep = e->next;
+	    SFREE(e->scheme);
+	    SFREE(e);
+	}
+    }
+    else {
+	if (e == NULL) {
+	    SUALLOC(e, 1, sizeof(struct wfdb_backend_entry));
+	    SSTRCPY(e->scheme, scheme);
+	    *ep = e;
+	}
+	e->backend = *backend;
     }
-    return(nf);
 }
 
-static long nf_get_range(netfile* nf, long startb, long len, char *rbuf)
+/* bk_find returns the entry for the backend, if any, that handles the named
+   file (or path component). */
+static struct wfdb_backend_entry *bk_find(const char *name)
 {
-    CHUNK *chunk = NULL;
-    char *rp = NULL;
-    long avail = nf->cont_len - startb;
+    static int initialized;
+    struct wfdb_backend_entry *e;
+    size_t n;
 
-    if (len > avail) len = avail;	/* limit request to available bytes */
-    if (nf == NULL || nf->url == NULL || *nf->url == '\0' ||
-	startb < 0L || startb >= nf->cont_len || len <= 0L || rbuf == NULL)
-	return (0L);	/* invalid inputs -- fail silently */
+    if (!initialized) {
+	initialized = TRUE;
+	bk_set("mem", &mem_backend);
+    }
+    for (e = wfdb_backends; e; e = e->next)
+	if (strncmp(name, e->scheme, n = strlen(e->scheme)) == 0 &&
+	    strncmp(name + n, "://", 3) == 0)
+	    return (e);
+    return (NULL);
+}
 
-    if (nf->mode == NF_CHUNK_MODE) {	/* range requests acceptable */
-	long rlen = (avail >= page_size) ? page_size : avail;
-
-	if (len <= page_size) {	/* short request -- check if cached */
-	    if ((startb < nf->base_addr) ||
-		((startb + len) > (nf->base_addr + page_size))) {
-		/* requested data not in cache -- update the cache */
-		if (chunk = nf_get_url_range_chunk(nf, startb, rlen)) {
-		    if (chunk_size(chunk) != rlen) {
-			wfdb_error(
-		     "nf_get_range: requested %ld bytes, received %ld bytes\n",
-		                   rlen, (long)chunk_size(chunk));
-			len = 0L;
-		    }
-		    else {
-			nf->base_addr = startb;
-			memcpy(nf->data, chunk_data(chunk), rlen);
-		    }
-		}
-		else {	/* attempt to update cache failed */
-		    wfdb_error(
-	     "nf_get_range: couldn't read %ld bytes of %s starting at %ld\n", 
-	                       len, nf->url, startb);
-		    len = 0L;
-		}
-	    } 
-      
-	    /* move cached data to the return buffer */
-	    rp = nf->data + startb - nf->base_addr;
-	}
+/* wfdb_register_backend makes the functions in *backend responsible for all
+   files with names that begin with "SCHEME://".  If backend is NULL, any
+   backend previously registered for the scheme is removed.  The backend
+   structure is copied, so that it need not remain valid.  Files already open
+   are not affected.  wfdb_register_backend returns 0 if successful, or -1 if
+   its arguments are invalid. */
+FINT wfdb_register_backend(const char *scheme, const WFDB_Backend *backend)
+{
+    struct wfdb_path_component *c;
+    const char *p;
 
-	else if (chunk = nf_get_url_range_chunk(nf, startb, len)) {
-	    /* long request (> page_size) */
-	    if (chunk_size(chunk) != len) {
-		wfdb_error(
-		     "nf_get_range: requested %ld bytes, received %ld bytes\n",
-		           len, (long)chunk_size(chunk));
-		len = 0L;
-	    }
-	    rp = chunk_data(chunk);
-	}
-	else {
-	    wfdb_error(
-	       "nf_get_range: couldn't read %ld bytes of %s starting at %ld\n",
-		       len, nf->url, startb);
-	    len = 0L;
+    if (scheme == NULL || *scheme == '\0') {
+	wfdb_error("wfdb_register_backend: scheme name is missing\n");
+	return (-1);
+    }
+    for (p = scheme; *p; p++)
+	if (!(('a' <= *p && *p <= 'z') || ('A' <= *p && *p <= 'Z') ||
+	      ('0' <= *p && *p <= '9') || *p == '+' || *p == '-' ||
+	      *p == '.')) {
+	    wfdb_error("wfdb_register_backend: invalid scheme name %s\n",
+		       scheme);
+	    return (-1);
 	}
+    if (backend &&
+	(!backend->open || !backend->close ||
+	 (!backend->read && !backend->map))) {
+	wfdb_error("wfdb_register_backend: backend for %s is incomplete\n",
+		   scheme);
+	return (-1);
     }
+    (void)bk_find("");		/* register the built-in backends first */
+    bk_set(scheme, backend);
 
-    else  /* cannot use range requests -- cache contains full file */
-	rp = nf->data + startb;		
-
-    if (rp != NULL && len > 0)
-	memcpy(rbuf, rp, len);
-    if (chunk) chunk_delete(chunk);
-    return (len);
+    /* Reclassify any components of the WFDB path that may be affected. */
+    for (c = wfdb_path_list; c; c = c->next)
+	if (bk_find(c->prefix)) c->type = WFDB_BACKEND;
+	else if (strstr(c->prefix, "://")) c->type = WFDB_NET;
+    return (0);
 }
 
-/* nf_feof returns true after reading past the end of a file but before
-   repositioning the pos in the file. */
-static int nf_feof(netfile *nf)
+/* wfdb_memfile makes size bytes of memory, beginning at data, readable as a
+   file named "mem://NAME" (name may be given with or without the "mem://"
+   prefix).  The data are not copied, and must remain valid and unchanged
+   until the file is closed and unregistered.  If data is NULL, any file
+   previously registered under the same name is unregistered.  wfdb_memfile
+   returns 0 if successful, or -1 if name is missing. */
+FINT wfdb_memfile(const char *name, const void *data, long size)
 {
-    return ((nf->err == NF_EOF_ERR) ? TRUE : FALSE);
+    struct wfdb_memfile *m, **mp;
+
+    if (name == NULL || *name == '\0') {
+	wfdb_error("wfdb_memfile: file name is missing\n");
+	return (-1);
+    }
+    if (strncmp(name, "mem://", 6) == 0)
+	name += 6;
+    for (mp = &wfdb_memfiles; (m = *mp) != NULL; mp = &m->next)
+	if (strcmp(m->name, name) == 0)
+	    break;
+    if (data == NULL) {
+	if (m) {
+	    *mp = m->next;
+	    SFREE(m->name);
+	    SFREE(m);
+	}
+	return (0);
+    }
+    if (m == NULL) {
+	SUALLOC(m, 1, sizeof(struct wfdb_memfile));
+	SSTRCPY(m->name, name);
+	*mp = m;
+    }
+    m->data = data;
+    m->size = size;
+    return (0);
 }
 
-/* nf_eof returns true if the file pointer is at the EOF. */
-static int nf_eof(netfile *nf)
+/* bk_fopen opens a file using a registered backend. */
+static WFDB_FILE *bk_fopen(struct wfdb_backend_entry *e, const char *fname,
+			   const char *mode)
 {
-    return (nf->pos >= nf->cont_len) ? TRUE : FALSE;
+    struct wfdb_bfile *bf;
+    const void *map;
+    void *file;
+    long size;
+    WFDB_FILE *wp;
+
+    if ((file = (*e->backend.open)(e->backend.context, fname, mode)) == NULL)
+	return (NULL);
+    SUALLOC(bf, 1, sizeof(struct wfdb_bfile));
+    bf->b = e->backend;
+    bf->file = file;
+    if (*mode == 'r' && bf->b.map && (map = (*bf->b.map)(file, &size))) {
+	bf->map = map;
+	bf->size = size;
+    }
+    else if (*mode == 'r' && bf->b.read == NULL) {
+	wfdb_error("wfdb_fopen: can't read %s\n", fname);
+	(*bf->b.close)(file);
+	SFREE(bf);
+	return (NULL);
+    }
+    SUALLOC(wp, 1, sizeof(WFDB_FILE));
+    wp->type = WFDB_BACKEND;
+    wp->bfp = bf;
+    return (wp);
 }
 
-static netfile* nf_fopen(const char *url, const char *mode)
+static int bk_fclose(struct wfdb_bfile *bf)
 {
-    netfile* nf = NULL;
+    int status = (*bf->b.close)(bf->file);
 
-    if (!www_done_init)
-	www_init();
-    if (*mode == 'w' || *mode == 'a')
-	errno = EROFS;	/* no support for output */
-    else if (*mode != 'r')
-	errno = EINVAL;	/* invalid mode string */
-    else if (nf = nf_new(url))
-	nf_open_files++;
-    return (nf);
+    SFREE(bf->buf);
+    SFREE(bf);
+    return (status);
 }
 
-static int nf_fclose(netfile* nf)
+/* bk_fill refills the read buffer of an unmapped file, and returns the number
+   of bytes read. */
+static long bk_fill(struct wfdb_bfile *bf)
 {
-    nf_delete(nf);
-    nf_open_files--;
-    return (0);
+    long n;
+
+    if (bf->buf == NULL)
+	SUALLOC(bf->buf, BK_BUFSIZE, 1);
+    bf->bufpos = bf->buflen = 0;
+    if (bf->buf == NULL)
+	return (0);
+    if ((n = (*bf->b.read)(bf->file, bf->buf, BK_BUFSIZE)) < 0)
+	bf->err = TRUE;
+    else
+	bf->buflen = n;
+    return (bf->buflen);
 }
 
-static int nf_fgetc(netfile *nf)
+static size_t bk_fread(void *ptr, size_t size, size_t nmemb,
+		       struct wfdb_bfile *bf)
 {
-    char c;
+    size_t count = 0, n, total = size * nmemb;
+    long k;
+
+    if (bf->map) {
+	count = (bf->pos < bf->size) ? bf->size - bf->pos : 0;
+	if (count > total) count = total;
+	memcpy(ptr, bf->map + bf->pos, count);
+	bf->pos += count;
+    }
+    else if (bf->b.read)
+	while (count < total) {
+	    if (bf->bufpos < bf->buflen) {
+		if ((n = bf->buflen - bf->bufpos) > total - count)
+		    n = total - count;
+		memcpy((char *)ptr + count, bf->buf + bf->bufpos, n);
+		bf->bufpos += n;
+		count += n;
+	    }
+	    else if (total - count >= BK_BUFSIZE) {
+		/* Read large blocks directly into the caller's buffer. */
+		if ((k = (*bf->b.read)(bf->file, (char *)ptr + count,
+				       total - count)) <= 0) {
+		    if (k < 0) bf->err = TRUE;
+		    break;
+		}
+		count += k;
+	    }
+	    else if (bk_fill(bf) == 0)
+		break;
+	}
+    if (count < total && !bf->err)
+	bf->eof = TRUE;
+    return (size ? count / size : 0);
+}
 
-    if (nf_get_range(nf, nf->pos++, 1, &c))
-	return (c & 0xff);
-    nf->err = (nf->pos >= nf->cont_len) ? NF_EOF_ERR : NF_REAL_ERR;
+static int bk_fgetc(struct wfdb_bfile *bf)
+{
+    if (bf->map) {
+	if (bf->pos < bf->size)
+	    return ((unsigned char)bf->map[bf->pos++]);
+    }
+    else if (bf->b.read &&
+	     (bf->bufpos < bf->buflen || bk_fill(bf) > 0))
+	return ((unsigned char)bf->buf[bf->bufpos++]);
+    if (!bf->err)
+	bf->eof = TRUE;
     return (EOF);
 }
 
-static char* nf_fgets(char *s, int size, netfile *nf)
+static char *bk_fgets(char *s, int size, struct wfdb_bfile *bf)
 {
-    int c = 0, i = 0; 
+    int c = 0, i = 0;
 
-    if (s == NULL) return (NULL);
-    while (c != '\n' && i < (size-1) && (c = nf_fgetc(nf)) != EOF)
+    while (i < size - 1 && c != '\n' && (c = bk_fgetc(bf)) != EOF)
 	s[i++] = c;
-    if ((c == EOF) && (i == 0))	return (NULL);
-    s[i] = 0;
+    if (i == 0 || bf->err)
+	return (NULL);
+    s[i] = '\0';
     return (s);
 }
 
-static size_t nf_fread(void *ptr, size_t size, size_t nmemb, netfile *nf)
+static long bk_ftell(struct wfdb_bfile *bf)
 {
-    long bytes_available, bytes_read = 0L, bytes_requested = size * nmemb;
+    long pos;
 
-    if (nf == NULL || ptr == NULL || bytes_requested == 0) return ((size_t)0);
-    bytes_available = nf->cont_len - nf->pos;
-    if (bytes_requested > bytes_available) bytes_requested = bytes_available;
-    if (bytes_requested > page_size && page_size) bytes_requested = page_size;
-    nf->pos += bytes_read = nf_get_range(nf, nf->pos, bytes_requested, ptr);
-    return ((size_t)(bytes_read / size));
+    if (bf->map)
+	return (bf->pos);
+    if (bf->b.tell == NULL) {
+	errno = ESPIPE;
+	return (-1L);
+    }
+    if ((pos = (*bf->b.tell)(bf->file)) >= 0)
+	pos -= bf->buflen - bf->bufpos;
+    return (pos);
 }
 
-static int nf_fseek(netfile* nf, long offset, int whence)
+static int bk_fseek(struct wfdb_bfile *bf, long offset, int whence)
 {
-  int ret = -1;
+    long base = 0L;
 
-  if (nf)
-    switch (whence) {
-      case SEEK_SET:
-	if (offset >= 0 && offset <= nf->cont_len) {
-	  nf->pos = offset;
-	  nf->err = NF_NO_ERR;
-	  ret = 0;
-	}
-	break;
-      case SEEK_CUR:
-	if (((unsigned long) nf->pos + offset) <= nf->cont_len) {
-	  nf->pos += offset;
-	  nf->err = NF_NO_ERR;
-	  ret = 0;
-	}
-	break;
-      case SEEK_END:
-	if (offset <= 0 && offset >= -nf->cont_len) {
-	  nf->pos = nf->cont_len + offset;
-	  nf->err = NF_NO_ERR;
-	  ret = 0; 
+    if (whence == SEEK_CUR && (base = bk_ftell(bf)) < 0)
+	return (-1);
+    else if (whence == SEEK_END) {
+	if (bf->map)
+	    base = bf->size;
+	else if (bf->b.size == NULL || (base = (*bf->b.size)(bf->file)) < 0) {
+	    errno = ESPIPE;
+	    return (-1);
 	}
-	break;
-      default:
-	break;
     }
-  return (ret);
+    else if (whence != SEEK_SET && whence != SEEK_CUR) {
+	errno = EINVAL;
+	return (-1);
+    }
+    if ((offset += base) < 0) {
+	errno = EINVAL;
+	return (-1);
+    }
+    if (bf->map)
+	bf->pos = offset;
+    else if (bf->b.seek == NULL) {
+	errno = ESPIPE;
+	return (-1);
+    }
+    else if ((*bf->b.seek)(bf->file, offset) < 0)
+	return (-1);
+    else
+	bf->bufpos = bf->buflen = 0;
+    bf->eof = FALSE;
+    return (0);
 }
 
-static long nf_ftell(netfile *nf)
+static size_t bk_fwrite(const void *ptr, size_t size, size_t nmemb,
+			struct wfdb_bfile *bf)
 {
-    return (nf->pos);
+    long n;
+
+    if (bf->map || bf->b.write == NULL) {
+	errno = EROFS;
+	return (0);
+    }
+    /* Discard any buffered input, so that the data are written at the
+       current position. */
+    if (bf->bufpos < bf->buflen && bk_fseek(bf, 0L, SEEK_CUR) < 0)
+	return (0);
+    if ((n = (*bf->b.write)(bf->file, ptr, size * nmemb)) < 0) {
+	bf->err = TRUE;
+	n = 0;
+    }
+    return (size ? n / size : 0);
 }
 
-static int nf_ferror(netfile *nf)
+static int bk_fputc(int c, struct wfdb_bfile *bf)
 {
-    return ((nf->err == NF_REAL_ERR) ? TRUE : FALSE);
+    unsigned char b = c;
+
+    return (bk_fwrite(&b, 1, 1, bf) == 1 ? b : EOF);
 }
 
-static void nf_clearerr(netfile *nf)
+/* Write-behind output
+
+If the environment variable WFDB_WRITEBEHIND is set to a positive number N (or
+to any other non-empty value other than "0", in which case N is taken to be
+WB_QUEUE_DEPTH), local files opened for writing by wfdb_fopen are written by a
+background thread, so that the program producing the output need not wait for
+it to be written.  Output to such a file is collected in blocks of
+WB_BLOCK_SIZE bytes;  each full block is handed to the write-behind thread,
+which writes blocks in the order in which they were queued.  At most N blocks
+(for all files together) may be waiting at once;  if the queue is full, the
+producer waits until a block has been written.
+
+If an error occurs while writing a block, it is reported by wfdb_ferror, and
+later output to the file is discarded.  wfdb_fflush, wfdb_fseek, wfdb_ftell,
+and wfdb_fclose queue any partially-filled block and wait until all queued
+output for the file has been written;  since osigclose, oannclose, and
+wfdbflush use these functions, they are barriers for write-behind output.
+
+Write-behind output is available only if the library was compiled with
+WFDB_WRITE_BEHIND defined (see wfdblib.h);  otherwise WFDB_WRITEBEHIND is
+ignored.
+*/
+
+#if WFDB_WRITE_BEHIND
+#include <pthread.h>
+
+struct wfdb_wbfile {
+    FILE *fp;		/* the output file */
+    char *block;	/* block being filled (NULL if none) */
+    long len;		/* number of bytes in block */
+    int pending;	/* number of blocks queued or being written */
+    int err;		/* TRUE if a write error has occurred (protected by
+			   wb_lock, like 'pending') */
+    struct wfdb_wbfile *next;	/* next open write-behind file */
+};
+
+static struct wb_block {
+    struct wfdb_wbfile *wbf;	/* the file to which the block belongs */
+    char *data;			/* contents of the block */
+    long len;			/* number of bytes in data */
+    struct wb_block *next;
+} *wb_head, *wb_tail;		/* queue of blocks to be written */
+
+static int wb_depth = -1;	/* maximum number of queued blocks (0: write-
+				   behind disabled, -1: not yet determined) */
+static int wb_queued;		/* number of queued blocks */
+static int wb_started;		/* TRUE if the write-behind thread exists */
+static struct wfdb_wbfile *wb_files;	/* list of open write-behind files */
+static pthread_t wb_thread;
+static pthread_mutex_t wb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wb_ready = PTHREAD_COND_INITIALIZER; /* block queued */
+static pthread_cond_t wb_written = PTHREAD_COND_INITIALIZER; /* block done */
+
+/* wb_writer is the write-behind thread.  It runs until the process exits. */
+static void *wb_writer(void *arg)
 {
-    nf->err = NF_NO_ERR;
+    struct wb_block *b;
+    int err;
+
+    pthread_mutex_lock(&wb_lock);
+    while (1) {
+	while (wb_head == NULL)
+	    pthread_cond_wait(&wb_ready, &wb_lock);
+	b = wb_head;
+	if ((wb_head = b->next) == NULL) wb_tail = NULL;
+	wb_queued--;
+	err = b->wbf->err;
+	pthread_mutex_unlock(&wb_lock);
+
+	/* Only this thread uses the FILE while the file has pending blocks. */
+	WFDB_TRACE_BEGIN("write-behind: write block");
+	if (!err && fwrite(b->data, 1, b->len, b->wbf->fp) != b->len)
+	    err = TRUE;
+	WFDB_TRACE_END("write-behind: write block");
+
+	pthread_mutex_lock(&wb_lock);
+	if (err) b->wbf->err = TRUE;
+	b->wbf->pending--;
+	pthread_cond_broadcast(&wb_written);
+	SFREE(b->data);
+	SFREE(b);
+    }
+    return (NULL);
 }
 
-static int nf_fflush(netfile *nf)
+/* wb_ferror returns TRUE if a write error has occurred. */
+static int wb_ferror(struct wfdb_wbfile *wbf)
 {
-    /* no support yet for writing to remote files */
-    errno = EROFS;
-    return (EOF);
+    int err;
+
+    pthread_mutex_lock(&wb_lock);
+    err = wbf->err;
+    pthread_mutex_unlock(&wb_lock);
+    return (err);
 }
 
-static size_t nf_fwrite(const void *ptr, size_t size, size_t nmemb,netfile *nf)
+/* wb_seterr records a write error (including failure to allocate memory for
+   the output);  later output to the file is discarded. */
+static void wb_seterr(struct wfdb_wbfile *wbf)
 {
-    /* no support yet for writing to remote files */
-    errno = EROFS;
-    return (0);
+    pthread_mutex_lock(&wb_lock);
+    wbf->err = TRUE;
+    pthread_mutex_unlock(&wb_lock);
 }
 
-static int nf_putc(int c, netfile *nf)
+static void wb_clearerr(struct wfdb_wbfile *wbf)
 {
-    /* no support yet for writing to remote files */
-    errno = EROFS;
-    return (EOF);
+    pthread_mutex_lock(&wb_lock);
+    wbf->err = FALSE;
+    pthread_mutex_unlock(&wb_lock);
 }
 
-#else	/* !WFDB_NETFILES */
-# define nf_feof(nf)                      (0)
-# define nf_fgetc(nf)                     (EOF)
-# define nf_fgets(s, size, nf)            (NULL)
-# define nf_fread(ptr, size, nmemb, nf)   (0)
-# define nf_fseek(nf, offset, whence)     (-1)
-# define nf_ftell(nf)                     (-1)
-# define nf_ferror(nf)                    (0)
-# define nf_clearerr(nf)                  ((void) 0)
-# define nf_fflush(nf)                    (EOF)
-# define nf_fwrite(ptr, size, nmemb, nf)  (0)
-# define nf_putc(c, nf)                   (EOF)
+/* wb_submit queues the block being filled (if any) for the write-behind
+   thread, after waiting if necessary for space in the queue. */
+static void wb_submit(struct wfdb_wbfile *wbf)
+{
+    struct wb_block *b = NULL;
+
+    if (wbf->block == NULL)
+	return;
+    if (wbf->len > 0 && !wb_ferror(wbf)) {
+	SUALLOC(b, 1, sizeof(struct wb_block));
+	if (b == NULL)		/* memory errors are not fatal */
+	    wb_seterr(wbf);
+    }
+    if (b == NULL) {		/* discard the block */
+	SFREE(wbf->block);
+	wbf->len = 0;
+	return;
+    }
+    b->wbf = wbf;
+    b->data = wbf->block;
+    b->len = wbf->len;
+    wbf->block = NULL;
+    wbf->len = 0;
+    pthread_mutex_lock(&wb_lock);
+    while (wb_queued >= wb_depth)
+	pthread_cond_wait(&wb_written, &wb_lock);
+    if (wb_tail) wb_tail->next = b;
+    else wb_head = b;
+    wb_tail = b;
+    wb_queued++;
+    wbf->pending++;
+    pthread_cond_signal(&wb_ready);
+    pthread_mutex_unlock(&wb_lock);
+}
+
+/* wb_drain queues the block being filled (if any) and waits until all of
+   the file's queued blocks have been written.  It returns 0 if no write
+   error has occurred, or EOF otherwise. */
+static int wb_drain(struct wfdb_wbfile *wbf)
+{
+    int err;
+
+    wb_submit(wbf);
+    pthread_mutex_lock(&wb_lock);
+    while (wbf->pending > 0)
+	pthread_cond_wait(&wb_written, &wb_lock);
+    err = wbf->err;
+    pthread_mutex_unlock(&wb_lock);
+    return (err ? EOF : 0);
+}
+
+/* wb_drain_all is invoked on exit, so that output to files that were not
+   closed is not lost. */
+static void wb_drain_all(void)
+{
+    struct wfdb_wbfile *wbf;
+
+    for (wbf = wb_files; wbf; wbf = wbf->next)
+	wb_drain(wbf);
+}
+
+/* wb_attach enables write-behind output for a local file that has just been
+   opened for writing, if write-behind is enabled and the write-behind thread
+   can be started. */
+static void wb_attach(WFDB_FILE *wp)
+{
+    struct wfdb_wbfile *wbf;
+    char *p;
+
+    if (wb_depth < 0) {
+	wb_depth = 0;
+	if ((p = getenv("WFDB_WRITEBEHIND")) && *p && strcmp(p, "0") &&
+	    (wb_depth = atoi(p)) <= 0)
+	    wb_depth = WB_QUEUE_DEPTH;
+    }
+    if (wb_depth == 0)
+	return;
+    if (!wb_started) {
+	if (pthread_create(&wb_thread, NULL, wb_writer, NULL)) {
+	    wfdb_error("wfdb_fopen: can't start write-behind thread\n");
+	    wb_depth = 0;
+	    return;
+	}
+	pthread_detach(wb_thread);
+	atexit(wb_drain_all);
+	wb_started = TRUE;
+    }
+    SUALLOC(wbf, 1, sizeof(struct wfdb_wbfile));
+    if (wbf == NULL)
+	return;
+    wbf->fp = wp->fp;
+    wbf->next = wb_files;
+    wb_files = wbf;
+    wp->wbp = wbf;
+}
+
+static size_t wb_fwrite(const void *ptr, size_t size, size_t nmemb,
+			struct wfdb_wbfile *wbf)
+{
+    size_t n, total = size * nmemb, count = 0;
+    int err = wb_ferror(wbf);
+
+    while (count < total && !err) {
+	if (wbf->block == NULL) {
+	    SUALLOC(wbf->block, WB_BLOCK_SIZE, 1);
+	    wbf->len = 0;
+	    if (wbf->block == NULL) {	/* memory errors are not fatal */
+		wb_seterr(wbf);
+		break;
+	    }
+	}
+	if ((n = WB_BLOCK_SIZE - wbf->len) > total - count)
+	    n = total - count;
+	memcpy(wbf->block + wbf->len, (const char *)ptr + count, n);
+	wbf->len += n;
+	count += n;
+	if (wbf->len == WB_BLOCK_SIZE) {
+	    wb_submit(wbf);
+	    err = wb_ferror(wbf);
+	}
+    }
+    return (size && !wb_ferror(wbf) ? count / size : 0);
+}
+
+static int wb_fputc(int c, struct wfdb_wbfile *wbf)
+{
+    unsigned char b = c;
+
+    /* If an error has occurred, the block will be discarded by wb_submit,
+       and the error will be reported by wfdb_ferror and wfdb_fclose. */
+    if (wbf->block && wbf->len < WB_BLOCK_SIZE - 1) {
+	wbf->block[wbf->len++] = b;
+	return (b);
+    }
+    return (wb_fwrite(&b, 1, 1, wbf) == 1 ? b : EOF);
+}
+
+static int wb_fclose(struct wfdb_wbfile *wbf)
+{
+    struct wfdb_wbfile **p;
+    int status = wb_drain(wbf);
+
+    for (p = &wb_files; *p; p = &(*p)->next)
+	if (*p == wbf) {
+	    *p = wbf->next;
+	    break;
+	}
+    SFREE(wbf);
+    return (status);
+}
+
+#else	/* !WFDB_WRITE_BEHIND */
+# define wb_attach(wp)                    ((void) 0)
+# define wb_drain_all()                   ((void) 0)
+# define wb_drain(wbf)                    (EOF)
+# define wb_fwrite(ptr, size, nmemb, wbf) (0)
+# define wb_fputc(c, wbf)                 (EOF)
+# define wb_fclose(wbf)                   (EOF)
+# define wb_ferror(wbf)                   (EOF)
+# define wb_clearerr(wbf)                 ((void) 0)
 #endif
 
 /* The definition of nf_vfprintf (which is a stub) has been moved;  it is
@@ -2084,14 +4788,46 @@ void wfdb_clearerr(WFDB_FILE *wp)
 {
     if (wp->type == WFDB_NET)
 	nf_clearerr(wp->netfp);
-    else
+    else if (wp->type == WFDB_COMPRESSED)
+	zf_clearerr(wp->zfp);
+    else if (wp->type == WFDB_BACKEND)
+	wp->bfp->eof = wp->bfp->err = FALSE;
+    else {
+	if (wp->wbp) wb_clearerr(wp->wbp);
 	clearerr(wp->fp);
+    }
+}
+
+/* wfdb_fmap is used by the signal file readers in signal.c to read files that
+   are held in memory (see "Custom I/O backends" above) in place.  If wp is
+   such a file, wfdb_fmap sets *data to point to the next unread byte, advances
+   the file position as if the following n bytes had been read, and returns n,
+   which is the number of bytes remaining in the file or max, whichever is
+   less.  For other files, wfdb_fmap returns -1, and does nothing else. */
+long wfdb_fmap(WFDB_FILE *wp, const char **data, long max)
+{
+    struct wfdb_bfile *bf;
+    long n;
+
+    if (wp->type != WFDB_BACKEND || (bf = wp->bfp)->map == NULL)
+	return (-1L);
+    n = (bf->pos < bf->size) ? bf->size - bf->pos : 0L;
+    if (n > max) n = max;
+    *data = bf->map + bf->pos;
+    bf->pos += n;
+    if (n == 0) bf->eof = TRUE;
+    WFDB_COUNT(bytes_read[WFDB_BACKEND], n);
+    return (n);
 }
 
 int wfdb_feof(WFDB_FILE *wp)
 {
     if (wp->type == WFDB_NET)
 	return (nf_feof(wp->netfp));
+    if (wp->type == WFDB_COMPRESSED)
+	return (zf_feof(wp->zfp));
+    if (wp->type == WFDB_BACKEND)
+	return (wp->bfp->eof);
     return (feof(wp->fp));
 }
 
@@ -2099,6 +4835,12 @@ int wfdb_ferror(WFDB_FILE *wp)
 {
     if (wp->type == WFDB_NET)
 	return (nf_ferror(wp->netfp));
+    if (wp->type == WFDB_COMPRESSED)
+	return (zf_ferror(wp->zfp));
+    if (wp->type == WFDB_BACKEND)
+	return (wp->bfp->err);
+    if (wp->wbp)
+	return (wb_ferror(wp->wbp));
     return (ferror(wp->fp));
 }
 
@@ -2106,32 +4848,64 @@ int wfdb_fflush(WFDB_FILE *wp)
 {
     if (wp == NULL) {	/* flush all WFDB_FILEs */
 	nf_fflush(NULL);
+	wb_drain_all();
 	return (fflush(NULL));
     }
     else if (wp->type == WFDB_NET)
 	return (nf_fflush(wp->netfp));
+    else if (wp->type == WFDB_COMPRESSED || wp->type == WFDB_BACKEND)
+	return (0);	/* nothing is buffered for output */
+    else if (wp->wbp && wb_drain(wp->wbp))
+	return (EOF);
     else
 	return (fflush(wp->fp));
 }
 
 char* wfdb_fgets(char *s, int size, WFDB_FILE *wp)
 {
+    char *r;
+
     if (wp->type == WFDB_NET)
-	return (nf_fgets(s, size, wp->netfp));
-    return (fgets(s, size, wp->fp));
+	r = nf_fgets(s, size, wp->netfp);
+    else if (wp->type == WFDB_COMPRESSED)
+	r = zf_fgets(s, size, wp->zfp);
+    else if (wp->type == WFDB_BACKEND)
+	r = bk_fgets(s, size, wp->bfp);
+    else
+	r = fgets(s, size, wp->fp);
+    if (r)
+	WFDB_COUNT(bytes_read[wp->type], strlen(r));
+    return (r);
 }
 
 size_t wfdb_fread(void *ptr, size_t size, size_t nmemb, WFDB_FILE *wp)
 {
+    size_t n;
+
     if (wp->type == WFDB_NET)
-	return (nf_fread(ptr, size, nmemb, wp->netfp));
-    return (fread(ptr, size, nmemb, wp->fp));
+	n = nf_fread(ptr, size, nmemb, wp->netfp);
+    else if (wp->type == WFDB_COMPRESSED)
+	n = zf_fread(ptr, size, nmemb, wp->zfp);
+    else if (wp->type == WFDB_BACKEND)
+	n = bk_fread(ptr, size, nmemb, wp->bfp);
+    else
+	n = fread(ptr, size, nmemb, wp->fp);
+    WFDB_COUNT(freads, 1);
+    WFDB_COUNT(bytes_read[wp->type], n * size);
+    return (n);
 }
 
 int wfdb_fseek(WFDB_FILE *wp, long int offset, int whence)
 {
+    WFDB_COUNT(fseeks, 1);
     if (wp->type == WFDB_NET)
 	return (nf_fseek(wp->netfp, offset, whence));
+    if (wp->type == WFDB_COMPRESSED)
+	return (zf_fseek(wp->zfp, offset, whence));
+    if (wp->type == WFDB_BACKEND)
+	return (bk_fseek(wp->bfp, offset, whence));
+    if (wp->wbp && wb_drain(wp->wbp))
+	return (-1);
     return(fseek(wp->fp, offset, whence));
 }
 
@@ -2139,27 +4913,65 @@ long wfdb_ftell(WFDB_FILE *wp)
 {
     if (wp->type == WFDB_NET)
 	return (nf_ftell(wp->netfp));
+    if (wp->type == WFDB_COMPRESSED)
+	return (zf_ftell(wp->zfp));
+    if (wp->type == WFDB_BACKEND)
+	return (bk_ftell(wp->bfp));
+    if (wp->wbp && wb_drain(wp->wbp))
+	return (-1L);
     return (ftell(wp->fp));
 }
 
 size_t wfdb_fwrite(const void *ptr, size_t size, size_t nmemb, WFDB_FILE *wp)
 {
+    size_t n;
+
     if (wp->type == WFDB_NET)
-	return (nf_fwrite(ptr, size, nmemb, wp->netfp));
-    return (fwrite(ptr, size, nmemb, wp->fp));
+	n = nf_fwrite(ptr, size, nmemb, wp->netfp);
+    else if (wp->type == WFDB_COMPRESSED) {
+	errno = EROFS;
+	return (0);
+    }
+    else if (wp->type == WFDB_BACKEND)
+	n = bk_fwrite(ptr, size, nmemb, wp->bfp);
+    else if (wp->wbp)
+	n = wb_fwrite(ptr, size, nmemb, wp->wbp);
+    else
+	n = fwrite(ptr, size, nmemb, wp->fp);
+    WFDB_COUNT(bytes_written[wp->type], n * size);
+    return (n);
 }
 
 int wfdb_getc(WFDB_FILE *wp)
 {
+    int c;
+
     if (wp->type == WFDB_NET)
-	return (nf_fgetc(wp->netfp));
-    return (getc(wp->fp));
+	c = nf_fgetc(wp->netfp);
+    else if (wp->type == WFDB_COMPRESSED)
+	c = zf_fgetc(wp->zfp);
+    else if (wp->type == WFDB_BACKEND)
+	c = bk_fgetc(wp->bfp);
+    else
+	c = getc(wp->fp);
+    if (c != EOF)
+	WFDB_COUNT(bytes_read[wp->type], 1);
+    return (c);
 }
 
 int wfdb_putc(int c, WFDB_FILE *wp)
 {
+    if (wp->type == WFDB_COMPRESSED) {
+	errno = EROFS;
+	return (EOF);
+    }
+    WFDB_COUNT(bytes_written[wp->type], 1);
     if (wp->type == WFDB_NET)
 	return (nf_putc(c, wp->netfp));
+    if (wp->type == WFDB_BACKEND)
+	return (bk_fputc(c, wp->bfp));
+    if (wp->wbp)
+	return (wb_fputc(c, wp->wbp));
     return (putc(c, wp->fp));
 }
 
@@ -2167,11 +4979,18 @@ int wfdb_fclose(WFDB_FILE *wp)
 {
     int status;
 
+    if (wp->type == WFDB_COMPRESSED)
+	status = zf_close(wp->zfp);
+    else if (wp->type == WFDB_BACKEND)
+	status = bk_fclose(wp->bfp);
 #if WFDB_NETFILES
-    status = (wp->type == WFDB_NET) ? nf_fclose(wp->netfp) : fclose(wp->fp);
-#else
-    status = fclose(wp->fp);
+    else if (wp->type == WFDB_NET)
+	status = nf_fclose(wp->netfp);
 #endif
+    else {
+	status = wp->wbp ? wb_fclose(wp->wbp) : 0;
+	if (fclose(wp->fp)) status = EOF;
+    }
     if (wp->fp != stdin)
 	SFREE(wp);
     return (status);
@@ -2180,10 +4999,14 @@ int wfdb_fclose(WFDB_FILE *wp)
 WFDB_FILE *wfdb_fopen(char *fname, const char *mode)
 {
     char *p = fname;
+    struct wfdb_backend_entry *e;
     WFDB_FILE *wp;
 
     if (p == NULL || strstr(p, ".."))
 	return (NULL);
+    wfdb_stats_init();
+    if (e = bk_find(p))
+	return (bk_fopen(e, fname, mode));
     SUALLOC(wp, 1, sizeof(WFDB_FILE));
     if (strstr(p, "://")) {
 #if WFDB_NETFILES
@@ -2197,6 +5020,8 @@ WFDB_FILE *wfdb_fopen(char *fname, const char *mode)
     }
     if (wp->fp = fopen(fname, mode)) {
 	wp->type = WFDB_LOCAL;
+	if (*mode == 'w' || *mode == 'a')
+	    wb_attach(wp);
 	return (wp);
     }
     if (strcmp(mode, WB) == 0 || strcmp(mode, AB) == 0) {
@@ -2222,6 +5047,7 @@ WFDB_FILE *wfdb_fopen(char *fname, const char *mode)
 	   to create the output file. */
 	if (stat == 0 && (wp->fp = fopen(fname, mode))) {
 		wp->type = WFDB_LOCAL;
+		wb_attach(wp);
 		return (wp);
 	}
     }
@@ -146,9 +146,13 @@ symbols reserved to the library begin with the characters "wfdb_".
    environment variable WFDBANNSORT specifies if wfdbquit() should attempt to
    sort annotations in any output annotation files before closing them (it
    does this if WFDBANNSORT is non-zero, or if WFDBANNSORT is not set, and
-   DEFWFDBANNSORT is non-zero).  Sorting is done by invoking 'sortann' (see
-   ../app/sortann.c) as a separate process;  since this cannot be done from
-   an MS-Windows DLL, sorting is disabled by default in this case. */
+   DEFWFDBANNSORT is non-zero).  MIT-format output annotations are normally
+   buffered and sorted in memory by putann and oannclose (see annot.c), so
+   that this is needed only for very large or AHA-format annotation files, or
+   if wfdbflush() was invoked before the out-of-order annotations were
+   written.  Sorting is done by invoking 'sortann' (see ../app/sortann.c) as a
+   separate process;  since this cannot be done from an MS-Windows DLL,
+   sorting is disabled by default in this case. */
 #if defined(_WINDLL)
 #define DEFWFDBANNSORT 0
 #else
@@ -164,6 +168,25 @@ symbols reserved to the library begin with the characters "wfdb_".
    is not set, the value of DEFWFDBMODE determines the mode. */
 #define DEFWFDBGVMODE WFDB_LOWRES
 
+/* When opening a multi-segment record, readheader() can load the segment table
+   and the contents of the segment headers from a binary "compiled header"
+   (record.hec) rather than parsing each of the text headers.  The environment
+   variable WFDBHEC determines if compiled headers are used (0: never;  1: if
+   present and up to date;  2: as for 1, but also create them as needed);  if
+   WFDBHEC is not set, the value of DEFWFDBHEC determines the behavior. */
+#define DEFWFDBHEC 1
+
+/* When reading an annotation file, iannsettime() uses a sparse index of the
+   file's contents, built as the file is read, to avoid reading it from the
+   beginning.  The index can also be saved in an index file (record.atr.aix,
+   for the annotation file record.atr).  The environment variable WFDBAIX
+   determines if index files are used (0: never;  1: if present and up to date;
+   2: as for 1, but also create them as needed);  if WFDBAIX is not set, the
+   value of DEFWFDBAIX determines the behavior.  Checking for an index file
+   adds some work to each annopen() call, so index files are not used by
+   default. */
+#define DEFWFDBAIX 0
+
 /* putenv() is available in POSIX, SVID, and BSD Unices and in MS-DOS and
    32-bit MS Windows, but not under 16-bit MS Windows or under MacOS.  If it is
    available, getwfdb() (in wfdbio.c) detects when the environment variables
@@ -204,16 +227,94 @@ struct WFDB_FILE {
   FILE *fp;
   struct netfile *netfp;
   int type;
+  struct wfdb_zfile *zfp;
+  struct wfdb_bfile *bfp;
+  struct wfdb_wbfile *wbp;	/* if not NULL, output is written by a
+				   background thread (see wfdbio.c) */
 };
 
 /* Values for WFDB_FILE 'type' field */
 #define WFDB_LOCAL	0	/* a local file, read via C standard I/O */
 #define WFDB_NET	1	/* a remote file, read via libwww */
+#define WFDB_COMPRESSED	2	/* a compressed (.gz or .zst) file, read via
+				   zlib or libzstd (see wfdbio.c) */
+#define WFDB_BACKEND	3	/* a file accessed via a registered backend
+				   (see wfdb_register_backend in wfdbio.c) */
+
+/* To enable reading of gzip-compressed (.gz) and Zstandard-compressed (.zst)
+   files, define WFDB_GZIP_SUPPORT and link with zlib, and/or define
+   WFDB_ZSTD_SUPPORT and link with libzstd (see WFDBIO_CFLAGS in
+   'Makefile'). */
+#if defined(WFDB_GZIP_SUPPORT) || defined(WFDB_ZSTD_SUPPORT)
+#define WFDB_COMPRESSION 1
+#endif
+
+/* Write-behind output (see wfdbio.c) requires POSIX threads.  To enable it,
+   define WFDB_WRITE_BEHIND and link with the POSIX threads library (see
+   WFDBIO_CFLAGS in 'Makefile'). */
+#ifndef WFDB_WRITE_BEHIND
+#define WFDB_WRITE_BEHIND 0
+#endif
+
+#define WB_BLOCK_SIZE	65536	/* bytes per block of write-behind output */
+#define WB_QUEUE_DEPTH	8	/* default maximum number of blocks of output
+				   awaiting the write-behind thread, if
+				   write-behind is enabled (WFDB_WRITEBEHIND) */
+
+/* WFDB_COUNT(F, N) adds N to the library statistics counter F (a member of
+   WFDB_Stats; see wfdb_getstats in wfdbio.c) if statistics are being
+   collected.  N is not evaluated otherwise.  Define WFDB_NO_STATS to omit
+   the counters from the library entirely. */
+#ifndef WFDB_NO_STATS
+extern int wfdb_stats_on;
+extern WFDB_Stats wfdb_stats;
+#define WFDB_COUNT(F, N)	((void)(wfdb_stats_on > 0 && (wfdb_stats.F += (N))))
+#else
+#define WFDB_COUNT(F, N)	((void)0)
+#endif
+
+/* Tracing.  If WFDB_TRACE is defined when the library is compiled, timed spans
+   are recorded around the operations marked by the macros below, and can be
+   written to a file in Chrome trace format (see wfdb_trace_export in
+   wfdbio.c).  WFDB_TRACE_EVENTS (a power of 2) is the number of events kept
+   for each thread;  older events are overwritten.  WFDB_TRACE_BEGIN(NAME) and
+   WFDB_TRACE_END(NAME) mark the beginning and end of a span;
+   WFDB_TRACE_FUNCTION(NAME), which must follow the declarations at the
+   beginning of a function, marks a span that ends when the function returns
+   (this requires a compiler that supports the cleanup attribute, such as gcc
+   or clang).  If WFDB_TRACE is not defined, the macros generate no code. */
+#ifdef WFDB_TRACE
+#define WFDB_TRACE_EVENTS	65536
+struct wfdb_trace_span { const char *name; };
+extern void wfdb_trace_begin(const char *name);
+extern void wfdb_trace_end(const char *name);
+extern struct wfdb_trace_span wfdb_trace_enter(const char *name);
+extern void wfdb_trace_leave(struct wfdb_trace_span *span);
+#define WFDB_TRACE_BEGIN(N)	wfdb_trace_begin(N)
+#define WFDB_TRACE_END(N)	wfdb_trace_end(N)
+#define WFDB_TRACE_FUNCTION(N)	struct wfdb_trace_span wfdb_trace_span_ \
+		__attribute__((__cleanup__(wfdb_trace_leave))) = \
+		wfdb_trace_enter(N)
+#else
+#define WFDB_TRACE_BEGIN(N)	((void)0)
+#define WFDB_TRACE_END(N)	((void)0)
+#define WFDB_TRACE_FUNCTION(N)	((void)0)
+#endif
 
 /* Composite data types */
 typedef struct netfile netfile;
 typedef struct WFDB_FILE WFDB_FILE;
 
+/* Validator of a local file (see wfdb_fileval in wfdbio.c) */
+struct wfdb_fileval {
+    double size;		/* size, in bytes */
+    double mtime;		/* modification time, in seconds */
+    double mtimens;		/* fractional part of mtime, in nanoseconds
+				   (0 if not available) */
+    double ino;			/* inode number */
+    unsigned int hash[2];	/* hashes of the first and last 64K bytes */
+};
+
 /* To enable http and ftp access as well as standard (local file) I/O via the
    WFDB library, define WFDB_NETFILES=1 and link with libwww (see 'Makefile').
    Otherwise, the WFDB library uses only the ANSI/ISO standard I/O library. */
@@ -242,6 +343,21 @@ typedef struct WFDB_FILE WFDB_FILE;
 #define ENTRYSIZE	20	/* max size of a single cache entry in MB */
 
 #define NF_PAGE_SIZE	32768 	/* default bytes per http range request */
+#define NF_CACHE_SIZE	1048576	/* default bytes of remote file pages to cache
+				   (WFDB_CACHESIZE) */
+#define NF_READAHEAD	4	/* default number of pages to read ahead when a
+				   remote file is read sequentially
+				   (WFDB_READAHEAD) */
+#define NF_MAX_CONNECTIONS 4	/* default maximum number of http range
+				   requests in progress at once
+				   (WFDB_MAXCONN) */
+#define NF_CACHE_TTL	3600	/* default number of seconds before entries in
+				   the disk cache (WFDB_CACHEDIR) must be
+				   revalidated (WFDB_CACHETTL) */
+#define NF_LOOKUP_TTL	300	/* default number of seconds to remember that a
+				   remote file does not exist (WFDB_LOOKUPTTL) */
+#define NF_LOOKUP_HASH	256	/* size of the hash table of missing files */
+#define NF_LOOKUP_MAX	4096	/* maximum number of missing files remembered */
 
 /* values for netfile 'err' field */
 #define NF_NO_ERR	0	/* no errors */
@@ -289,6 +405,7 @@ extern int wfdb_fclose(WFDB_FILE *fp);
 extern WFDB_FILE *wfdb_open(const char *file_type, const char *record, int mode);
 extern int wfdb_checkname(const char *name, const char *description);
 extern void wfdb_striphea(char *record);
+extern int wfdb_fileval(const char *fname, struct wfdb_fileval *v);
 extern int wfdb_g16(WFDB_FILE *fp);
 extern long wfdb_g32(WFDB_FILE *fp);
 extern void wfdb_p16(unsigned int x, WFDB_FILE *fp);
@@ -309,6 +426,7 @@ extern void wfdb_setirec(const char *record_name);
 extern char *wfdb_getirec(void);
 
 extern void wfdb_clearerr(WFDB_FILE *fp);
+extern long wfdb_fmap(WFDB_FILE *fp, const char **data, long max);
 extern int wfdb_feof(WFDB_FILE *fp);
 extern int wfdb_ferror(WFDB_FILE *fp);
 extern int wfdb_fflush(WFDB_FILE *fp);
@@ -320,6 +438,7 @@ extern size_t wfdb_fwrite(const void *ptr, size_t size, size_t nmemb,
 			  WFDB_FILE *fp);
 extern int wfdb_getc(WFDB_FILE *fp);
 extern int wfdb_putc(int c, WFDB_FILE *fp);
+extern void wfdb_printstats(void);
 
 /* These functions are defined in signal.c */
 extern void wfdb_sampquit(void);
@@ -340,7 +459,7 @@ extern void wfdb_oaflush(void);
 
 extern char *wfdb_getirec();
 extern int wfdb_fclose(), wfdb_checkname(), wfdb_g16(), wfdb_parse_path(),
-    wfdb_fprintf();
+    wfdb_fprintf(), wfdb_fileval();
 extern long wfdb_g32();
 extern void wfdb_striphea(), wfdb_p16(), wfdb_p32(), wfdb_addtopath(),
     wfdb_setirec(), wfdb_sampquit(), wfdb_sigclose(),
@@ -351,9 +470,9 @@ extern WFDB_FILE *wfdb_open(), *wfdb_fopen();
 extern char *wfdb_fgets();
 extern int wfdb_feof(), wfdb_ferror(), wfdb_fflush(), wfdb_fseek(),
     wfdb_getc(), wfdb_putc();
-extern long wfdb_ftell();
+extern long wfdb_ftell(), wfdb_fmap();
 extern size_t wfdb_fread(), wfdb_fwrite();
-extern void wfdb_clearerr();
+extern void wfdb_clearerr(), wfdb_printstats();
 
 /* Some non-ANSI C libraries (e.g., version 7, BSD 4.2) lack an implementation
    of strtok(); define NOSTRTOK to compile the portable version in wfdbio.c. */